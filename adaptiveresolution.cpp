@@ -0,0 +1,83 @@
+#include "adaptiveresolution.h"
+
+#include <QOpenGLTimerQuery>
+#include <algorithm>
+#include <cmath>
+
+AdaptiveResolution::AdaptiveResolution(float targetFrameMs)
+    : _targetFrameMs(targetFrameMs), _scale(1), _smoothedMs(targetFrameMs)
+{
+    _queries[0] = _queries[1] = 0;
+    _queryPending[0] = _queryPending[1] = false;
+}
+
+AdaptiveResolution::~AdaptiveResolution()
+{
+    delete _queries[0];
+    delete _queries[1];
+}
+
+void AdaptiveResolution::beginScene()
+{
+    if (!_queriesCreated) {
+        _queriesCreated = true;
+        _queries[0] = new QOpenGLTimerQuery();
+        _queries[1] = new QOpenGLTimerQuery();
+        _queriesSupported = _queries[0]->create() && _queries[1]->create();
+    }
+
+    if (!_queriesSupported) {
+        _cpuClock.start();
+        return;
+    }
+
+    // collect the result of the previous frame without stalling
+    int previous = 1 - _currentQuery;
+    if (_queryPending[previous] && _queries[previous]->isResultAvailable()) {
+        sceneMeasured(_queries[previous]->waitForResult() / 1000000.0f);
+        _queryPending[previous] = false;
+    }
+
+    if (!_queryPending[_currentQuery]) {
+        _queries[_currentQuery]->begin();
+    }
+}
+
+void AdaptiveResolution::endScene()
+{
+    if (!_queriesSupported) {
+        sceneMeasured(_cpuClock.nsecsElapsed() / 1000000.0f);
+        return;
+    }
+
+    if (!_queryPending[_currentQuery]) {
+        _queries[_currentQuery]->end();
+        _queryPending[_currentQuery] = true;
+        _currentQuery = 1 - _currentQuery;
+    }
+}
+
+void AdaptiveResolution::navigationStopped()
+{
+    if (_queriesSupported) {
+        // results belong to the old scale and would skew the next navigation
+        for (int i = 0; i < 2; i++) {
+            if (_queryPending[i]) {
+                _queries[i]->waitForResult();
+                _queryPending[i] = false;
+            }
+        }
+    }
+    _smoothedMs = _targetFrameMs;
+}
+
+void AdaptiveResolution::sceneMeasured(float ms)
+{
+    // smooth out single slow frames (e.g. a texture upload)
+    _smoothedMs = _smoothedMs * 0.7f + ms * 0.3f;
+
+    // fill cost scales with pixel count, i.e. with the square of the scale
+    float correction = std::sqrt(_targetFrameMs / std::max(_smoothedMs, 0.1f));
+    correction = std::min(std::max(correction, 0.8f), 1.1f); // avoid visible pumping
+    _scale = std::min(std::max(_scale * correction, NAVIGATION_MIN_SCALE), 1.0f);
+}
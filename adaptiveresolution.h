@@ -0,0 +1,48 @@
+#ifndef ADAPTIVERESOLUTION_H
+#define ADAPTIVERESOLUTION_H
+
+#include <QElapsedTimer>
+
+class QOpenGLTimerQuery;
+
+#define NAVIGATION_TARGET_FRAME_MS 12.0f
+#define NAVIGATION_MIN_SCALE 0.25f
+
+// picks the render scale used while the camera moves so the scene draw stays
+// near a target time. The scale persists between navigations, so a heavy
+// scene starts the next orbit at the resolution that worked last time.
+//
+// Scene time is measured with GPU timer queries read one frame late, so
+// vsync and compositor waits don't count. Without timer query support the
+// CPU time of the draw is used instead.
+class AdaptiveResolution
+{
+public:
+    AdaptiveResolution(float targetFrameMs = NAVIGATION_TARGET_FRAME_MS);
+    ~AdaptiveResolution();
+
+    float scale() const { return _scale; }
+
+    // bracket the scene draw of navigation frames, the GL context must be current
+    void beginScene();
+    void endScene();
+
+    // drops queries still in flight when the camera stops
+    void navigationStopped();
+
+private:
+    void sceneMeasured(float ms);
+
+    float _targetFrameMs;
+    float _scale;
+    float _smoothedMs;
+
+    bool _queriesCreated = false;
+    bool _queriesSupported = false;
+    QOpenGLTimerQuery* _queries[2];
+    bool _queryPending[2];
+    int _currentQuery = 0;
+    QElapsedTimer _cpuClock;
+};
+
+#endif // ADAPTIVERESOLUTION_H
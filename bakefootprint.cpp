@@ -0,0 +1,140 @@
+#include "bakefootprint.h"
+
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+
+#include "geometrycache.h"
+#include "geometrystore.h"
+
+#define FOOTPRINT_CHUNK_TRIANGLES 65536
+
+namespace {
+    struct FootprintChunk
+    {
+        int firstTriangle;
+        int lastTriangle;
+        float minU = 1, minV = 1, maxU = 0, maxV = 0;
+        bool hit = false;
+    };
+}
+
+QRectF BakeFootprint::uvBounds(Mesh *mesh, const QMatrix4x4 &cameraPV, QRectF screenRect, QSize viewSize, MeshPropType space)
+{
+    const QRectF unitSquare(0, 0, 1, 1);
+
+    auto toNdc = [viewSize](QPointF p) {
+        return QPointF(p.x() / viewSize.width() * 2 - 1, p.y() / viewSize.height() * 2 - 1);
+    };
+
+    if (space == MeshPropType::UV) {
+        // the view shows uv space directly, unproject the screen rect
+        QMatrix4x4 inverse = cameraPV.inverted();
+        QPointF a = toNdc(screenRect.bottomLeft());
+        QPointF b = toNdc(screenRect.topRight());
+        QVector3D uvA = inverse.map(QVector3D(a.x(), a.y(), 0));
+        QVector3D uvB = inverse.map(QVector3D(b.x(), b.y(), 0));
+        QRectF uvRect = QRectF(QPointF(uvA.x(), uvA.y()), QPointF(uvB.x(), uvB.y())).normalized();
+        return uvRect.intersected(unitSquare);
+    }
+
+    const QPointF ndcLo = toNdc(screenRect.topLeft());
+    const QPointF ndcHi = toNdc(screenRect.bottomRight());
+    const float clipMinX = std::min(ndcLo.x(), ndcHi.x()), clipMaxX = std::max(ndcLo.x(), ndcHi.x());
+    const float clipMinY = std::min(ndcLo.y(), ndcHi.y()), clipMaxY = std::max(ndcLo.y(), ndcHi.y());
+
+    // reject meshes whose bounds miss the strokes before touching their arrays
+    MeshGeometry* geometry = GeometryCache::meshGeometry(mesh);
+    float boundsMinX = 1e30f, boundsMinY = 1e30f, boundsMaxX = -1e30f, boundsMaxY = -1e30f;
+    bool boundsBehindCamera = false;
+    for (int corner = 0; corner < 8; corner++) {
+        QVector3D p = geometry->boundsMin + geometry->boundsSize * QVector3D(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1);
+        QVector4D clip = cameraPV * QVector4D(p, 1);
+        if (clip.w() <= 0) {
+            boundsBehindCamera = true;
+            break;
+        }
+        float x = clip.x() / clip.w(), y = clip.y() / clip.w();
+        boundsMinX = std::min(boundsMinX, x); boundsMaxX = std::max(boundsMaxX, x);
+        boundsMinY = std::min(boundsMinY, y); boundsMaxY = std::max(boundsMaxY, y);
+    }
+    if (!boundsBehindCamera && (boundsMaxX < clipMinX || boundsMinX > clipMaxX || boundsMaxY < clipMinY || boundsMinY > clipMaxY))
+        return QRectF();
+
+    GeometryStore::ensureHostGeometry(mesh);
+
+    const int vertexCount = mesh->_vertices.size() / 3;
+    const int uvStride = vertexCount > 0 ? mesh->_uvs.size() / vertexCount : 0;
+    const int triangleCount = mesh->_triangleIndices.size() / 3;
+    if (triangleCount == 0 || uvStride < 2)
+        return QRectF();
+
+    QVector<FootprintChunk> chunks;
+    for (int first = 0; first < triangleCount; first += FOOTPRINT_CHUNK_TRIANGLES) {
+        FootprintChunk chunk;
+        chunk.firstTriangle = first;
+        chunk.lastTriangle = std::min(first + FOOTPRINT_CHUNK_TRIANGLES, triangleCount);
+        chunks.append(chunk);
+    }
+
+    const float* positions = mesh->_vertices.constData();
+    const float* uvs = mesh->_uvs.constData();
+
+    QtConcurrent::blockingMap(chunks, [&](FootprintChunk& chunk) {
+        for (int t = chunk.firstTriangle; t < chunk.lastTriangle; t++) {
+            float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+            bool behindCamera = false;
+            int v[3];
+
+            for (int c = 0; c < 3; c++) {
+                v[c] = mesh->_triangleIndices[t*3 + c];
+                QVector4D clip = cameraPV * QVector4D(positions[v[c]*3], positions[v[c]*3+1], positions[v[c]*3+2], 1);
+                if (clip.w() <= 0) {
+                    behindCamera = true;
+                    break;
+                }
+                float x = clip.x() / clip.w(), y = clip.y() / clip.w();
+                minX = std::min(minX, x); maxX = std::max(maxX, x);
+                minY = std::min(minY, y); maxY = std::max(maxY, y);
+            }
+
+            // triangles crossing the eye plane are kept to stay conservative
+            if (!behindCamera && (maxX < clipMinX || minX > clipMaxX || maxY < clipMinY || minY > clipMaxY))
+                continue;
+
+            for (int c = 0; c < 3; c++) {
+                float u = uvs[v[c]*uvStride], w = uvs[v[c]*uvStride + 1];
+                chunk.minU = std::min(chunk.minU, u); chunk.maxU = std::max(chunk.maxU, u);
+                chunk.minV = std::min(chunk.minV, w); chunk.maxV = std::max(chunk.maxV, w);
+            }
+            chunk.hit = true;
+        }
+    });
+
+    QRectF bounds;
+    foreach (const FootprintChunk& chunk, chunks) {
+        if (chunk.hit) {
+            bounds = bounds.united(QRectF(QPointF(chunk.minU, chunk.minV), QPointF(chunk.maxU, chunk.maxV)));
+        }
+    }
+
+    // tiled uvs wrap, so anything outside the unit square touches all of it
+    if (bounds.left() < 0 || bounds.top() < 0 || bounds.right() > 1 || bounds.bottom() > 1)
+        return unitSquare;
+
+    return bounds;
+}
+
+QRect BakeFootprint::texelRect(QRectF uvBounds, int textureSize)
+{
+    if (uvBounds.isNull())
+        return QRect();
+
+    const int pad = 2;
+    int x0 = (int)std::floor(uvBounds.left() * textureSize) - pad;
+    int y0 = (int)std::floor(uvBounds.top() * textureSize) - pad;
+    int x1 = (int)std::ceil(uvBounds.right() * textureSize) + pad;
+    int y1 = (int)std::ceil(uvBounds.bottom() * textureSize) + pad;
+
+    return QRect(QPoint(x0, y0), QPoint(x1 - 1, y1 - 1)).intersected(QRect(0, 0, textureSize, textureSize));
+}
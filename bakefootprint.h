@@ -0,0 +1,26 @@
+#ifndef BAKEFOOTPRINT_H
+#define BAKEFOOTPRINT_H
+
+#include <QRect>
+#include <QRectF>
+#include <QSize>
+#include <QMatrix4x4>
+
+#include "mesh.h"
+#include "constants.h"
+
+// finds which part of a mesh texture a bake can change, from the screen
+// area covered by the paint strokes. The result is conservative: occluded
+// and back facing triangles under the strokes are included.
+class BakeFootprint
+{
+public:
+    // uv bounds in [0,1] of the triangles under screenRect, given in GL
+    // window coordinates (origin bottom left). Empty if nothing is covered.
+    static QRectF uvBounds(Mesh* mesh, const QMatrix4x4& cameraPV, QRectF screenRect, QSize viewSize, MeshPropType space);
+
+    // uv bounds to texel rect, padded for bilinear sampling
+    static QRect texelRect(QRectF uvBounds, int textureSize);
+};
+
+#endif // BAKEFOOTPRINT_H
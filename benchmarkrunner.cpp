@@ -0,0 +1,389 @@
+#include "benchmarkrunner.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QFile>
+#include <QMouseEvent>
+#include <QKeyEvent>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QSysInfo>
+#include <QThreadPool>
+#include <QTimer>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "glview.h"
+#include "camera.h"
+#include "project.h"
+#include "scenetablemodel.h"
+#include "meshprocessor.h"
+#include "meshnameindex.h"
+#include "maskbaker.h"
+
+namespace {
+    float elapsedMs(const QElapsedTimer& timer)
+    {
+        return timer.nsecsElapsed() / 1000000.0f;
+    }
+
+    void finishGL()
+    {
+        QOpenGLContext::currentContext()->functions()->glFinish();
+    }
+}
+
+BenchmarkRunner::BenchmarkRunner(QString reportPath, QObject *parent)
+    : QObject(parent), _reportPath(reportPath)
+{
+}
+
+Mesh* BenchmarkRunner::gridMesh(int triangles)
+{
+    int side = std::max(1, (int)std::sqrt(triangles / 2.0));
+
+    Mesh* mesh = new Mesh();
+    for (int z = 0; z <= side; z++) {
+        for (int x = 0; x <= side; x++) {
+            float u = (float)x / side;
+            float v = (float)z / side;
+            mesh->addVertex(u * 2 - 1, 0, v * 2 - 1);
+            mesh->addUV(u, v);
+        }
+    }
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) {
+            int corner = z * (side + 1) + x;
+            mesh->addTriangle(corner, corner + 1, corner + side + 2);
+            mesh->addTriangle(corner, corner + side + 2, corner + side + 1);
+        }
+    }
+    mesh->setMeshName(QString("grid %1").arg(side * side * 2));
+    return mesh;
+}
+
+void BenchmarkRunner::start()
+{
+    std::cout << "running benchmarks, report goes to " << _reportPath.toStdString() << std::endl;
+
+    _stages.clear();
+    _stages << [this]() { return benchMeshBuild(100000); }
+            << [this]() { return benchMeshBuild(1000000); }
+            << [this]() { return benchCamera(); }
+            << [this]() { return benchStrokeDabs(); }
+            << [this]() { return benchMaskBake(); }
+            << [this]() { return benchSceneTable(1000); }
+            << [this]() { return waitForImports(); }
+            << [this]() { removeSceneMeshes(); return true; }
+            << [this]() { return benchSceneTable(10000); }
+            << [this]() { return waitForImports(); }
+            << [this]() { removeSceneMeshes(); return true; }
+            << [this]() {
+                   _sceneMeshes.append(gridMesh(1000000));
+                   Project::activeProject()->addMesh(_sceneMeshes.last());
+                   return true;
+               }
+            << [this]() { return waitForImports(); }
+            << [this]() { return benchDrawScene(); }
+            << [this]() { return benchBake(); }
+            << [this]() { removeSceneMeshes(); return true; };
+
+    _nextStage = 0;
+    _cases = QJsonObject();
+    QTimer::singleShot(0, this, SLOT(step()));
+}
+
+void BenchmarkRunner::step()
+{
+    if (_nextStage >= _stages.size()) {
+        finish();
+        return;
+    }
+
+    if (_stages[_nextStage]()) {
+        _nextStage++;
+        QTimer::singleShot(0, this, SLOT(step()));
+    } else {
+        QTimer::singleShot(10, this, SLOT(step()));
+    }
+}
+
+void BenchmarkRunner::addCase(QString name, const QList<float>& samplesMs)
+{
+    QList<float> sorted = samplesMs;
+    std::sort(sorted.begin(), sorted.end());
+
+    double sum = 0;
+    foreach (float ms, sorted) {
+        sum += ms;
+    }
+
+    QJsonObject json;
+    json["iterations"] = sorted.size();
+    json["mean_ms"] = sorted.isEmpty() ? 0 : sum / sorted.size();
+    json["min_ms"] = sorted.isEmpty() ? 0 : sorted.first();
+    json["median_ms"] = sorted.isEmpty() ? 0 : sorted[sorted.size() / 2];
+    json["max_ms"] = sorted.isEmpty() ? 0 : sorted.last();
+    _cases[name] = json;
+
+    std::cout << name.toStdString() << ": " << json["median_ms"].toDouble() << " ms median over "
+              << sorted.size() << " runs" << std::endl;
+}
+
+bool BenchmarkRunner::waitForImports()
+{
+    foreach (Mesh* mesh, _sceneMeshes) {
+        if (MeshProcessor::instance()->isProcessing(mesh))
+            return false;
+    }
+    return true;
+}
+
+void BenchmarkRunner::removeSceneMeshes()
+{
+    Project::activeProject()->reset();
+    qDeleteAll(_sceneMeshes);
+    _sceneMeshes.clear();
+}
+
+bool BenchmarkRunner::benchMeshBuild(int triangles)
+{
+    QList<float> samples;
+    for (int i = 0; i < 5; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        Mesh* mesh = gridMesh(triangles);
+        samples.append(elapsedMs(timer));
+        delete mesh;
+    }
+    addCase(QString("mesh_build_%1").arg(triangles), samples);
+    return true;
+}
+
+bool BenchmarkRunner::benchCamera()
+{
+    PerspectiveCamera camera;
+    QList<float> samples;
+    static volatile float checksum = 0; // keeps the loop from being optimized out
+
+    for (int i = 0; i < 20; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        for (int j = 0; j < 10000; j++) {
+            QMatrix4x4 pv = camera.getProjMatrix(1920, 1080 + j % 2) * camera.getViewMatrix(1920, 1080);
+            checksum += pv(0, 0);
+        }
+        samples.append(elapsedMs(timer));
+    }
+
+    addCase("camera_matrices_10k", samples);
+    return true;
+}
+
+bool BenchmarkRunner::benchStrokeDabs()
+{
+    // long zigzag, as a fast stroke across a full HD view
+    QList<Point2> points;
+    for (int i = 0; i < 100; i++) {
+        points.append(Point2((i % 2) * 1900 + 10, i * 10 + 10));
+    }
+
+    QList<float> samples;
+    int dabs = 0;
+    for (int i = 0; i < 20; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        dabs = GLView::strokeDabs(points).size();
+        samples.append(elapsedMs(timer));
+    }
+
+    addCase(QString("stroke_dabs_%1").arg(dabs), samples);
+    return true;
+}
+
+bool BenchmarkRunner::benchSceneTable(int meshCount)
+{
+    Project* project = Project::activeProject();
+    for (int i = 0; i < meshCount; i++) {
+        Mesh* mesh = gridMesh(2);
+        mesh->setMeshName(QString("mesh %1").arg(i));
+        _sceneMeshes.append(mesh);
+        project->addMesh(mesh);
+    }
+
+    QList<float> build;
+    for (int i = 0; i < 5; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        SceneTableModel model;
+        build.append(elapsedMs(timer));
+    }
+    addCase(QString("scene_table_build_%1").arg(meshCount), build);
+
+    // one more mesh with a live model, the path taken on every import
+    QList<float> added;
+    SceneTableModel model;
+    for (int i = 0; i < 5; i++) {
+        Mesh* mesh = gridMesh(2);
+        _sceneMeshes.append(mesh);
+
+        QElapsedTimer timer;
+        timer.start();
+        project->addMesh(mesh);
+        added.append(elapsedMs(timer));
+    }
+    addCase(QString("scene_table_add_%1").arg(meshCount), added);
+
+    // outliner search, a selective substring and a glob
+    QList<float> search;
+    for (int i = 0; i < 20; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        MeshNameIndex::instance()->query(QString("mesh %1").arg(i * 37));
+        MeshNameIndex::instance()->query("*9?1*");
+        search.append(elapsedMs(timer));
+    }
+    addCase(QString("scene_name_search_%1").arg(meshCount), search);
+    return true;
+}
+
+bool BenchmarkRunner::benchDrawScene()
+{
+    if (GLView::views().isEmpty() || !GLView::views().first()->isValid())
+        return false;
+
+    GLView* view = GLView::views().first();
+    view->makeCurrent();
+
+    // first draw uploads geometry and creates the texture
+    view->drawScene();
+    finishGL();
+
+    QList<float> samples;
+    for (int i = 0; i < BENCHMARK_DRAW_ITERATIONS; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        view->drawScene();
+        finishGL();
+        samples.append(elapsedMs(timer));
+    }
+
+    view->doneCurrent();
+    addCase("draw_scene_1m", samples);
+    return true;
+}
+
+bool BenchmarkRunner::benchBake()
+{
+    GLView* view = GLView::views().first();
+    QPoint center(view->width() / 2, view->height() / 2);
+    int reach = std::min(view->width(), view->height()) / 4;
+
+    QList<float> samples;
+    for (int i = 0; i < BENCHMARK_BAKE_ITERATIONS; i++) {
+        QMouseEvent press(QEvent::MouseButtonPress, center - QPoint(reach, 0), Qt::LeftButton, Qt::LeftButton, Qt::NoModifier);
+        view->mousePressEvent(&press);
+        for (int x = -reach; x <= reach; x += 8) {
+            QMouseEvent move(QEvent::MouseMove, center + QPoint(x, (x / 8) % 2 * 8), Qt::NoButton, Qt::LeftButton, Qt::NoModifier);
+            view->mouseMoveEvent(&move);
+        }
+        QMouseEvent release(QEvent::MouseButtonRelease, center + QPoint(reach, 0), Qt::LeftButton, Qt::NoButton, Qt::NoModifier);
+        view->mouseReleaseEvent(&release);
+        view->repaint(); // strokes reach the paint layer when drawn
+
+        QKeyEvent bake(QEvent::KeyPress, Qt::Key_Space, Qt::NoModifier);
+        QElapsedTimer timer;
+        timer.start();
+        view->keyPressEvent(&bake);
+        view->makeCurrent();
+        finishGL();
+        samples.append(elapsedMs(timer));
+        view->doneCurrent();
+    }
+
+    addCase("bake_stroke_1m", samples);
+    return true;
+}
+
+bool BenchmarkRunner::benchMaskBake()
+{
+    // rippled grid, so rays from the troughs hit the crests
+    Mesh* mesh = gridMesh(20000);
+    MaskBakeInput input;
+    input.type = MaskType::AMBIENT_OCCLUSION;
+    input.size = 256;
+    input.vertices = mesh->_vertices;
+    input.uvs = mesh->_uvs;
+    for (int i = 0; i < mesh->_triangleIndices.size(); i++) {
+        input.indices.append(mesh->_triangleIndices[i]);
+    }
+    for (int v = 0; v < input.vertices.size() / 3; v++) {
+        float x = input.vertices[v * 3], z = input.vertices[v * 3 + 2];
+        input.vertices[v * 3 + 1] = 0.1f * std::sin(x * 12) * std::cos(z * 12);
+    }
+    delete mesh;
+
+    // once on one thread and once on all of them, for the scaling
+    QThreadPool* pool = QThreadPool::globalInstance();
+    int threads = pool->maxThreadCount();
+    QList<int> threadCounts;
+    threadCounts << 1;
+    if (threads > 1) {
+        threadCounts << threads;
+    }
+
+    foreach (int count, threadCounts) {
+        pool->setMaxThreadCount(count);
+        QList<float> samples;
+        MaskBakeStats stats;
+        for (int i = 0; i < 3; i++) {
+            MaskBaker::bakeMask(input, &stats);
+            samples.append(stats.ms);
+        }
+        QString name = QString("mask_occlusion_%1_threads_%2").arg(input.size).arg(count);
+        addCase(name, samples);
+
+        QJsonObject json = _cases[name].toObject();
+        json["mrays_per_second"] = stats.ms > 0 ? stats.rays / (stats.ms * 1000.0) : 0;
+        _cases[name] = json;
+    }
+    pool->setMaxThreadCount(threads);
+    return true;
+}
+
+void BenchmarkRunner::finish()
+{
+    QJsonObject report;
+    report["cases"] = _cases;
+    report["qt"] = qVersion();
+    report["os"] = QSysInfo::prettyProductName();
+    report["cpu"] = QSysInfo::currentCpuArchitecture();
+#ifdef QT_NO_DEBUG
+    report["build"] = "release";
+#else
+    report["build"] = "debug";
+#endif
+
+    if (!GLView::views().isEmpty()) {
+        GLView* view = GLView::views().first();
+        view->makeCurrent();
+        QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+        report["gl_renderer"] = QString((const char*)f->glGetString(GL_RENDERER));
+        report["gl_version"] = QString((const char*)f->glGetString(GL_VERSION));
+        view->doneCurrent();
+    }
+
+    QByteArray json = QJsonDocument(report).toJson();
+    std::cout << json.constData() << std::endl;
+
+    QFile reportFile(_reportPath);
+    if (reportFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        reportFile.write(json);
+    } else {
+        std::cerr << "unable to write benchmark report: " << _reportPath.toStdString() << std::endl;
+    }
+
+    emit finished(report);
+}
@@ -0,0 +1,63 @@
+#ifndef BENCHMARKRUNNER_H
+#define BENCHMARKRUNNER_H
+
+#include <QObject>
+#include <QList>
+#include <QJsonObject>
+#include <functional>
+
+#include "mesh.h"
+
+#define BENCHMARK_DRAW_ITERATIONS 50
+#define BENCHMARK_BAKE_ITERATIONS 20
+
+// fixed set of timed cases over the CPU and GL hot paths, so builds can be
+// compared against each other. Started with PAINTBUG_BENCHMARK set to the
+// path of the JSON report. Runs headless with QT_QPA_PLATFORM=offscreen
+// and Mesa (LIBGL_ALWAYS_SOFTWARE=1).
+//
+// Cases run one per event loop turn so views get their GL context and
+// mesh imports can finish in between. The project should be empty, the
+// scene cases add and remove their own meshes.
+class BenchmarkRunner : public QObject
+{
+    Q_OBJECT
+public:
+    explicit BenchmarkRunner(QString reportPath, QObject *parent = 0);
+
+    void start();
+
+    // triangulated grid in the xz plane spanning [-1,1], with uvs
+    static Mesh* gridMesh(int triangles);
+
+signals:
+    void finished(QJsonObject report);
+
+private slots:
+    void step();
+
+private:
+    // a stage returns false to be called again on a later turn
+    typedef std::function<bool()> Stage;
+
+    void addCase(QString name, const QList<float>& samplesMs);
+    bool waitForImports();
+    void removeSceneMeshes();
+    void finish();
+
+    bool benchMeshBuild(int triangles);
+    bool benchCamera();
+    bool benchStrokeDabs();
+    bool benchMaskBake();
+    bool benchSceneTable(int meshCount);
+    bool benchDrawScene();
+    bool benchBake();
+
+    QString _reportPath;
+    QList<Stage> _stages;
+    int _nextStage = 0;
+    QJsonObject _cases;
+    QList<Mesh*> _sceneMeshes;
+};
+
+#endif // BENCHMARKRUNNER_H
@@ -0,0 +1,196 @@
+#include "blockencoder.h"
+
+#include <algorithm>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+    inline quint16 toRgb565(int r, int g, int b)
+    {
+        return (quint16)((((r * 31 + 127) / 255) << 11) | (((g * 63 + 127) / 255) << 5) | ((b * 31 + 127) / 255));
+    }
+
+    inline void fromRgb565(quint16 color, int* rgb)
+    {
+        int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    void loadBlock(const uchar* rgba, int width, int height, int bx, int by, uchar* block)
+    {
+        for (int y = 0; y < 4; y++) {
+            int sy = std::min(by * 4 + y, height - 1);
+            for (int x = 0; x < 4; x++) {
+                int sx = std::min(bx * 4 + x, width - 1);
+                memcpy(block + (y * 4 + x) * 4, rgba + (sy * width + sx) * 4, 4);
+            }
+        }
+    }
+
+    // per channel min and max over the 16 texels
+    void blockBounds(const uchar* block, uchar* minColor, uchar* maxColor)
+    {
+#ifdef __SSE2__
+        __m128i r0 = _mm_loadu_si128((const __m128i*)(block));
+        __m128i r1 = _mm_loadu_si128((const __m128i*)(block + 16));
+        __m128i r2 = _mm_loadu_si128((const __m128i*)(block + 32));
+        __m128i r3 = _mm_loadu_si128((const __m128i*)(block + 48));
+
+        __m128i lo = _mm_min_epu8(_mm_min_epu8(r0, r1), _mm_min_epu8(r2, r3));
+        __m128i hi = _mm_max_epu8(_mm_max_epu8(r0, r1), _mm_max_epu8(r2, r3));
+
+        // fold the four texels of a row together
+        lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 8));
+        lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 4));
+        hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 8));
+        hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 4));
+
+        int packedLo = _mm_cvtsi128_si32(lo);
+        int packedHi = _mm_cvtsi128_si32(hi);
+        memcpy(minColor, &packedLo, 4);
+        memcpy(maxColor, &packedHi, 4);
+#else
+        for (int c = 0; c < 4; c++) {
+            minColor[c] = 255;
+            maxColor[c] = 0;
+        }
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 4; c++) {
+                minColor[c] = std::min(minColor[c], block[i * 4 + c]);
+                maxColor[c] = std::max(maxColor[c], block[i * 4 + c]);
+            }
+        }
+#endif
+    }
+
+    void encodeColor(const uchar* block, const uchar* minColor, const uchar* maxColor, uchar* out)
+    {
+        // inset the box a little, the endpoints are rarely hit exactly
+        int lo[3], hi[3];
+        for (int c = 0; c < 3; c++) {
+            int inset = (maxColor[c] - minColor[c]) >> 4;
+            lo[c] = minColor[c] + inset;
+            hi[c] = maxColor[c] - inset;
+        }
+
+        quint16 color0 = toRgb565(hi[0], hi[1], hi[2]);
+        quint16 color1 = toRgb565(lo[0], lo[1], lo[2]);
+
+        quint32 indices = 0;
+        if (color0 != color1) {
+            // color0 > color1 selects the four color mode
+            if (color0 < color1) {
+                std::swap(color0, color1);
+            }
+
+            int palette[4][3];
+            fromRgb565(color0, palette[0]);
+            fromRgb565(color1, palette[1]);
+            for (int c = 0; c < 3; c++) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+
+            for (int i = 0; i < 16; i++) {
+                const uchar* texel = block + i * 4;
+                int best = 0, bestDistance = 1 << 30;
+                for (int p = 0; p < 4; p++) {
+                    int dr = texel[0] - palette[p][0], dg = texel[1] - palette[p][1], db = texel[2] - palette[p][2];
+                    int distance = dr * dr + dg * dg + db * db;
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= (quint32)best << (i * 2);
+            }
+        }
+
+        out[0] = color0 & 0xff; out[1] = color0 >> 8;
+        out[2] = color1 & 0xff; out[3] = color1 >> 8;
+        out[4] = indices & 0xff; out[5] = (indices >> 8) & 0xff;
+        out[6] = (indices >> 16) & 0xff; out[7] = indices >> 24;
+    }
+
+    void encodeAlpha(const uchar* block, uchar minAlpha, uchar maxAlpha, uchar* out)
+    {
+        quint64 indices = 0;
+        if (minAlpha != maxAlpha) {
+            // alpha0 > alpha1 selects eight interpolated values
+            int palette[8];
+            palette[0] = maxAlpha;
+            palette[1] = minAlpha;
+            for (int i = 2; i < 8; i++) {
+                palette[i] = ((8 - i) * maxAlpha + (i - 1) * minAlpha) / 7;
+            }
+
+            for (int i = 0; i < 16; i++) {
+                int alpha = block[i * 4 + 3];
+                int best = 0, bestDistance = 256;
+                for (int p = 0; p < 8; p++) {
+                    int distance = std::abs(alpha - palette[p]);
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= (quint64)best << (i * 3);
+            }
+        }
+
+        out[0] = maxAlpha;
+        out[1] = minAlpha;
+        for (int b = 0; b < 6; b++) {
+            out[2 + b] = (indices >> (b * 8)) & 0xff;
+        }
+    }
+}
+
+bool BlockEncoder::hasAlpha(const uchar *rgba, int pixelCount)
+{
+    for (int i = 0; i < pixelCount; i++) {
+        if (rgba[i * 4 + 3] != 255)
+            return true;
+    }
+    return false;
+}
+
+int BlockEncoder::blockBytes(bool alpha)
+{
+    return alpha ? 16 : 8;
+}
+
+int BlockEncoder::encodedSize(int width, int height, bool alpha)
+{
+    return ((width + 3) / 4) * ((height + 3) / 4) * blockBytes(alpha);
+}
+
+void BlockEncoder::encodeRows(const uchar *rgba, int width, int height, bool alpha,
+                              uchar *out, int firstBlockRow, int lastBlockRow)
+{
+    const int blocksWide = (width + 3) / 4;
+    const int bytes = blockBytes(alpha);
+
+    uchar block[64];
+    uchar minColor[4], maxColor[4];
+
+    for (int by = firstBlockRow; by < lastBlockRow; by++) {
+        for (int bx = 0; bx < blocksWide; bx++) {
+            uchar* blockOut = out + (by * blocksWide + bx) * bytes;
+
+            loadBlock(rgba, width, height, bx, by, block);
+            blockBounds(block, minColor, maxColor);
+
+            if (alpha) {
+                encodeAlpha(block, minColor[3], maxColor[3], blockOut);
+                blockOut += 8;
+            }
+            encodeColor(block, minColor, maxColor, blockOut);
+        }
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef BLOCKENCODER_H
+#define BLOCKENCODER_H
+
+#include <QtGlobal>
+
+// CPU encoder for S3TC / BC block compressed textures. It fits each 4x4
+// block to the inset bounding box of its colors, which is fast enough to
+// run over whole scenes in the background and close to what the driver
+// would produce. BC1 stores opaque color in 8 bytes per block, BC3 adds an
+// alpha block for 16 bytes.
+class BlockEncoder
+{
+public:
+    static bool hasAlpha(const uchar* rgba, int pixelCount);
+
+    static int blockBytes(bool alpha);
+    static int encodedSize(int width, int height, bool alpha);
+
+    // encodes block rows [firstBlockRow, lastBlockRow) of an RGBA8 image into
+    // out, which holds encodedSize bytes. Edge blocks repeat the last texel.
+    // Disjoint row ranges can be encoded concurrently
+    static void encodeRows(const uchar* rgba, int width, int height, bool alpha,
+                           uchar* out, int firstBlockRow, int lastBlockRow);
+};
+
+#endif // BLOCKENCODER_H
@@ -0,0 +1,229 @@
+#include "brushlibrary.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QPainter>
+#include <QPixmapCache>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QOpenGLTexture>
+#include <QtConcurrent>
+#include <cmath>
+#include <iostream>
+
+#include "glview.h"
+
+namespace {
+    struct DecodedBrush
+    {
+        QString path;
+        QImage image;
+        QByteArray contentHash;
+    };
+
+    DecodedBrush decodeBrush(const QString& path)
+    {
+        DecodedBrush decoded;
+        decoded.path = path;
+
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly))
+            return decoded;
+
+        QByteArray bytes = file.readAll();
+        decoded.contentHash = QCryptographicHash::hash(bytes, QCryptographicHash::Sha1);
+
+        QImage image = QImage::fromData(bytes);
+        if (image.isNull())
+            return decoded;
+
+        // layers of a texture array share one size
+        decoded.image = image.scaled(BRUSH_LAYER_SIZE, BRUSH_LAYER_SIZE, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+                .convertToFormat(QImage::Format_RGBA8888);
+        return decoded;
+    }
+
+    QString thumbnailPath(const QString& key)
+    {
+        QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/brush-thumbnails";
+        return dir + "/" + key + ".png";
+    }
+
+    // the brush dabbed along an S curve, like a short stroke on the canvas
+    QImage renderThumbnail(BrushPreset preset, QImage brush)
+    {
+        QString path = thumbnailPath(preset.key());
+        QImage cached(path);
+        if (cached.size() == QSize(BRUSH_THUMBNAIL_WIDTH, BRUSH_THUMBNAIL_HEIGHT))
+            return cached;
+
+        // brush images are white with alpha, tint them to show on buttons
+        QImage tinted(brush.size(), QImage::Format_ARGB32_Premultiplied);
+        tinted.fill(QColor(30, 30, 30));
+        QPainter tint(&tinted);
+        tint.setCompositionMode(QPainter::CompositionMode_DestinationIn);
+        tint.drawImage(0, 0, brush);
+        tint.end();
+
+        float dabSize = BRUSH_THUMBNAIL_HEIGHT * 0.5f;
+        float margin = dabSize * 0.5f + 2;
+        QList<Point2> points;
+        for (int i = 0; i <= 16; i++) {
+            float t = i / 16.0f;
+            float x = margin + t * (BRUSH_THUMBNAIL_WIDTH - 2 * margin);
+            float y = BRUSH_THUMBNAIL_HEIGHT * 0.5f + std::sin(t * 6.2831853f) * (BRUSH_THUMBNAIL_HEIGHT * 0.5f - margin);
+            points.append(Point2(x, y));
+        }
+
+        QImage thumbnail(BRUSH_THUMBNAIL_WIDTH, BRUSH_THUMBNAIL_HEIGHT, QImage::Format_ARGB32_Premultiplied);
+        thumbnail.fill(Qt::transparent);
+        QPainter painter(&thumbnail);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform);
+        painter.setOpacity(preset.opacity);
+        foreach (Point2 p, GLView::strokeDabs(points, preset.spacing)) {
+            painter.drawImage(QRectF(p.x() - dabSize * 0.5f, p.y() - dabSize * 0.5f, dabSize, dabSize), tinted);
+        }
+        painter.end();
+
+        QDir().mkpath(QFileInfo(path).absolutePath());
+        if (!thumbnail.save(path)) {
+            std::cerr << "unable to cache brush thumbnail: " << path.toStdString() << std::endl;
+        }
+        return thumbnail;
+    }
+}
+
+QString BrushPreset::key() const
+{
+    QByteArray data = contentHash;
+    data += QString("%1:%2:%3x%4:%5").arg(opacity).arg(spacing)
+            .arg(BRUSH_THUMBNAIL_WIDTH).arg(BRUSH_THUMBNAIL_HEIGHT).arg(BRUSH_THUMBNAIL_VERSION).toUtf8();
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex();
+}
+
+BrushLibrary::BrushLibrary(QObject *parent) : QObject(parent)
+{
+}
+
+BrushLibrary* BrushLibrary::instance()
+{
+    static BrushLibrary* library = new BrushLibrary();
+    return library;
+}
+
+void BrushLibrary::loadDirectory(QString path)
+{
+    if (_loadedDirectories.contains(path))
+        return;
+    _loadedDirectories.append(path);
+
+    QDir dir(path);
+    QStringList paths;
+    foreach (QString name, dir.entryList(QStringList() << "*.png" << "*.jpg" << "*.bmp", QDir::Files, QDir::Name)) {
+        paths.append(dir.filePath(name));
+    }
+
+    QJsonObject settings;
+    QFile settingsFile(dir.filePath("presets.json"));
+    if (settingsFile.open(QIODevice::ReadOnly)) {
+        settings = QJsonDocument::fromJson(settingsFile.readAll()).object();
+    }
+
+    QFutureWatcher<DecodedBrush>* watcher = new QFutureWatcher<DecodedBrush>(this);
+    connect(watcher, &QFutureWatcher<DecodedBrush>::finished, this, [this, watcher, settings]() {
+        watcher->deleteLater();
+
+        foreach (const DecodedBrush& decoded, watcher->future().results()) {
+            if (decoded.image.isNull()) {
+                std::cerr << "unable to decode brush: " << decoded.path.toStdString() << std::endl;
+                continue;
+            }
+
+            QString fileName = QFileInfo(decoded.path).fileName();
+            QJsonObject presetSettings = settings.value(fileName).toObject();
+
+            BrushPreset preset;
+            preset.imagePath = decoded.path;
+            preset.name = presetSettings.value("name").toString(QFileInfo(decoded.path).baseName());
+            preset.opacity = presetSettings.value("opacity").toDouble(1);
+            preset.spacing = std::max(presetSettings.value("spacing").toDouble(1), 0.25);
+            preset.contentHash = decoded.contentHash;
+
+            _presets.append(preset);
+            _images.append(decoded.image);
+        }
+
+        _textureDirty = true;
+        emit presetsChanged();
+    });
+    watcher->setFuture(QtConcurrent::mapped(paths, decodeBrush));
+}
+
+void BrushLibrary::setActivePreset(int index)
+{
+    if (_presets.isEmpty())
+        return;
+
+    index = qBound(0, index, _presets.size() - 1);
+    if (index != _activePreset) {
+        _activePreset = index;
+        emit activePresetChanged();
+    }
+}
+
+QOpenGLTexture* BrushLibrary::textureArray()
+{
+    if (_textureDirty && !_images.isEmpty()) {
+        delete _textureArray;
+
+        _textureArray = new QOpenGLTexture(QOpenGLTexture::Target2DArray);
+        _textureArray->setSize(BRUSH_LAYER_SIZE, BRUSH_LAYER_SIZE);
+        _textureArray->setLayers(_images.size());
+        _textureArray->setFormat(QOpenGLTexture::RGBA8_UNorm);
+        _textureArray->setMipLevels(_textureArray->maximumMipLevels());
+        _textureArray->allocateStorage();
+        for (int layer = 0; layer < _images.size(); layer++) {
+            _textureArray->setData(0, layer, QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, _images[layer].constBits());
+        }
+        _textureArray->generateMipMaps();
+        _textureArray->setMinMagFilters(QOpenGLTexture::LinearMipMapLinear, QOpenGLTexture::Linear);
+        _textureArray->setWrapMode(QOpenGLTexture::ClampToEdge);
+
+        _textureDirty = false;
+    }
+    return _textureArray;
+}
+
+QPixmap BrushLibrary::thumbnail(int index)
+{
+    const BrushPreset& preset = _presets[index];
+    QString key = preset.key();
+
+    QPixmap pixmap;
+    if (QPixmapCache::find("brush:" + key, &pixmap))
+        return pixmap;
+
+    if (!_renderingThumbnails.contains(key)) {
+        _renderingThumbnails.insert(key);
+
+        QFutureWatcher<QImage>* watcher = new QFutureWatcher<QImage>(this);
+        connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher, key]() {
+            watcher->deleteLater();
+            _renderingThumbnails.remove(key);
+            QPixmapCache::insert("brush:" + key, QPixmap::fromImage(watcher->result()));
+
+            // presets with the same look share the thumbnail
+            for (int i = 0; i < _presets.size(); i++) {
+                if (_presets[i].key() == key) {
+                    emit thumbnailReady(i);
+                }
+            }
+        });
+        watcher->setFuture(QtConcurrent::run(renderThumbnail, preset, _images[index]));
+    }
+
+    return QPixmap();
+}
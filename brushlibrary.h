@@ -0,0 +1,78 @@
+#ifndef BRUSHLIBRARY_H
+#define BRUSHLIBRARY_H
+
+#include <QObject>
+#include <QVector>
+#include <QImage>
+#include <QPixmap>
+#include <QSet>
+#include <QStringList>
+
+class QOpenGLTexture;
+
+#define BRUSH_LAYER_SIZE 128
+#define BRUSH_THUMBNAIL_WIDTH 96
+#define BRUSH_THUMBNAIL_HEIGHT 48
+#define BRUSH_THUMBNAIL_VERSION 1 // bump when thumbnail rendering changes
+
+struct BrushPreset
+{
+    QString name;
+    QString imagePath;
+    float opacity = 1;
+    float spacing = 1;       // window pixels between interpolated dabs
+    QByteArray contentHash;  // of the image file
+
+    // identifies how the preset looks, keys its cached thumbnail
+    QString key() const;
+};
+
+// brush presets with images decoded on worker threads. The decoded images
+// share one GL_TEXTURE_2D_ARRAY so switching brushes is a uniform change.
+//
+// Thumbnails of a preview stroke are rendered once on a worker, kept in
+// QPixmapCache and on disk under the cache location, so showing a palette
+// only blits pixmaps.
+class BrushLibrary : public QObject
+{
+    Q_OBJECT
+public:
+    static BrushLibrary* instance();
+
+    // every image in the directory becomes a preset. A presets.json there
+    // may set name, opacity and spacing keyed by file name.
+    void loadDirectory(QString path);
+
+    int presetCount() const { return _presets.size(); }
+    const BrushPreset& preset(int index) const { return _presets[index]; }
+
+    int activePreset() const { return _activePreset; }
+    void setActivePreset(int index);
+
+    // with a GL context current, layer i holds preset i. 0 until the first
+    // images are decoded.
+    QOpenGLTexture* textureArray();
+
+    // null until rendered, thumbnailReady follows
+    QPixmap thumbnail(int index);
+
+signals:
+    void presetsChanged();
+    void activePresetChanged();
+    void thumbnailReady(int index);
+
+private:
+    explicit BrushLibrary(QObject *parent = 0);
+
+    QVector<BrushPreset> _presets;
+    QVector<QImage> _images; // BRUSH_LAYER_SIZE square, one per preset
+    int _activePreset = 0;
+
+    QOpenGLTexture* _textureArray = 0;
+    bool _textureDirty = false;
+
+    QStringList _loadedDirectories;
+    QSet<QString> _renderingThumbnails;
+};
+
+#endif // BRUSHLIBRARY_H
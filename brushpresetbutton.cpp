@@ -0,0 +1,42 @@
+#include "brushpresetbutton.h"
+
+#include <QPainter>
+
+#include "brushlibrary.h"
+
+BrushPresetButton::BrushPresetButton(int preset, QWidget *parent) : QToolButton(parent), _preset(preset)
+{
+    BrushLibrary* library = BrushLibrary::instance();
+    setCheckable(true);
+    setChecked(library->activePreset() == preset);
+    setToolTip(library->preset(preset).name);
+
+    connect(this, &QToolButton::clicked, this, [this]() {
+        BrushLibrary::instance()->setActivePreset(_preset);
+    });
+    connect(library, &BrushLibrary::activePresetChanged, this, [this]() {
+        setChecked(BrushLibrary::instance()->activePreset() == _preset);
+    });
+    connect(library, &BrushLibrary::thumbnailReady, this, [this](int index) {
+        if (index == _preset) {
+            update();
+        }
+    });
+}
+
+QSize BrushPresetButton::sizeHint() const
+{
+    return QSize(BRUSH_THUMBNAIL_WIDTH + 4, BRUSH_THUMBNAIL_HEIGHT + 4);
+}
+
+void BrushPresetButton::paintEvent(QPaintEvent *event)
+{
+    QToolButton::paintEvent(event);
+
+    // an empty pixmap means the thumbnail is still rendering
+    QPixmap thumbnail = BrushLibrary::instance()->thumbnail(_preset);
+    if (!thumbnail.isNull()) {
+        QPainter p(this);
+        p.drawPixmap((width() - thumbnail.width()) / 2, (height() - thumbnail.height()) / 2, thumbnail);
+    }
+}
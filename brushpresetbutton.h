@@ -0,0 +1,23 @@
+#ifndef BRUSHPRESETBUTTON_H
+#define BRUSHPRESETBUTTON_H
+
+#include <QToolButton>
+
+// palette button for one brush preset, paints the cached stroke thumbnail
+// and selects the preset when clicked
+class BrushPresetButton : public QToolButton
+{
+    Q_OBJECT
+public:
+    explicit BrushPresetButton(int preset, QWidget *parent = 0);
+
+    QSize sizeHint() const;
+
+protected:
+    void paintEvent(QPaintEvent *event);
+
+private:
+    int _preset;
+};
+
+#endif // BRUSHPRESETBUTTON_H
@@ -0,0 +1,361 @@
+#include "geometrycache.h"
+
+#include <QHash>
+#include <QCryptographicHash>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLExtraFunctions>
+#include <algorithm>
+#include <cmath>
+
+#include "geometrystore.h"
+
+#define QUANTIZE_MESH_POSITIONS 1
+
+namespace {
+    QHash<Mesh*, MeshGeometry*> geometries;
+    QHash<Mesh*, QVector<QVector<quint32> > > lodIndices;
+
+    // buffers by content hash, referenced by every mesh with that content
+    struct SharedBuffers
+    {
+        QOpenGLBuffer* positions = 0;
+        QOpenGLBuffer* uvs = 0;
+        QOpenGLBuffer* indices = 0;
+        QVector<MeshLod> lods;
+        qint64 bytes = 0;
+        int references = 0;
+    };
+    QHash<QByteArray, SharedBuffers> sharedBuffers;
+    bool quantize = QUANTIZE_MESH_POSITIONS;
+
+    QOpenGLBuffer* createBuffer(QOpenGLBuffer::Type type, const void* data, int bytes)
+    {
+        QOpenGLBuffer* buffer = new QOpenGLBuffer(type);
+        buffer->create();
+        buffer->setUsagePattern(QOpenGLBuffer::StaticDraw);
+        buffer->bind();
+        buffer->allocate(data, bytes);
+        buffer->release();
+        return buffer;
+    }
+
+    template <typename T>
+    QByteArray toBytes(const QVector<T>& values)
+    {
+        return QByteArray((const char*)values.constData(), values.size() * sizeof(T));
+    }
+
+    quint16 toUnorm16(float v)
+    {
+        return (quint16)std::lround(std::min(std::max(v, 0.f), 1.f) * 65535.f);
+    }
+}
+
+QMatrix4x4 MeshGeometry::dequantizeMatrix() const
+{
+    QMatrix4x4 m;
+    if (quantizedPositions) {
+        m.translate(boundsMin);
+        m.scale(boundsSize);
+    }
+    return m;
+}
+
+MeshGeometry* GeometryCache::meshGeometry(Mesh *mesh)
+{
+    if (geometries.contains(mesh))
+        return geometries[mesh];
+
+    GeometryStore::ensureHostGeometry(mesh);
+
+    MeshGeometry* g = new MeshGeometry();
+
+    const int vertexCount = mesh->_vertices.size() / 3;
+    const int uvStride = vertexCount > 0 ? mesh->_uvs.size() / vertexCount : 0;
+    g->vertexCount = vertexCount;
+    g->indexCount = mesh->_triangleIndices.size();
+
+    // positions
+    QVector3D lo(0,0,0), hi(0,0,0);
+    for (int i = 0; i < vertexCount; i++) {
+        QVector3D p(mesh->_vertices[i*3], mesh->_vertices[i*3+1], mesh->_vertices[i*3+2]);
+        if (i == 0) {
+            lo = hi = p;
+        }
+        lo = QVector3D(std::min(lo.x(), p.x()), std::min(lo.y(), p.y()), std::min(lo.z(), p.z()));
+        hi = QVector3D(std::max(hi.x(), p.x()), std::max(hi.y(), p.y()), std::max(hi.z(), p.z()));
+    }
+    g->boundsMin = lo;
+    g->boundsRadius = (hi - lo).length() * 0.5f;
+    // flat axes get a unit extent so dequantizing never divides by zero
+    QVector3D size = hi - lo;
+    g->boundsSize = QVector3D(size.x() > 0 ? size.x() : 1, size.y() > 0 ? size.y() : 1, size.z() > 0 ? size.z() : 1);
+
+    QByteArray positionData;
+    if (quantize) {
+        g->quantizedPositions = true;
+
+        // xyzw with w = 1 keeps attributes 4 byte aligned
+        QVector<quint16> packed(vertexCount * 4);
+        for (int i = 0; i < vertexCount; i++) {
+            packed[i*4+0] = toUnorm16((mesh->_vertices[i*3+0] - lo.x()) / g->boundsSize.x());
+            packed[i*4+1] = toUnorm16((mesh->_vertices[i*3+1] - lo.y()) / g->boundsSize.y());
+            packed[i*4+2] = toUnorm16((mesh->_vertices[i*3+2] - lo.z()) / g->boundsSize.z());
+            packed[i*4+3] = 65535;
+        }
+        positionData = toBytes(packed);
+    } else {
+        positionData = QByteArray((const char*)mesh->_vertices.constData(), vertexCount * 3 * sizeof(float));
+    }
+
+    // uvs, dropping the unused third component
+    bool uvsInUnitSquare = true;
+    for (int i = 0; i < vertexCount && uvStride >= 2; i++) {
+        float u = mesh->_uvs[i*uvStride];
+        float v = mesh->_uvs[i*uvStride+1];
+        if (u < 0 || u > 1 || v < 0 || v > 1) {
+            uvsInUnitSquare = false;
+            break;
+        }
+    }
+
+    QByteArray uvData;
+    if (uvsInUnitSquare) {
+        g->normalizedUVs = true;
+        QVector<quint16> packed(vertexCount * 2);
+        for (int i = 0; i < vertexCount; i++) {
+            packed[i*2+0] = toUnorm16(uvStride >= 2 ? mesh->_uvs[i*uvStride] : 0);
+            packed[i*2+1] = toUnorm16(uvStride >= 2 ? mesh->_uvs[i*uvStride+1] : 0);
+        }
+        uvData = toBytes(packed);
+    } else {
+        // tiled uvs would lose too much precision as half floats
+        QVector<float> packed(vertexCount * 2);
+        for (int i = 0; i < vertexCount; i++) {
+            packed[i*2+0] = mesh->_uvs[i*uvStride];
+            packed[i*2+1] = mesh->_uvs[i*uvStride+1];
+        }
+        uvData = toBytes(packed);
+    }
+
+    // indices
+    QByteArray indexData;
+    QVector<QByteArray> lodData;
+    g->indexType = vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    QVector<QVector<quint32> > levels;
+    levels.append(QVector<quint32>(g->indexCount));
+    for (int i = 0; i < g->indexCount; i++) {
+        levels[0][i] = (quint32)mesh->_triangleIndices[i];
+    }
+    levels += lodIndices.value(mesh);
+
+    for (int level = 0; level < levels.size(); level++) {
+        const QVector<quint32>& indices = levels[level];
+        QByteArray data;
+        if (g->indexType == GL_UNSIGNED_SHORT) {
+            QVector<quint16> packed(indices.size());
+            for (int i = 0; i < indices.size(); i++) {
+                packed[i] = (quint16)indices[i];
+            }
+            data = toBytes(packed);
+        } else {
+            data = toBytes(indices);
+        }
+
+        if (level == 0) {
+            indexData = data;
+        } else {
+            lodData.append(data);
+        }
+    }
+
+    g->uncompactBytes = (qint64)vertexCount * 6 * sizeof(float) + (qint64)g->indexCount * sizeof(quint32);
+
+    // identical packed data shares one set of buffers. Quantized positions
+    // are relative to the mesh bounds, so copies of a part placed anywhere
+    // in the scene match and differ only in their dequantize matrix.
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QString("%1:%2:%3:%4:%5:%6:%7").arg(g->quantizedPositions).arg(g->normalizedUVs).arg(g->indexType)
+                 .arg(positionData.size()).arg(uvData.size()).arg(indexData.size()).arg(lodData.size()).toUtf8());
+    hash.addData(positionData);
+    hash.addData(uvData);
+    hash.addData(indexData);
+    foreach (const QByteArray& data, lodData) {
+        hash.addData(QByteArray::number(data.size()));
+        hash.addData(data);
+    }
+    g->contentHash = hash.result();
+
+    SharedBuffers& shared = sharedBuffers[g->contentHash];
+    if (shared.references == 0) {
+        shared.positions = createBuffer(QOpenGLBuffer::VertexBuffer, positionData.constData(), positionData.size());
+        shared.uvs = createBuffer(QOpenGLBuffer::VertexBuffer, uvData.constData(), uvData.size());
+        shared.indices = createBuffer(QOpenGLBuffer::IndexBuffer, indexData.constData(), indexData.size());
+        shared.bytes = positionData.size() + uvData.size() + indexData.size();
+
+        int indexBytes = g->indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+        foreach (const QByteArray& data, lodData) {
+            MeshLod lod;
+            lod.indexCount = data.size() / indexBytes;
+            lod.indices = createBuffer(QOpenGLBuffer::IndexBuffer, data.constData(), data.size());
+            shared.lods.append(lod);
+            shared.bytes += data.size();
+        }
+    }
+    shared.references++;
+
+    g->positions = shared.positions;
+    g->uvs = shared.uvs;
+    g->indices = shared.indices;
+    g->lods = shared.lods;
+    g->bytes = shared.bytes;
+
+    geometries[mesh] = g;
+    return g;
+}
+
+bool GeometryCache::hasMeshGeometry(Mesh *mesh)
+{
+    return geometries.contains(mesh);
+}
+
+void GeometryCache::removeMeshGeometry(Mesh *mesh)
+{
+    MeshGeometry* g = geometries.take(mesh);
+    if (!g)
+        return;
+
+    // buffers go with the last mesh using them
+    SharedBuffers& shared = sharedBuffers[g->contentHash];
+    if (--shared.references == 0) {
+        shared.positions->destroy();
+        shared.uvs->destroy();
+        shared.indices->destroy();
+        delete shared.positions;
+        delete shared.uvs;
+        delete shared.indices;
+        foreach (MeshLod lod, shared.lods) {
+            lod.indices->destroy();
+            delete lod.indices;
+        }
+        sharedBuffers.remove(g->contentHash);
+    }
+    delete g;
+}
+
+void GeometryCache::removeMesh(Mesh *mesh)
+{
+    removeMeshGeometry(mesh);
+    lodIndices.remove(mesh);
+}
+
+void GeometryCache::setMeshLods(Mesh *mesh, const QVector<QVector<quint32> > &indices)
+{
+    lodIndices[mesh] = indices;
+}
+
+int GeometryCache::selectLod(MeshGeometry *geometry, float projectedPixelArea)
+{
+    int triangleBudget = projectedPixelArea / MIN_PIXELS_PER_LOD_TRIANGLE;
+    if (geometry->indexCount / 3 <= triangleBudget)
+        return 0;
+
+    for (int i = 0; i < geometry->lods.size(); i++) {
+        if (geometry->lods[i].indexCount / 3 <= triangleBudget)
+            return i + 1;
+    }
+    return geometry->lods.size();
+}
+
+void GeometryCache::setAttribute(QOpenGLShaderProgram *shader, const char *name, MeshGeometry *geometry, MeshPropType space)
+{
+    // setAttributeBuffer always normalizes, so unorm16 data arrives in [0,1]
+    shader->enableAttributeArray(name);
+    if (space == MeshPropType::UV) {
+        geometry->uvs->bind();
+        shader->setAttributeBuffer(name, geometry->normalizedUVs ? GL_UNSIGNED_SHORT : GL_FLOAT, 0, 2, 0);
+        geometry->uvs->release();
+    } else {
+        geometry->positions->bind();
+        if (geometry->quantizedPositions) {
+            shader->setAttributeBuffer(name, GL_UNSIGNED_SHORT, 0, 4, 0);
+        } else {
+            shader->setAttributeBuffer(name, GL_FLOAT, 0, 3, 0);
+        }
+        geometry->positions->release();
+    }
+}
+
+QMatrix4x4 GeometryCache::attributeToObject(MeshGeometry *geometry, MeshPropType space)
+{
+    if (space == MeshPropType::UV)
+        return QMatrix4x4();
+    return geometry->dequantizeMatrix();
+}
+
+void GeometryCache::drawElements(MeshGeometry *geometry, int lod)
+{
+    QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+
+    QOpenGLBuffer* indices = geometry->indices;
+    int indexCount = geometry->indexCount;
+    if (lod > 0 && lod <= geometry->lods.size()) {
+        indices = geometry->lods[lod-1].indices;
+        indexCount = geometry->lods[lod-1].indexCount;
+    }
+
+    indices->bind();
+    f->glDrawElements(GL_TRIANGLES, indexCount, geometry->indexType, 0);
+    indices->release();
+}
+
+void GeometryCache::drawElementsInstanced(MeshGeometry *geometry, int instanceCount, int lod)
+{
+    QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+
+    QOpenGLBuffer* indices = geometry->indices;
+    int indexCount = geometry->indexCount;
+    if (lod > 0 && lod <= geometry->lods.size()) {
+        indices = geometry->lods[lod-1].indices;
+        indexCount = geometry->lods[lod-1].indexCount;
+    }
+
+    indices->bind();
+    f->glDrawElementsInstanced(GL_TRIANGLES, indexCount, geometry->indexType, 0, instanceCount);
+    indices->release();
+}
+
+bool GeometryCache::quantizePositions()
+{
+    return quantize;
+}
+
+void GeometryCache::setQuantizePositions(bool quantizePositions)
+{
+    quantize = quantizePositions;
+}
+
+int GeometryCache::shareCount(MeshGeometry *geometry)
+{
+    return sharedBuffers.value(geometry->contentHash).references;
+}
+
+qint64 GeometryCache::totalBytes()
+{
+    qint64 total = 0;
+    foreach (const SharedBuffers& shared, sharedBuffers) {
+        total += shared.bytes;
+    }
+    return total;
+}
+
+qint64 GeometryCache::savedBytes()
+{
+    // compact formats and sharing together
+    qint64 uncompact = 0;
+    foreach (MeshGeometry* g, geometries) {
+        uncompact += g->uncompactBytes;
+    }
+    return uncompact - totalBytes();
+}
@@ -0,0 +1,100 @@
+#ifndef GEOMETRYCACHE_H
+#define GEOMETRYCACHE_H
+
+#include <QOpenGLBuffer>
+#include <QOpenGLShaderProgram>
+#include <QMatrix4x4>
+#include <QVector3D>
+
+#include "mesh.h"
+#include "constants.h"
+
+#define MIN_PIXELS_PER_LOD_TRIANGLE 4.0f
+
+// simplified index buffer drawn in place of the full one when the mesh
+// covers few pixels while the camera moves. Settled frames draw level 0,
+// the primitive ids bakes test against are those of the full mesh.
+struct MeshLod
+{
+    QOpenGLBuffer* indices = 0;
+    int indexCount = 0;
+};
+
+// GPU copy of a mesh's geometry stored in compact vertex formats:
+//  - positions as unorm16 xyzw quantized within the mesh bounds (optional)
+//  - uvs as unorm16 pairs when they lie in [0,1], otherwise float pairs
+//  - 16 bit indices when the mesh has few enough vertices
+// Meshes whose packed data is identical share the buffers, and keep their
+// own bounds and so their own dequantize matrix.
+struct MeshGeometry
+{
+    QOpenGLBuffer* positions = 0;
+    QOpenGLBuffer* uvs = 0;
+    QOpenGLBuffer* indices = 0;
+
+    bool quantizedPositions = false;
+    QVector3D boundsMin;
+    QVector3D boundsSize;
+    float boundsRadius = 0;
+
+    bool normalizedUVs = false;
+    GLenum indexType = GL_UNSIGNED_INT;
+    int indexCount = 0;
+    int vertexCount = 0;
+
+    // coarser levels share the vertex buffers and index type of level 0
+    QVector<MeshLod> lods;
+
+    qint64 bytes = 0;
+    qint64 uncompactBytes = 0; // size of the same data as 3 float + 3 float + uint
+    QByteArray contentHash;    // of the packed buffers, keys the sharing
+
+    // maps quantized positions back into object space
+    QMatrix4x4 dequantizeMatrix() const;
+};
+
+class GeometryCache
+{
+public:
+    // uploads the mesh on first use, a GL context must be current
+    static MeshGeometry* meshGeometry(Mesh* mesh);
+    static bool hasMeshGeometry(Mesh* mesh);
+    static void removeMeshGeometry(Mesh* mesh);
+    // also forgets the LOD chain, for meshes leaving the project
+    static void removeMesh(Mesh* mesh);
+
+    // index buffers of coarser levels, uploaded with the mesh geometry
+    static void setMeshLods(Mesh* mesh, const QVector<QVector<quint32> >& lodIndices);
+
+    // finest level that still gives each triangle MIN_PIXELS_PER_LOD_TRIANGLE
+    // of the projected area
+    static int selectLod(MeshGeometry* geometry, float projectedPixelArea);
+
+    // binds positions or uvs to a shader attribute depending on the space
+    // the attribute should hold
+    static void setAttribute(QOpenGLShaderProgram* shader, const char* name, MeshGeometry* geometry, MeshPropType space);
+
+    // transform taking an attribute filled in the given space to object space
+    static QMatrix4x4 attributeToObject(MeshGeometry* geometry, MeshPropType space);
+
+    // lod 0 is the full resolution mesh, bakes and picking must use it
+    static void drawElements(MeshGeometry* geometry, int lod = 0);
+
+    // the same level for every instance, attributes with a divisor set up
+    // by the caller
+    static void drawElementsInstanced(MeshGeometry* geometry, int instanceCount, int lod = 0);
+
+    // affects meshes uploaded after the change
+    static bool quantizePositions();
+    static void setQuantizePositions(bool quantize);
+
+    // meshes using the buffers of this geometry, itself included
+    static int shareCount(MeshGeometry* geometry);
+
+    // buffers in use, shared ones counted once
+    static qint64 totalBytes();
+    // by compact formats and sharing
+    static qint64 savedBytes();
+};
+
+#endif // GEOMETRYCACHE_H
@@ -0,0 +1,245 @@
+#include "geometrystore.h"
+
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QtConcurrent>
+#include <iostream>
+#include <string.h>
+
+#include "project.h"
+#include "geometrycache.h"
+#include "meshprocessor.h"
+#include "profiler.h"
+
+namespace {
+    struct StoredGeometry
+    {
+        qint64 lastUsedMs = 0;
+        bool released = false;
+
+        QString path;
+        bool fileCurrent = false; // file matches the arrays
+
+        // the arrays being written, compared by data pointer to detect edits
+        QFuture<bool> writing;
+        const float* writtenVertices = 0;
+        const float* writtenUVs = 0;
+    };
+
+    struct GeometryHeader
+    {
+        qint32 vertexFloats;
+        qint32 uvFloats;
+        qint32 indexCount;
+    };
+
+    QHash<Mesh*, StoredGeometry> stored;
+    QTemporaryDir* cacheDir = 0;
+    QElapsedTimer clock;
+    int nextFile = 0;
+    int enabled = -1;
+
+    qint64 now()
+    {
+        if (!clock.isValid()) {
+            clock.start();
+        }
+        return clock.elapsed();
+    }
+
+    QString newCachePath()
+    {
+        if (!cacheDir) {
+            QString root = qgetenv("PAINTBUG_GEOMETRY_CACHE_DIR");
+            cacheDir = root.isEmpty() ? new QTemporaryDir() : new QTemporaryDir(QDir(root).filePath("geometry-XXXXXX"));
+        }
+        return cacheDir->filePath(QString("%1.geom").arg(nextFile++));
+    }
+
+    bool writeGeometry(QString path, QVector<float> vertices, QVector<float> uvs, QVector<quint32> indices)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            std::cerr << "unable to write geometry cache: " << path.toStdString() << std::endl;
+            return false;
+        }
+
+        GeometryHeader header = { vertices.size(), uvs.size(), indices.size() };
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)vertices.constData(), vertices.size() * sizeof(float));
+        file.write((const char*)uvs.constData(), uvs.size() * sizeof(float));
+        file.write((const char*)indices.constData(), indices.size() * sizeof(quint32));
+        return file.error() == QFile::NoError;
+    }
+
+    void release(Mesh* mesh, StoredGeometry& entry)
+    {
+        mesh->_vertices = QVector<float>();
+        mesh->_uvs = QVector<float>();
+        mesh->_triangleIndices.clear();
+        mesh->_triangleIndices.squeeze();
+        entry.released = true;
+    }
+
+    void startWrite(Mesh* mesh, StoredGeometry& entry)
+    {
+        if (entry.path.isEmpty()) {
+            entry.path = newCachePath();
+        }
+
+        QVector<quint32> indices(mesh->_triangleIndices.size());
+        for (int i = 0; i < indices.size(); i++) {
+            indices[i] = mesh->_triangleIndices[i];
+        }
+
+        // shared copies, the mesh detaches if it is edited meanwhile
+        QVector<float> vertices = mesh->_vertices;
+        QVector<float> uvs = mesh->_uvs;
+        entry.writtenVertices = vertices.constData();
+        entry.writtenUVs = uvs.constData();
+
+        QString path = entry.path;
+        entry.writing = QtConcurrent::run([path, vertices, uvs, indices]() {
+            return writeGeometry(path, vertices, uvs, indices);
+        });
+    }
+}
+
+bool GeometryStore::isEnabled()
+{
+    if (enabled < 0) {
+        enabled = (RELEASE_HOST_GEOMETRY || qgetenv("PAINTBUG_RELEASE_GEOMETRY") == "1") ? 1 : 0;
+    }
+    return enabled;
+}
+
+void GeometryStore::ensureHostGeometry(Mesh *mesh)
+{
+    if (!stored.contains(mesh))
+        return;
+
+    StoredGeometry& entry = stored[mesh];
+    entry.lastUsedMs = now();
+    if (!entry.released)
+        return;
+
+    QFile file(entry.path);
+    uchar* data = 0;
+    if (file.open(QIODevice::ReadOnly)) {
+        data = file.map(0, file.size());
+    }
+    if (!data) {
+        std::cerr << "unable to map geometry cache: " << entry.path.toStdString() << std::endl;
+        return;
+    }
+
+    GeometryHeader header;
+    memcpy(&header, data, sizeof(header));
+    const uchar* cursor = data + sizeof(header);
+
+    mesh->_vertices.resize(header.vertexFloats);
+    memcpy(mesh->_vertices.data(), cursor, header.vertexFloats * sizeof(float));
+    cursor += header.vertexFloats * sizeof(float);
+
+    mesh->_uvs.resize(header.uvFloats);
+    memcpy(mesh->_uvs.data(), cursor, header.uvFloats * sizeof(float));
+    cursor += header.uvFloats * sizeof(float);
+
+    const quint32* indices = (const quint32*)cursor;
+    mesh->_triangleIndices.resize(header.indexCount);
+    for (int i = 0; i < header.indexCount; i++) {
+        mesh->_triangleIndices[i] = indices[i];
+    }
+
+    file.unmap(data);
+    entry.released = false;
+}
+
+void GeometryStore::invalidate(Mesh *mesh)
+{
+    if (stored.contains(mesh)) {
+        stored[mesh].fileCurrent = false;
+        stored[mesh].lastUsedMs = now();
+    }
+}
+
+void GeometryStore::update()
+{
+    if (!isEnabled())
+        return;
+
+    qint64 time = now();
+
+    foreach (Mesh* mesh, Project::activeProject()->meshes()) {
+        if (!stored.contains(mesh)) {
+            stored[mesh].lastUsedMs = time;
+            continue;
+        }
+
+        StoredGeometry& entry = stored[mesh];
+        if (entry.released || entry.writing.isRunning())
+            continue;
+
+        if (entry.writing.resultCount() > 0) {
+            // only trust the file if the arrays weren't replaced meanwhile
+            entry.fileCurrent = entry.writing.result() &&
+                    mesh->_vertices.constData() == entry.writtenVertices &&
+                    mesh->_uvs.constData() == entry.writtenUVs;
+            entry.writing = QFuture<bool>();
+        }
+
+        // the GPU copy must exist so nothing needs the arrays to draw
+        if (time - entry.lastUsedMs < GEOMETRY_IDLE_SECONDS * 1000 ||
+            MeshProcessor::instance()->isProcessing(mesh) || !GeometryCache::hasMeshGeometry(mesh))
+            continue;
+
+        if (entry.fileCurrent) {
+            release(mesh, entry);
+        } else {
+            startWrite(mesh, entry);
+        }
+    }
+
+    Profiler::setCounter("host geometry", QString("%1 MB").arg(totalHostBytes() / (1024 * 1024)));
+}
+
+bool GeometryStore::isReleased(Mesh *mesh)
+{
+    return stored.contains(mesh) && stored[mesh].released;
+}
+
+qint64 GeometryStore::hostBytes(Mesh *mesh)
+{
+    if (isReleased(mesh))
+        return 0;
+
+    return mesh->_vertices.capacity() * sizeof(float) + mesh->_uvs.capacity() * sizeof(float)
+            + mesh->_triangleIndices.capacity() * sizeof(mesh->_triangleIndices[0]);
+}
+
+qint64 GeometryStore::totalHostBytes()
+{
+    qint64 bytes = 0;
+    foreach (Mesh* mesh, Project::activeProject()->meshes()) {
+        bytes += hostBytes(mesh);
+    }
+    return bytes;
+}
+
+void GeometryStore::forgetMesh(Mesh *mesh)
+{
+    if (!stored.contains(mesh))
+        return;
+
+    // leave the mesh whole, it may still be referenced
+    ensureHostGeometry(mesh);
+
+    StoredGeometry entry = stored.take(mesh);
+    entry.writing.waitForFinished();
+    if (!entry.path.isEmpty()) {
+        QFile::remove(entry.path);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef GEOMETRYSTORE_H
+#define GEOMETRYSTORE_H
+
+#include <QtGlobal>
+
+#include "mesh.h"
+
+#define RELEASE_HOST_GEOMETRY 0
+#define GEOMETRY_IDLE_SECONDS 30
+
+// opt-in policy dropping a mesh's CPU arrays once GeometryCache has them on
+// the GPU, so host memory doesn't hold a second copy of the scene. Released
+// arrays live in a cache file and are read back through a memory map when
+// something needs them again. Enabled by RELEASE_HOST_GEOMETRY or by setting
+// PAINTBUG_RELEASE_GEOMETRY=1.
+//
+// Code reading _vertices, _uvs or _triangleIndices calls ensureHostGeometry
+// first.
+class GeometryStore
+{
+public:
+    static bool isEnabled();
+
+    static void ensureHostGeometry(Mesh* mesh);
+
+    // the arrays were replaced, the cached copy is stale
+    static void invalidate(Mesh* mesh);
+
+    // once per drawn frame, releases meshes whose arrays went unused
+    static void update();
+
+    static bool isReleased(Mesh* mesh);
+    static qint64 hostBytes(Mesh* mesh);
+    static qint64 totalHostBytes();
+
+    static void forgetMesh(Mesh* mesh);
+};
+
+#endif // GEOMETRYSTORE_H
@@ -0,0 +1,308 @@
+#include "gldebugoutput.h"
+
+#if PAINTBUG_GL_DEBUG
+
+#include <QOpenGLDebugLogger>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QThread>
+#include <atomic>
+#include <iostream>
+#include <string.h>
+
+namespace {
+    struct RingEntry
+    {
+        std::atomic<quint32> sequence;
+        GLuint id;
+        int source;
+        int type;
+        int severity;
+        int repeats;
+        char text[GL_DEBUG_MESSAGE_LENGTH];
+    };
+
+    struct DedupeSlot
+    {
+        std::atomic<quint64> key;
+        std::atomic<qint64> windowStartMs;
+        std::atomic<int> suppressed;
+    };
+
+    #define DEDUPE_SLOTS 256
+    #define DEDUPE_PROBES 8
+
+    RingEntry ring[GL_DEBUG_RING_SIZE];
+    std::atomic<quint32> writeIndex(0);
+    std::atomic<quint32> readIndex(0);
+
+    DedupeSlot dedupe[DEDUPE_SLOTS];
+
+    // rate limit over whole seconds
+    std::atomic<qint64> rateSecond(-1);
+    std::atomic<int> rateCount(0);
+    std::atomic<int> dropped(0);
+
+    std::atomic<int> severityMask(QOpenGLDebugMessage::HighSeverity | QOpenGLDebugMessage::MediumSeverity |
+                                  QOpenGLDebugMessage::LowSeverity);
+    std::atomic<int> sourceMask(QOpenGLDebugMessage::AnySource);
+    std::atomic<int> typeMask(QOpenGLDebugMessage::AnyType);
+
+    QElapsedTimer clock;
+    QThread* drainThread = 0;
+    std::atomic<bool> stopping(false);
+
+    void initRing()
+    {
+        for (int i = 0; i < GL_DEBUG_RING_SIZE; i++) {
+            ring[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // bounded multi-producer queue, each slot's sequence says whose turn it is
+    bool push(GLuint id, int source, int type, int severity, int repeats, const QString& text)
+    {
+        quint32 index = writeIndex.load(std::memory_order_relaxed);
+        RingEntry* entry;
+        while (true) {
+            entry = &ring[index & (GL_DEBUG_RING_SIZE - 1)];
+            qint32 diff = (qint32)(entry->sequence.load(std::memory_order_acquire) - index);
+            if (diff == 0) {
+                if (writeIndex.compare_exchange_weak(index, index + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                index = writeIndex.load(std::memory_order_relaxed);
+            }
+        }
+
+        entry->id = id;
+        entry->source = source;
+        entry->type = type;
+        entry->severity = severity;
+        entry->repeats = repeats;
+
+        // latin1 copy without allocating
+        int length = qMin(text.size(), GL_DEBUG_MESSAGE_LENGTH - 1);
+        const QChar* chars = text.constData();
+        for (int i = 0; i < length; i++) {
+            entry->text[i] = chars[i].toLatin1();
+        }
+        entry->text[length] = 0;
+
+        entry->sequence.store(index + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(RingEntry& out)
+    {
+        quint32 index = readIndex.load(std::memory_order_relaxed);
+        RingEntry* entry = &ring[index & (GL_DEBUG_RING_SIZE - 1)];
+        if (entry->sequence.load(std::memory_order_acquire) != index + 1)
+            return false;
+
+        // single consumer, no need for a compare exchange
+        out.id = entry->id;
+        out.source = entry->source;
+        out.type = entry->type;
+        out.severity = entry->severity;
+        out.repeats = entry->repeats;
+        memcpy(out.text, entry->text, GL_DEBUG_MESSAGE_LENGTH);
+
+        entry->sequence.store(index + GL_DEBUG_RING_SIZE, std::memory_order_release);
+        readIndex.store(index + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // returns false if the message is a repeat inside the window, otherwise
+    // how many repeats were swallowed since the last one that got through
+    bool passDedupe(quint64 key, qint64 nowMs, int& repeats)
+    {
+        repeats = 0;
+        int start = (int)((key * 0x9E3779B97F4A7C15ull) >> 56) & (DEDUPE_SLOTS - 1);
+        for (int probe = 0; probe < DEDUPE_PROBES; probe++) {
+            DedupeSlot& slot = dedupe[(start + probe) & (DEDUPE_SLOTS - 1)];
+            quint64 current = slot.key.load(std::memory_order_acquire);
+
+            if (current == 0) {
+                if (!slot.key.compare_exchange_strong(current, key)) {
+                    if (current != key)
+                        continue;
+                } else {
+                    slot.windowStartMs.store(nowMs);
+                    return true;
+                }
+            } else if (current != key) {
+                continue;
+            }
+
+            qint64 windowStart = slot.windowStartMs.load();
+            if (nowMs - windowStart < GL_DEBUG_DEDUPE_WINDOW_MS) {
+                slot.suppressed.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (slot.windowStartMs.compare_exchange_strong(windowStart, nowMs)) {
+                repeats = slot.suppressed.exchange(0, std::memory_order_relaxed);
+                return true;
+            }
+            // another thread just restarted the window
+            slot.suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        // table crowded, let it through
+        return true;
+    }
+
+    bool passRateLimit(qint64 nowMs)
+    {
+        qint64 second = nowMs / 1000;
+        qint64 previous = rateSecond.load();
+        if (previous != second && rateSecond.compare_exchange_strong(previous, second)) {
+            rateCount.store(0);
+        }
+        return rateCount.fetch_add(1) < GL_DEBUG_MAX_PER_SECOND;
+    }
+
+    void submit(const QOpenGLDebugMessage& message)
+    {
+        if (!(message.severity() & severityMask.load(std::memory_order_relaxed)) ||
+            !(message.source() & sourceMask.load(std::memory_order_relaxed)) ||
+            !(message.type() & typeMask.load(std::memory_order_relaxed)))
+            return;
+
+        qint64 nowMs = clock.elapsed();
+        quint64 key = ((quint64)message.id() << 32) | ((quint64)message.source() << 16) | (quint64)message.type();
+        int repeats;
+        if (!passDedupe(key + 1, nowMs, repeats))
+            return;
+
+        if (!passRateLimit(nowMs) ||
+            !push(message.id(), message.source(), message.type(), message.severity(), repeats, message.message())) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    const char* severityName(int severity)
+    {
+        switch (severity) {
+        case QOpenGLDebugMessage::HighSeverity: return "high";
+        case QOpenGLDebugMessage::MediumSeverity: return "medium";
+        case QOpenGLDebugMessage::LowSeverity: return "low";
+        case QOpenGLDebugMessage::NotificationSeverity: return "notification";
+        }
+        return "unknown";
+    }
+
+    const char* typeName(int type)
+    {
+        switch (type) {
+        case QOpenGLDebugMessage::ErrorType: return "error";
+        case QOpenGLDebugMessage::DeprecatedBehaviorType: return "deprecated";
+        case QOpenGLDebugMessage::UndefinedBehaviorType: return "undefined behavior";
+        case QOpenGLDebugMessage::PortabilityType: return "portability";
+        case QOpenGLDebugMessage::PerformanceType: return "performance";
+        case QOpenGLDebugMessage::MarkerType: return "marker";
+        case QOpenGLDebugMessage::GroupPushType: return "group push";
+        case QOpenGLDebugMessage::GroupPopType: return "group pop";
+        }
+        return "other";
+    }
+
+    void drain()
+    {
+        RingEntry entry;
+        while (pop(entry)) {
+            std::cerr << "GL " << typeName(entry.type) << " (" << severityName(entry.severity)
+                      << ", id " << entry.id << "): " << entry.text;
+            if (entry.repeats > 0) {
+                std::cerr << " [repeated " << entry.repeats << " times]";
+            }
+            std::cerr << std::endl;
+        }
+
+        int lost = dropped.exchange(0, std::memory_order_relaxed);
+        if (lost > 0) {
+            std::cerr << "GL debug output: " << lost << " messages dropped" << std::endl;
+        }
+    }
+
+    class DrainThread : public QThread
+    {
+    protected:
+        void run() override
+        {
+            while (!stopping.load()) {
+                drain();
+                msleep(50);
+            }
+            drain();
+        }
+    };
+
+    void stopDrainThread()
+    {
+        stopping.store(true);
+        drainThread->wait();
+        delete drainThread;
+        drainThread = 0;
+    }
+
+    void startDrainThread()
+    {
+        clock.start();
+        initRing();
+
+        QByteArray minimum = qgetenv("PAINTBUG_GL_DEBUG_SEVERITY");
+        if (!minimum.isEmpty()) {
+            int mask = QOpenGLDebugMessage::HighSeverity;
+            if (minimum != "high")
+                mask |= QOpenGLDebugMessage::MediumSeverity;
+            if (minimum == "low" || minimum == "notification")
+                mask |= QOpenGLDebugMessage::LowSeverity;
+            if (minimum == "notification")
+                mask |= QOpenGLDebugMessage::NotificationSeverity;
+            severityMask.store(mask);
+        }
+
+        drainThread = new DrainThread();
+        drainThread->start(QThread::LowestPriority);
+        qAddPostRoutine(stopDrainThread);
+    }
+}
+
+void GLDebugOutput::attach(QObject *parent)
+{
+    if (!drainThread) {
+        startDrainThread();
+    }
+
+    QOpenGLDebugLogger* logger = new QOpenGLDebugLogger(parent);
+    if (!logger->initialize()) {
+        std::cerr << "GL debug output unavailable, the context has no debug flag" << std::endl;
+        delete logger;
+        return;
+    }
+
+    // direct connection, asynchronous messages can come from driver threads
+    QObject::connect(logger, &QOpenGLDebugLogger::messageLogged, submit);
+    logger->startLogging(QOpenGLDebugLogger::AsynchronousLogging);
+}
+
+void GLDebugOutput::setSeverities(QOpenGLDebugMessage::Severities severities)
+{
+    severityMask.store(int(severities));
+}
+
+void GLDebugOutput::setSources(QOpenGLDebugMessage::Sources sources)
+{
+    sourceMask.store(int(sources));
+}
+
+void GLDebugOutput::setTypes(QOpenGLDebugMessage::Types types)
+{
+    typeMask.store(int(types));
+}
+
+#endif // PAINTBUG_GL_DEBUG
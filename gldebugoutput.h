@@ -0,0 +1,47 @@
+#ifndef GLDEBUGOUTPUT_H
+#define GLDEBUGOUTPUT_H
+
+#include <QObject>
+#include <QOpenGLDebugMessage>
+
+// debug builds only, release builds don't create a logger at all
+#ifndef QT_NO_DEBUG
+#define PAINTBUG_GL_DEBUG 1
+#else
+#define PAINTBUG_GL_DEBUG 0
+#endif
+
+#define GL_DEBUG_RING_SIZE 256        // power of two
+#define GL_DEBUG_MESSAGE_LENGTH 240
+#define GL_DEBUG_DEDUPE_WINDOW_MS 2000
+#define GL_DEBUG_MAX_PER_SECOND 50
+
+// GL debug output without touching the frame. Messages arrive through
+// QOpenGLDebugLogger in asynchronous mode, possibly on driver threads, and
+// are filtered, deduplicated and rate limited before being copied into a
+// lock-free ring buffer. A logging thread drains the buffer and prints.
+//
+// Repeats of a message within GL_DEBUG_DEDUPE_WINDOW_MS are counted and
+// reported with the next copy that gets through.
+class GLDebugOutput
+{
+public:
+#if PAINTBUG_GL_DEBUG
+    // call with the context current, the logger is owned by parent
+    static void attach(QObject* parent);
+
+    // runtime filters, everything but notifications by default. The
+    // initial severities can be set with PAINTBUG_GL_DEBUG_SEVERITY to
+    // high, medium, low or notification (the lowest one shown).
+    static void setSeverities(QOpenGLDebugMessage::Severities severities);
+    static void setSources(QOpenGLDebugMessage::Sources sources);
+    static void setTypes(QOpenGLDebugMessage::Types types);
+#else
+    static void attach(QObject*) {}
+    static void setSeverities(QOpenGLDebugMessage::Severities) {}
+    static void setSources(QOpenGLDebugMessage::Sources) {}
+    static void setTypes(QOpenGLDebugMessage::Types) {}
+#endif
+};
+
+#endif // GLDEBUGOUTPUT_H
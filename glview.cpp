@@ -4,13 +4,44 @@
 #include <QOpenGLFunctions>
 #include <QOpenGLExtraFunctions>
 #include <QPainter>
+#include <QElapsedTimer>
+#include <QFileDialog>
+#include <QCoreApplication>
+#include <QMap>
 #include <iostream>
+#include <algorithm>
+#include <climits>
 
 #include "project.h"
 #include "sessionsettings.h"
 #include "glcache.h"
+#include "geometrycache.h"
+#include "meshprocessor.h"
+#include "textureresidency.h"
+#include "texturemips.h"
+#include "bakefootprint.h"
+#include "painthistory.h"
+#include "paintlayers.h"
+#include "projectarchive.h"
+#include "texturecompression.h"
+#include "geometrystore.h"
+#include "meshstats.h"
+#include "meshbvh.h"
+#include "gldebugoutput.h"
+#include "profiler.h"
+#include "journalreplayer.h"
+#include "benchmarkrunner.h"
+#include "brushlibrary.h"
+#include "uvislands.h"
+#include "textureimporter.h"
+#include "inputlatency.h"
+#include "maskbaker.h"
+#include "uvwireframe.h"
+#include "texeldensity.h"
+#include "instancetextures.h"
 
 #define DEBUG_PAINT_LAYER 0
+#define STROKE_MIN_POINT_DISTANCE 0.5f // window pixels between recorded stroke points
 
 namespace MouseMode {
     enum { FREE, CAMERA, TOOL, HUD };
@@ -20,6 +51,39 @@ int mouseMode = MouseMode::FREE;
 int activeMouseButton = -1;
 QList<GLView*> GLView::_glViews;
 
+// journal recording/replay can be requested from the environment so bug
+// reports can ship a journal without extra UI
+JournalReplayer* journalReplayer = 0;
+
+void startReplayWhenReady()
+{
+    foreach (GLView* view, GLView::views()) {
+        if (!view->isValid()) { // wait until every view has a GL context
+            QTimer::singleShot(100, startReplayWhenReady);
+            return;
+        }
+    }
+
+    journalReplayer->start();
+}
+
+// benchmark runs are also started from the environment, the app quits once
+// the report is written
+BenchmarkRunner* benchmarkRunner = 0;
+
+void startBenchmarkWhenReady()
+{
+    foreach (GLView* view, GLView::views()) {
+        if (!view->isValid()) {
+            QTimer::singleShot(100, startBenchmarkWhenReady);
+            return;
+        }
+    }
+
+    QObject::connect(benchmarkRunner, &BenchmarkRunner::finished, qApp, &QCoreApplication::quit, Qt::QueuedConnection);
+    benchmarkRunner->start();
+}
+
 QOpenGLFramebufferObject* GLView::drawFbo() {
     if (!_drawFbo) {
         _drawFbo = new QOpenGLFramebufferObject(PAINT_FBO_WIDTH, PAINT_FBO_WIDTH, QOpenGLFramebufferObject::Depth);
@@ -65,10 +129,42 @@ GLView::GLView(QWidget *parent) :
     connect(Project::activeProject(), SIGNAL(meshAdded()), this, SLOT(onMeshAdded()));
     connect(Project::activeProject(), SIGNAL(meshesRemoved(QList<Mesh*>)), this, SLOT(onMeshesRemoved(QList<Mesh*>)));
     connect(Project::activeProject(), SIGNAL(meshesAltered(QList<Mesh*>)), this, SLOT(onMeshesAltered(QList<Mesh*>)));
+    connect(MeshProcessor::instance(), SIGNAL(meshProcessed(Mesh*)), this, SLOT(onMeshProcessed(Mesh*)));
+    connect(TextureImporter::instance(), SIGNAL(progressChanged()), this, SLOT(update()));
+    connect(MaskBaker::instance(), SIGNAL(maskFinished(Mesh*)), this, SLOT(update()));
+    connect(this, &QOpenGLWidget::frameSwapped, this, [this]() {
+        InputLatency::frameSwapped(this);
+        makeCurrent();
+        InputLatency::pollFrames();
+    });
 
     _glViews.append(this); // keep track of all views
 
     _paintLayerIsDirty = false;
+
+    QString recordPath = qgetenv("PAINTBUG_RECORD_JOURNAL");
+    if (!recordPath.isEmpty() && !StrokeJournal::isRecording()) {
+        StrokeJournal::startRecording(recordPath);
+    }
+
+    QString replayPath = qgetenv("PAINTBUG_REPLAY_JOURNAL");
+    if (!replayPath.isEmpty() && !journalReplayer) {
+        JournalReplayer::Speed speed = qgetenv("PAINTBUG_REPLAY_SPEED") == "realtime"
+                ? JournalReplayer::REAL_TIME : JournalReplayer::MAX_SPEED;
+        journalReplayer = new JournalReplayer(replayPath, speed);
+        QTimer::singleShot(0, startReplayWhenReady);
+    }
+
+    QString benchmarkPath = qgetenv("PAINTBUG_BENCHMARK");
+    if (!benchmarkPath.isEmpty() && !benchmarkRunner) {
+        benchmarkRunner = new BenchmarkRunner(benchmarkPath);
+        QTimer::singleShot(0, startBenchmarkWhenReady);
+    }
+}
+
+const QList<GLView*>& GLView::views()
+{
+    return _glViews;
 }
 
 QOpenGLTexture* brushTexture = 0;
@@ -76,18 +172,36 @@ QOpenGLTexture* brushTexture = 0;
 void GLView::initializeGL()
 {
     _meshShader = ShaderFactory::buildMeshShader(this);
+    _instancedMeshShader = ShaderFactory::buildInstancedMeshShader(this);
+    _instanceBuffer = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+    _instanceBuffer->setUsagePattern(QOpenGLBuffer::StreamDraw);
+    _instanceBuffer->create();
+    // attribute divisors are core in 3.3
+    _instancing = QOpenGLContext::currentContext()->format().version() >= qMakePair(3, 3);
     _bakeShader = ShaderFactory::buildBakeShader(this);    
+    _maskMixShader = ShaderFactory::buildMaskMixShader(this);
 #if DEBUG_PAINT_LAYER
         _paintDebugShader = ShaderFactory::buildPaintDebugShader(this);
 #endif
-    _logger = new QOpenGLDebugLogger(this);
-    _logger->initialize();
+    GLDebugOutput::attach(this);
 
+    _brushShader = ShaderFactory::buildBrushStrokeShader(this);
     brushTexture = new QOpenGLTexture(QImage(QString(":/main/resources/brushes/brush1.png")));
 
+    BrushLibrary::instance()->loadDirectory(":/main/resources/brushes");
+    QString brushDir = qgetenv("PAINTBUG_BRUSH_DIR");
+    if (!brushDir.isEmpty()) {
+        BrushLibrary::instance()->loadDirectory(brushDir);
+    }
+
     if (!QOpenGLContext::currentContext()->functions()->hasOpenGLFeature(QOpenGLFunctions::MultipleRenderTargets)) {
         qDebug("Multiple render targets not supported");
     }
+
+    if (StrokeJournal::isRecording()) {
+        recordCameraState();
+        brushSizeChanged(); // records the starting brush
+    }
 }
 
 void GLView::resizeGL(int w, int h)
@@ -96,16 +210,21 @@ void GLView::resizeGL(int w, int h)
 
     _cameraScratch.viewWidth = w;
     _cameraScratch.viewHeight = h;
+
+    if (StrokeJournal::isRecording()) {
+        JournalEntry entry;
+        entry.type = JournalEvent::VIEW_SIZE;
+        entry.size = QSize(w, h);
+        recordJournalEntry(entry);
+    }
 }
 
 void GLView::paintGL()
 {
-      QPainter painter;
-    QList<QOpenGLDebugMessage> messages = _logger->loggedMessages();
-    foreach (const QOpenGLDebugMessage &message, messages)
-        qDebug() << message;
-
+    QElapsedTimer frameTimer;
+    frameTimer.start();
 
+    QPainter painter;
     painter.begin(this);
     painter.beginNativePainting();
 
@@ -114,9 +233,11 @@ void GLView::paintGL()
     // draw strokes onto paint FBO
     drawPaintStrokes();
 
-    // draw brush overlay
+    // draw brush overlay, last thing in the frame in low latency mode
     //bool cursorInWidget = this->rect().contains(this->mapFromGlobal(QCursor::pos()));
-    if (this->underMouse() || mouseMode != MouseMode::FREE) {
+    bool showBrush = this->underMouse() || mouseMode != MouseMode::FREE;
+    bool lateLatch = InputLatency::lowLatency();
+    if (showBrush && !lateLatch) {
         drawBrush();
     }
 
@@ -143,17 +264,46 @@ void GLView::paintGL()
         painter.setFont(prevFont);
     }
 
+    if (Profiler::overlayVisible()) {
+        Profiler::drawOverlay(&painter, 20, 45);
+    }
+
+    if (showBrush && lateLatch) {
+        painter.beginNativePainting();
+        drawBrush();
+        painter.endNativePainting();
+    }
+
     painter.end();
+
+    InputLatency::frameSubmitted(this);
+    InputLatency::pollFrames();
+
+    if (Profiler::gpuSync()) {
+        glFinish();
+    }
+    Profiler::recordFrame(frameTimer.nsecsElapsed() / 1000000.0f);
 }
 
 void GLView::drawScene()
 {
     glEnable(GL_DEPTH_TEST);
 
+    // render into a corner of the draw target while navigating and stretch it
+    // over the view afterwards. A full resolution frame follows on release.
+    bool navigating = _cameraScratch.moveType != MoveType::NOT_MOVING;
+    float renderScale = navigating ? _navigationResolution.scale() : 1.0f;
+    QSize renderSize(std::max(1, (int)(width() * renderScale)), std::max(1, (int)(height() * renderScale)));
+
+    if (navigating) {
+        _navigationResolution.beginScene();
+    }
+
     QOpenGLFramebufferObject* drawTarget = drawFbo();
     if (!drawTarget->bind()) {
         std::cerr << "unable to bind draw target" << std::endl;
     }
+    glViewport(0, 0, renderSize.width(), renderSize.height());
 
     glClearColor(.2,.2,.2,0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -164,20 +314,47 @@ void GLView::drawScene()
 
     Project* project = Project::activeProject();
 
-    // render each mesh
+    TextureResidency::beginFrame();
+    TextureImporter::instance()->update();
+    MaskBaker::instance()->update();
+    MeshStats::instance()->beginFrame();
+
+    // make sure each visible mesh has its texture and geometry
+    struct MeshDraw
+    {
+        Mesh* mesh;
+        MeshGeometry* geometry;
+    };
+    QVector<MeshDraw> draws;
+
     QVectorIterator<Mesh*> meshes = project->meshes();
     while (meshes.hasNext()) {
         Mesh* mesh = meshes.next();
         if (!project->meshVisible(mesh)) // ignore hidden
             continue;
 
-        QMatrix4x4 objToWorld;
+        // upload textures of a loaded project on first draw
+        QByteArray loadedPixels;
+        int loadedSize;
+        if (!GLCache::hasMeshTexture(mesh) && ProjectArchive::instance()->takeLoadedTexture(mesh, loadedPixels, loadedSize)) {
+            GLuint textureId;
+            glGenTextures(1, &textureId);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, textureId);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, loadedSize, loadedSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, loadedPixels.constData());
+            TextureMips::generate(textureId);
+
+            mesh->setTextureSize(loadedSize);
+            GLCache::setMeshTexture(mesh, textureId);
+            TextureResidency::registerTexture(mesh, loadedSize);
+        }
 
         // make sure a texture exists for this mesh
-        if (!GLCache::hasMeshTexture(mesh)) {
+        if (!GLCache::hasMeshTexture(mesh) && !TextureResidency::isEvicted(mesh)) {
             std::cout << "creating mesh texture" << std::endl;
 
-            const int TEXTURE_SIZE = 256;
+            // sized for the project wide texel density
+            const int TEXTURE_SIZE = TexelDensity::plannedSize(mesh);
 
             transferFbo()->bind();
 
@@ -213,70 +390,234 @@ void GLView::drawScene()
             glEnd();
 
             glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 0, 0, TEXTURE_SIZE, TEXTURE_SIZE, 0);
+            TextureMips::generate(textureId);
 
             transferFbo()->release();
 
-            glViewport(0, 0, width(), height());
+            glViewport(0, 0, renderSize.width(), renderSize.height());
 
             mesh->setTextureSize(TEXTURE_SIZE);
             GLCache::setMeshTexture(mesh, textureId);
+            TextureResidency::registerTexture(mesh, TEXTURE_SIZE);
         }
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, GLCache::meshTextureId(mesh));
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, paintFbo()->texture());
-        glActiveTexture(GL_TEXTURE0);
+        MeshDraw draw = { mesh, GeometryCache::meshGeometry(mesh) };
+        draws.append(draw);
+    }
 
-        QColor brushColor = settings()->brushColor();
+    // meshes sharing geometry are drawn back to back, the vertex setup is
+    // done once per group and only the transform and texture change
+    std::sort(draws.begin(), draws.end(),
+              [](const MeshDraw& a, const MeshDraw& b) { return a.geometry->positions < b.geometry->positions; });
+
+    QColor brushColor = settings()->brushColor();
+
+    QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+    GLenum bufs[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    f->glDrawBuffers(2, bufs);
+
+    // only the perspective preview draws simplified levels, and only while
+    // navigating: bakes compare level 0 primitive ids against this frame,
+    // and no stroke can be pending while the camera moves
+    auto meshLod = [&](MeshGeometry* geometry, const QMatrix4x4& objToWorld) {
+        if (!navigating || meshVertexSpace() == MeshPropType::UV || !dynamic_cast<PerspectiveCamera*>(_camera))
+            return 0;
+        QVector3D center = objToWorld * (geometry->boundsMin + geometry->boundsSize * 0.5f);
+        float distance = std::max((center - _camera->eye()).length() - geometry->boundsRadius, 0.001f);
+        float pixelRadius = geometry->boundsRadius / (distance * tan(_camera->fov() * 3.14159f / 360.0f)) * height() * 0.5f;
+        return GeometryCache::selectLod(geometry, 3.14159f * pixelRadius * pixelRadius);
+    };
 
-        _meshShader->bind();
-        _meshShader->setUniformValue("objToWorld", objToWorld);
-        _meshShader->setUniformValue("cameraPV", cameraProjViewM);
-        _meshShader->setUniformValue("paintFboWidth", PAINT_FBO_WIDTH);
-        _meshShader->setUniformValue("brushColor", brushColor.redF(), brushColor.greenF(), brushColor.blueF(), 1);
-        _meshShader->setUniformValue("meshTexture", 0);
-        _meshShader->setUniformValue("paintTexture", 1);
-
-        QOpenGLBuffer *vbo = GLCache::meshVertexBuffer(mesh);
-        QOpenGLBuffer *uvbo = GLCache::meshUVBuffer(mesh);
-        QOpenGLBuffer *ibo = GLCache::meshIndexBuffer(mesh);
-        QOpenGLVertexArrayObject *vao = GLCache::meshVertexArray(mesh);
+    // for the same reason copies sharing geometry and texture size go
+    // through one instanced call only while navigating, their textures
+    // copied into the layers of an array. The rest is drawn per mesh.
+    QVector<MeshDraw> meshDraws;
+    int matrixLocation = _instancedMeshShader->attributeLocation("instanceObjToWorld");
+    int layerLocation = _instancedMeshShader->attributeLocation("instanceLayer");
+    if (navigating && _instancing && _instancedMeshShader->bind() && matrixLocation >= 0 && layerLocation >= 0) {
+        _instancedMeshShader->setUniformValue("cameraPV", cameraProjViewM);
+        _instancedMeshShader->setUniformValue("meshTextures", 0);
+
+        for (int first = 0; first < draws.size(); ) {
+            int end = first + 1;
+            while (end < draws.size() && draws[end].geometry->positions == draws[first].geometry->positions) {
+                end++;
+            }
 
-        QOpenGLBuffer* positionBuffer;
-        if (meshVertexSpace() == MeshPropType::UV) {
-            positionBuffer = uvbo;
-        } else {
-            positionBuffer = vbo;
+            // compressed and evicted textures can't be copied into layers
+            QMap<int, QVector<MeshDraw> > bySize;
+            for (int i = first; i < end; i++) {
+                Mesh* mesh = draws[i].mesh;
+                if (TextureCompression::isCompressed(mesh) || TextureResidency::isEvicted(mesh)) {
+                    meshDraws.append(draws[i]);
+                } else {
+                    bySize[mesh->textureSize()].append(draws[i]);
+                }
+            }
+            first = end;
+
+            QMapIterator<int, QVector<MeshDraw> > sizes(bySize);
+            while (sizes.hasNext()) {
+                sizes.next();
+                for (int batch = 0; batch < sizes.value().size(); batch += INSTANCE_TEXTURE_MAX_LAYERS) {
+                    QVector<MeshDraw> copies = sizes.value().mid(batch, INSTANCE_TEXTURE_MAX_LAYERS);
+                    if (copies.size() < 2) {
+                        meshDraws += copies;
+                        continue;
+                    }
+
+                    // per copy the object transform and the array layer
+                    QVector<Mesh*> copyMeshes;
+                    QVector<float> instances;
+                    instances.reserve(copies.size() * 17);
+                    int lod = INT_MAX;
+                    for (int i = 0; i < copies.size(); i++) {
+                        QMatrix4x4 objToWorld;
+                        lod = std::min(lod, meshLod(copies[i].geometry, objToWorld));
+                        objToWorld = objToWorld * GeometryCache::attributeToObject(copies[i].geometry, meshVertexSpace());
+                        const float* columns = objToWorld.constData();
+                        for (int j = 0; j < 16; j++) {
+                            instances.append(columns[j]);
+                        }
+                        instances.append(i);
+                        copyMeshes.append(copies[i].mesh);
+                    }
+
+                    MeshGeometry* geometry = copies[0].geometry;
+                    glBindTexture(GL_TEXTURE_2D_ARRAY, InstanceTextures::arrayTexture(copyMeshes, sizes.key()));
+
+                    QOpenGLVertexArrayObject* vao = GLCache::meshVertexArray(copies[0].mesh);
+                    vao->bind();
+                    GeometryCache::setAttribute(_instancedMeshShader, "position", geometry, meshVertexSpace());
+                    GeometryCache::setAttribute(_instancedMeshShader, "in_uvs", geometry, MeshPropType::UV);
+
+                    _instanceBuffer->bind();
+                    _instanceBuffer->allocate(instances.constData(), instances.size() * sizeof(float));
+                    const int stride = 17 * sizeof(float);
+                    for (int column = 0; column < 4; column++) {
+                        f->glEnableVertexAttribArray(matrixLocation + column);
+                        f->glVertexAttribPointer(matrixLocation + column, 4, GL_FLOAT, GL_FALSE, stride, (const void*)(quintptr)(column * 4 * sizeof(float)));
+                        f->glVertexAttribDivisor(matrixLocation + column, 1);
+                    }
+                    f->glEnableVertexAttribArray(layerLocation);
+                    f->glVertexAttribPointer(layerLocation, 1, GL_FLOAT, GL_FALSE, stride, (const void*)(quintptr)(16 * sizeof(float)));
+                    f->glVertexAttribDivisor(layerLocation, 1);
+
+                    GeometryCache::drawElementsInstanced(geometry, copies.size(), lod);
+
+                    // the vertex array is the mesh's own, per mesh draws and
+                    // bakes use it without divisors
+                    for (int column = 0; column < 4; column++) {
+                        f->glVertexAttribDivisor(matrixLocation + column, 0);
+                        f->glDisableVertexAttribArray(matrixLocation + column);
+                    }
+                    f->glVertexAttribDivisor(layerLocation, 0);
+                    f->glDisableVertexAttribArray(layerLocation);
+                    _instanceBuffer->release();
+                    vao->release();
+
+                    // draw times are measured per call, copies drawn together have none
+                    foreach (const MeshDraw& copy, copies) {
+                        MeshStats::instance()->recordGeometry(copy.mesh, geometry->indexCount / 3, geometry->bytes);
+                        MeshStats::instance()->recordTexture(copy.mesh, copy.mesh->textureSize(), TextureResidency::meshTextureBytes(copy.mesh));
+                    }
+                }
+            }
         }
 
-        vao->bind();
-        positionBuffer->bind();
-        _meshShader->enableAttributeArray("position");
-        _meshShader->setAttributeBuffer("position", GL_FLOAT, 0, 3, 0);
-        positionBuffer->release();
-        uvbo->bind();
-        _meshShader->enableAttributeArray("in_uvs");
-        _meshShader->setAttributeBuffer("in_uvs", GL_FLOAT, 0, 3, 0);
-        uvbo->release();
-
-        QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
-        GLenum bufs[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-        f->glDrawBuffers(2, bufs);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        _instancedMeshShader->release();
+    } else {
+        meshDraws = draws;
+    }
 
-        ibo->bind();
-        glDrawElements(GL_TRIANGLES, mesh->_triangleIndices.count(), GL_UNSIGNED_INT, 0);
-        ibo->release();
-        vao->release();
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, paintFbo()->texture());
+    glActiveTexture(GL_TEXTURE0);
+
+    _meshShader->bind();
+    _meshShader->setUniformValue("cameraPV", cameraProjViewM);
+    _meshShader->setUniformValue("paintFboWidth", PAINT_FBO_WIDTH);
+    _meshShader->setUniformValue("brushColor", brushColor.redF(), brushColor.greenF(), brushColor.blueF(), 1);
+    _meshShader->setUniformValue("meshTexture", 0);
+    _meshShader->setUniformValue("paintTexture", 1);
+
+    QOpenGLVertexArrayObject* groupVao = 0;
+    QOpenGLBuffer* groupPositions = 0;
+    foreach (const MeshDraw& draw, meshDraws) {
+        Mesh* mesh = draw.mesh;
+        MeshGeometry* geometry = draw.geometry;
+        QMatrix4x4 objToWorld;
+        int lod = meshLod(geometry, objToWorld);
 
-        _meshShader->release();
+        // fold position dequantization into the object transform
+        objToWorld = objToWorld * GeometryCache::attributeToObject(geometry, meshVertexSpace());
+
+        if (geometry->positions != groupPositions) {
+            if (groupVao) {
+                groupVao->release();
+            }
+            groupVao = GLCache::meshVertexArray(mesh);
+            groupVao->bind();
+            GeometryCache::setAttribute(_meshShader, "position", geometry, meshVertexSpace());
+            GeometryCache::setAttribute(_meshShader, "in_uvs", geometry, MeshPropType::UV);
+            groupPositions = geometry->positions;
+        }
+
+        // textures stay per mesh, copies are painted independently
+        glBindTexture(GL_TEXTURE_2D, TextureResidency::textureForDraw(mesh));
+        _meshShader->setUniformValue("objToWorld", objToWorld);
+
+        MeshStats::instance()->beginDraw(mesh);
+        GeometryCache::drawElements(geometry, lod);
+        MeshStats::instance()->endDraw(mesh);
+
+        MeshStats::instance()->recordGeometry(mesh, geometry->indexCount / 3, geometry->bytes);
+        MeshStats::instance()->recordTexture(mesh, mesh->textureSize(), TextureResidency::meshTextureBytes(mesh));
+    }
+    if (groupVao) {
+        groupVao->release();
     }
+    _meshShader->release();
+
+    // uv layout over the meshes, its texture only redraws when the zoom
+    // crosses a power of two or other meshes are shown
+    if (meshVertexSpace() == MeshPropType::UV && UVWireframe::isVisible()) {
+        int wireframeSize = UVWireframe::sizeForZoom(height() / (2.0f * _camera->fov()));
+        QVector<Mesh*> wireframeMeshes;
+        wireframeMeshes.reserve(draws.size());
+        foreach (const MeshDraw& draw, draws) {
+            wireframeMeshes.append(draw.mesh);
+        }
+        UVWireframe::prepare(this, wireframeMeshes, wireframeSize);
+        drawTarget->bind(); // preparing binds its own target
+        glDisable(GL_DEPTH_TEST);
+        // color only, bakes read the primitive ids under the edges
+        GLenum colorBuf = GL_COLOR_ATTACHMENT0;
+        f->glDrawBuffers(1, &colorBuf);
+        UVWireframe::draw(this, cameraProjViewM);
+        f->glDrawBuffers(2, bufs);
+    }
+
+    Profiler::setCounter("geometry", QString("%1 MB for %2 meshes, %3 MB saved")
+                         .arg(GeometryCache::totalBytes() / (1024.0 * 1024.0), 0, 'f', 1).arg(draws.size())
+                         .arg(GeometryCache::savedBytes() / (1024.0 * 1024.0), 0, 'f', 1));
 
     glDisable(GL_DEPTH_TEST);
 
+    InstanceTextures::endFrame(this);
+    TextureResidency::endFrame();
+    TextureCompression::update();
+    GeometryStore::update();
+
     if (!drawTarget->release()) {
         std::cerr << "unable to release draw target" << std::endl;
     }
+    glViewport(0, 0, width(), height());
+
+    if (navigating) {
+        _navigationResolution.endScene();
+    }
 
     // draw scene texture to the screen
     drawTarget->texture();
@@ -289,17 +630,24 @@ void GLView::drawScene()
     glEnable(GL_TEXTURE_2D);
     glBindTexture(GL_TEXTURE_2D, drawTarget->texture());
 
+    // filter when upscaling, exact texel copies otherwise
+    GLint filter = renderScale < 1 ? GL_LINEAR : GL_NEAREST;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+
+    const float quadSize = PAINT_FBO_WIDTH / renderScale;
+
     glColor3f(1,1,1);
     glBegin(GL_QUADS);
     {
         glTexCoord2f(0, 0);
         glVertex2f(0, 0);
         glTexCoord2f(1, 0);
-        glVertex2f(PAINT_FBO_WIDTH, 0);
+        glVertex2f(quadSize, 0);
         glTexCoord2f(1, 1);
-        glVertex2f(PAINT_FBO_WIDTH, PAINT_FBO_WIDTH);
+        glVertex2f(quadSize, quadSize);
         glTexCoord2f(0, 1);
-        glVertex2f(0, PAINT_FBO_WIDTH);
+        glVertex2f(0, quadSize);
     }
     glEnd();
 
@@ -314,16 +662,57 @@ void GLView::drawOutlinedText(QPainter* painter, int x, int y, QString text, QCo
     painter->drawText(x-2, y-2, text);
 }
 
+bool GLView::pickSurface(QPointF windowPos, MeshPick &pick)
+{
+    QMatrix4x4 cameraPV = _camera->getProjMatrix(width(), height()) * _camera->getViewMatrix(width(), height());
+    QMatrix4x4 inversePV = cameraPV.inverted();
+
+    float x = 2.0f * windowPos.x() / width() - 1;
+    float y = 2.0f * windowPos.y() / height() - 1;
+    QVector3D nearP = inversePV * QVector3D(x, y, -1);
+    QVector3D farP = inversePV * QVector3D(x, y, 1);
+
+    return MeshBVH::pick(nearP, farP - nearP, meshVertexSpace(), pick);
+}
+
+void GLView::bindBrush()
+{
+    BrushLibrary* brushes = BrushLibrary::instance();
+    QOpenGLTexture* presets = brushes->textureArray();
+    if (!presets) {
+        brushTexture->bind();
+        return;
+    }
+
+    // fixed function can't sample arrays, the shader stands in for it
+    glActiveTexture(GL_TEXTURE0);
+    presets->bind();
+    _brushShader->bind();
+    _brushShader->setUniformValue("brushTextures", 0);
+    _brushShader->setUniformValue("layer", (float)brushes->activePreset());
+    _brushShader->setUniformValue("opacity", brushes->preset(brushes->activePreset()).opacity);
+}
+
+void GLView::releaseBrush()
+{
+    QOpenGLTexture* presets = BrushLibrary::instance()->textureArray();
+    if (!presets) {
+        brushTexture->release();
+        return;
+    }
+
+    _brushShader->release();
+    presets->release();
+}
+
 void GLView::drawBrush()
 {
-    brushTexture->bind();
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(0, width(), 0, height(), -1, 1);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    bindBrush();
 
-    QPoint cursorP = this->mapFromGlobal(QCursor::pos());
+    QPointF cursorP = this->mapFromGlobal(QCursor::pos());
+    if (InputLatency::lowLatency()) {
+        cursorP = InputLatency::predict(this, cursorP, InputLatency::latchToSwapMs());
+    }
     cursorP.setY(height() - cursorP.y());
     int brushRadius = settings()->brushSize() * 0.5f;
 
@@ -331,6 +720,53 @@ void GLView::drawBrush()
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glBlendEquation(GL_FUNC_ADD);
+
+    // in 3D views the brush lies on the surface under the cursor
+    MeshPick pick;
+    if (meshVertexSpace() != MeshPropType::UV && pickSurface(cursorP, pick)) {
+        QMatrix4x4 cameraPV = _camera->getProjMatrix(width(), height()) * _camera->getViewMatrix(width(), height());
+        glMatrixMode(GL_PROJECTION);
+        glLoadMatrixf(cameraPV.constData());
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
+
+        // world size of the brush radius at the depth of the hit
+        QVector3D ndc = cameraPV * pick.position;
+        QVector3D edge = cameraPV.inverted() * QVector3D(ndc.x() + 2.0f * brushRadius / width(), ndc.y(), ndc.z());
+        float radius = (edge - pick.position).length();
+
+        QVector3D helper = qAbs(pick.normal.y()) < 0.9f ? QVector3D(0, 1, 0) : QVector3D(1, 0, 0);
+        QVector3D tangent = QVector3D::crossProduct(pick.normal, helper).normalized() * radius;
+        QVector3D bitangent = QVector3D::crossProduct(pick.normal, tangent);
+        QVector3D center = pick.position + pick.normal * radius * 0.01f; // keep off the surface
+
+        QVector3D corners[4] = {
+            center - tangent - bitangent,
+            center + tangent - bitangent,
+            center + tangent + bitangent,
+            center - tangent + bitangent
+        };
+        float texCoords[4][2] = { {0, 0}, {1, 0}, {1, 1}, {0, 1} };
+
+        glBegin(GL_QUADS);
+        for (int i = 0; i < 4; i++) {
+            glTexCoord2f(texCoords[i][0], texCoords[i][1]);
+            glVertex3f(corners[i].x(), corners[i].y(), corners[i].z());
+        }
+        glEnd();
+
+        glDisable(GL_TEXTURE_2D);
+        glDisable(GL_BLEND);
+        releaseBrush();
+        return;
+    }
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0, width(), 0, height(), -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
     glBegin(GL_QUADS);
     {
         glTexCoord2f(0, 0);
@@ -346,7 +782,7 @@ void GLView::drawBrush()
     glDisable(GL_TEXTURE_2D);
     glDisable(GL_BLEND);
 
-    brushTexture->release();
+    releaseBrush();
     //QPoint cursorP = this->mapFromGlobal(QCursor::pos());
     //painter.drawImage(cursorP, foo);
 }
@@ -361,13 +797,29 @@ void GLView::messageTimerUpdate()
 
 void GLView::brushSizeChanged()
 {
+    if (StrokeJournal::isRecording()) {
+        JournalEntry entry;
+        entry.type = JournalEvent::BRUSH;
+        entry.brushSize = settings()->brushSize();
+        entry.brushColor = settings()->brushColor();
+        recordJournalEntry(entry);
+    }
+
     update(); // repaint render brush at new size
 }
 
 void GLView::brushColorChanged(QColor oldColor, QColor newColor)
 {
     if (_paintLayerIsDirty) {
-        bakePaintLayer();
+        bakePaintLayer(); // bake with the color the stroke was painted in
+    }
+
+    if (StrokeJournal::isRecording()) {
+        JournalEntry entry;
+        entry.type = JournalEvent::BRUSH;
+        entry.brushSize = settings()->brushSize();
+        entry.brushColor = newColor;
+        recordJournalEntry(entry);
     }
 }
 
@@ -382,10 +834,24 @@ void GLView::onMeshesRemoved(QList<Mesh*> removed)
 
     // release textures of removed meshes
     foreach (Mesh* removedMesh, removed) {
+        TextureImporter::instance()->forgetMesh(removedMesh);
+        MaskBaker::instance()->forgetMesh(removedMesh);
+        UVWireframe::forgetMesh(removedMesh);
+        TexelDensity::forgetMesh(removedMesh);
+        InstanceTextures::forgetMesh(removedMesh);
         if (GLCache::hasMeshTexture(removedMesh)) {
             GLuint unusedTexture = GLCache::removeMeshTexture(removedMesh);
-            glGenTextures(1, &unusedTexture);
+            glDeleteTextures(1, &unusedTexture);
         }
+        TextureResidency::forgetMesh(removedMesh);
+        PaintHistory::forgetMesh(removedMesh);
+        PaintLayers::forgetMesh(removedMesh);
+        TextureCompression::forgetMesh(removedMesh);
+        GeometryStore::forgetMesh(removedMesh);
+        MeshStats::instance()->forgetMesh(removedMesh);
+        MeshBVH::forgetMesh(removedMesh);
+        UVIslands::forgetMesh(removedMesh);
+        GeometryCache::removeMesh(removedMesh);
     }
 
     update();
@@ -393,9 +859,47 @@ void GLView::onMeshesRemoved(QList<Mesh*> removed)
 
 void GLView::onMeshesAltered(QList<Mesh *> altered)
 {
+    makeCurrent();
+
+    foreach (Mesh* mesh, altered) {
+        UVWireframe::forgetMesh(mesh);
+        TexelDensity::forgetMesh(mesh);
+    }
+
     update();
 }
 
+void GLView::onMeshProcessed(Mesh *mesh)
+{
+    makeCurrent();
+
+    // vertices were reordered, reupload on next draw
+    GeometryCache::removeMeshGeometry(mesh);
+
+    update();
+}
+
+QVector<Point2> GLView::strokeDabs(const QList<Point2> &points, float spacing)
+{
+    QVector<Point2> dabs;
+    dabs.reserve(points.size());
+
+    Point2 prevPoint;
+    foreach (Point2 p, points) {
+        dabs.append(p);
+        if (!prevPoint.isNull()) { // fill points in between
+            float distance = prevPoint.distanceToPoint(p);
+            for (float step = spacing; step < distance; step += spacing) {
+                float a = step / distance;
+                float b = 1 - a;
+                dabs.append(prevPoint * a + p * b);
+            }
+        }
+        prevPoint = p;
+    }
+    return dabs;
+}
+
 void GLView::drawPaintStrokes()
 {
     if (_strokePoints.size() == 0)
@@ -418,7 +922,7 @@ void GLView::drawPaintStrokes()
     //glAlphaFunc(GL_GREATER, 0.5);
     //glEnable(GL_ALPHA_TEST);
 
-    brushTexture->bind();
+    bindBrush();
 
     auto drawPoint = [brushRadius](Point2 p) { // helper func
         glTexCoord2f(0, 0);
@@ -431,25 +935,22 @@ void GLView::drawPaintStrokes()
         glVertex2f(-brushRadius + p.x(), brushRadius + p.y());
     };
 
-    Point2 prevPoint;
+    BrushLibrary* brushes = BrushLibrary::instance();
+    float spacing = brushes->presetCount() > 0 ? brushes->preset(brushes->activePreset()).spacing : 1;
+    QVector<Point2> dabs = strokeDabs(_strokePoints, spacing);
     glBegin(GL_QUADS);
     glColor4f(1,1,1,1);
-    foreach (Point2 p, _strokePoints) {
+    foreach (Point2 p, dabs) {
         drawPoint(p);
-        if (!prevPoint.isNull()) { // draw points in between
-            float distance = prevPoint.distanceToPoint(p);
-            for (int i = 1; i < distance; i++) {
-                float a = i / distance;
-                float b = 1 - a;
-                Point2 tweenPoint = prevPoint * a + p * b;
-                drawPoint(tweenPoint);
-            }
-        }
-        prevPoint = p;
     }
     glEnd();
+    Profiler::recordDabs(dabs.size());
+
+    foreach (Point2 p, _strokePoints) {
+        _strokeBounds = _strokeBounds.united(QRectF(p.x() - brushRadius, p.y() - brushRadius, brushRadius * 2, brushRadius * 2));
+    }
 
-    brushTexture->release();
+    releaseBrush();
     glDisable(GL_TEXTURE_2D);
     glDisable(GL_BLEND);
     //glDisable(GL_ALPHA_TEST);
@@ -491,6 +992,45 @@ void GLView::drawPaintLayer()
     _paintDebugShader->release();
 }
 
+// with the transfer fbo bound and the bake's viewport and scissor set, the
+// baked texels become mix(target, baked, mask)
+void GLView::applyBakeMask(Mesh *mesh, GLuint target, QRect dirty)
+{
+    if (!_bakeCopyTexture) {
+        glGenTextures(1, &_bakeCopyTexture);
+        glBindTexture(GL_TEXTURE_2D, _bakeCopyTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, PAINT_FBO_WIDTH, PAINT_FBO_WIDTH, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    // the shader can't sample the fbo it draws into
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, _bakeCopyTexture);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, dirty.x(), dirty.y(), dirty.x(), dirty.y(), dirty.width(), dirty.height());
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, MaskBaker::instance()->maskTexture(mesh));
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, target);
+
+    _maskMixShader->bind();
+    _maskMixShader->setUniformValue("targetTexture", 0);
+    _maskMixShader->setUniformValue("bakedTexture", 1);
+    _maskMixShader->setUniformValue("maskTexture", 2);
+    _maskMixShader->setUniformValue("bakedScale", mesh->textureSize() / (float)PAINT_FBO_WIDTH);
+
+    glBegin(GL_QUADS);
+    {
+        glVertex2f(0,0);
+        glVertex2f(1,0);
+        glVertex2f(1,1);
+        glVertex2f(0,1);
+    }
+    glEnd();
+
+    _maskMixShader->release();
+}
+
 // duration in milliseconds
 void GLView::setBusyMessage(QString message, int duration)
 {
@@ -506,8 +1046,16 @@ void GLView::bakePaintLayer()
     makeCurrent();
     setBusyMessage("baking", 400);
 
+    QElapsedTimer bakeTimer;
+    bakeTimer.start();
+
     Project* project = Project::activeProject();
 
+    // only bakes that carry strokes become undo steps
+    if (_paintLayerIsDirty) {
+        PaintHistory::beginBake();
+    }
+
     transferFbo()->bind();
 
     QMatrix4x4 cameraProjM = _camera->getProjMatrix(width(), height());
@@ -525,13 +1073,42 @@ void GLView::bakePaintLayer()
         if (!project->meshVisible(mesh)) // ignore hidden
             continue;
 
+        TextureResidency::ensureResident(mesh);
+        TextureCompression::ensureUncompressed(mesh);
+
+        QElapsedTimer meshBakeTimer;
+        meshBakeTimer.start();
+
         const int TARGET_TEXTURE_SIZE = mesh->textureSize();
+
+        // only texels under the strokes can change
+        QRect dirty(0, 0, TARGET_TEXTURE_SIZE, TARGET_TEXTURE_SIZE);
+        QRectF uvBounds;
+        if (!_strokeBounds.isNull()) {
+            uvBounds = BakeFootprint::uvBounds(mesh, cameraProjViewM, _strokeBounds, size(), meshVertexSpace());
+            dirty = BakeFootprint::texelRect(uvBounds, TARGET_TEXTURE_SIZE);
+        }
+        if (dirty.isEmpty())
+            continue; // strokes don't touch this mesh
+
+        // the footprint's texel rect may still miss every uv island
+        if (!UVIslands::touchesRect(mesh, uvBounds))
+            continue;
+        MeshGeometry* geometry = GeometryCache::meshGeometry(mesh);
+
+        // strokes go into the active layer, the mesh texture without a layer stack
+        GLuint target = PaintLayers::bakeTarget(mesh);
+
+        PaintHistory::captureBefore(mesh, target, dirty);
+
         glViewport(0, 0, TARGET_TEXTURE_SIZE, TARGET_TEXTURE_SIZE);
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(dirty.x(), dirty.y(), dirty.width(), dirty.height());
 
         QMatrix4x4 objToWorld;
 
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, GLCache::meshTextureId(mesh));
+        glBindTexture(GL_TEXTURE_2D, target);
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, paintFbo()->texture());
         glActiveTexture(GL_TEXTURE2);
@@ -542,6 +1119,11 @@ void GLView::bakePaintLayer()
 
         QColor brushColor = settings()->brushColor();
 
+        QOpenGLVertexArrayObject *vao = GLCache::meshVertexArray(mesh);
+
+        // the projected attribute holds positions in 3D views
+        objToWorld = objToWorld * GeometryCache::attributeToObject(geometry, meshVertexSpace());
+
         _bakeShader->bind();
         _bakeShader->setUniformValue("objToWorld", objToWorld);
         _bakeShader->setUniformValue("orthoPV", orthoProjViewM);
@@ -552,51 +1134,60 @@ void GLView::bakePaintLayer()
         _bakeShader->setUniformValue("targetScale", targetScale);
         _bakeShader->setUniformValue("brushColor", brushColor.redF(), brushColor.greenF(), brushColor.blueF(), 1);
 
-        QOpenGLBuffer *vbo = GLCache::meshVertexBuffer(mesh);
-        QOpenGLBuffer *uvbo = GLCache::meshUVBuffer(mesh);
-        QOpenGLBuffer *ibo = GLCache::meshIndexBuffer(mesh);
-        QOpenGLVertexArrayObject *vao = GLCache::meshVertexArray(mesh);
-
-        QOpenGLBuffer* textureBuffer;
-        if (meshVertexSpace() == MeshPropType::UV) {
-            textureBuffer = uvbo;
-        } else {
-            textureBuffer = vbo;
-        }
-
         vao->bind();
-        uvbo->bind();
-        _meshShader->enableAttributeArray("position");
-        _meshShader->setAttributeBuffer("position", GL_FLOAT, 0, 3, 0);
-        uvbo->release();
-        textureBuffer->bind();
-        _meshShader->enableAttributeArray("in_uvs");
-        _meshShader->setAttributeBuffer("in_uvs", GL_FLOAT, 0, 3, 0);
-        textureBuffer->release();
-
-        ibo->bind();
-        glDrawElements(GL_TRIANGLES, mesh->_triangleIndices.count(), GL_UNSIGNED_INT, 0);
-        ibo->release();
+        GeometryCache::setAttribute(_bakeShader, "position", geometry, MeshPropType::UV);
+        GeometryCache::setAttribute(_bakeShader, "in_uvs", geometry, meshVertexSpace());
+        GeometryCache::drawElements(geometry);
         vao->release();
 
         _bakeShader->release();
 
-        // copy bake back into mesh texture
+        if (MaskBaker::instance()->hasMask(mesh)) {
+            applyBakeMask(mesh, target, dirty);
+        }
+
+        glDisable(GL_SCISSOR_TEST);
+
+        // copy bake back into its target, keeping the drawn texture's mip levels
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, GLCache::meshTextureId(mesh));
-        glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 0, 0, TARGET_TEXTURE_SIZE, TARGET_TEXTURE_SIZE, 0);
+        glBindTexture(GL_TEXTURE_2D, target);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, dirty.x(), dirty.y(), dirty.x(), dirty.y(), dirty.width(), dirty.height());
+        if (PaintLayers::hasStack(mesh)) {
+            PaintLayers::recomposite(mesh, dirty);
+        } else {
+            TextureMips::updateRegion(target, TARGET_TEXTURE_SIZE, dirty);
+        }
+
+        PaintHistory::captureAfter(mesh, target, dirty);
+        ProjectArchive::instance()->markTextureDirty(mesh);
+        MeshStats::instance()->recordBake(mesh, meshBakeTimer.nsecsElapsed() / 1000000.0f);
     }
 
     transferFbo()->release();
+    PaintHistory::endBake();
 
     // clear paint buffer
     paintFbo()->bind();
     glClearColor(0,0,0,0);
     glClear(GL_COLOR_BUFFER_BIT);
     paintFbo()->release();
+    _strokeBounds = QRectF();
 
     glViewport(0, 0, width(), height());
 
+    if (Profiler::gpuSync()) {
+        glFinish();
+    }
+    float bakeMs = bakeTimer.nsecsElapsed() / 1000000.0f;
+    Profiler::recordBake(bakeMs);
+
+    if (StrokeJournal::isRecording()) {
+        JournalEntry entry;
+        entry.type = JournalEvent::BAKE;
+        entry.bakeMs = bakeMs;
+        recordJournalEntry(entry);
+    }
+
     // redraw other views that may be using texture
     foreach (GLView* view, _glViews) {
         if (view != this) {
@@ -612,23 +1203,33 @@ void GLView::mousePressEvent(QMouseEvent* event)
     // handle future keyboard widgets with this
     this->setFocus();
 
+    InputLatency::recordEvent(this, event);
+    recordMouseEvent(JournalEvent::MOUSE_PRESS, event);
+
     //bool altDown = event->modifiers() & Qt::AltModifier;
     bool camDown = event->modifiers() & Qt::AltModifier;
 
     if (mouseMode == MouseMode::FREE && camDown) {
         mouseMode = MouseMode::CAMERA;
         activeMouseButton = event->button();
+        recordCameraState(); // lets replays resync even if drags drift
         _camera->mousePressed(_cameraScratch, event);
 
         if (_paintLayerIsDirty) {
             bakePaintLayer(); // bake paint layer while aligned with target
         }
     }
+    else if (mouseMode == MouseMode::FREE && event->button() == Qt::LeftButton && event->modifiers() & Qt::ControlModifier) {
+        MeshPick pick;
+        if (pickSurface(QPointF(event->pos().x(), height() - event->pos().y()), pick)) {
+            emit meshPicked(pick.mesh);
+        }
+    }
     else if (mouseMode == MouseMode::FREE && event->button() & Qt::LeftButton) {
-        _strokePoints.append(Point2(event->pos().x(), height()-event->pos().y()));
+        _strokePoints.append(Point2(event->localPos().x(), height()-event->localPos().y()));
         mouseMode = MouseMode::TOOL;
         activeMouseButton = event->button();
-        _strokePoints.append(Point2(event->pos().x(), height()-event->pos().y()));
+        _strokePoints.append(Point2(event->localPos().x(), height()-event->localPos().y()));
     }
 
     update();
@@ -642,10 +1243,16 @@ void GLView::mouseReleaseEvent(QMouseEvent* event)
 {
     //CursorTool* cursorTool = SunshineUi::cursorTool();
 
+    InputLatency::recordEvent(this, event);
+    recordMouseEvent(JournalEvent::MOUSE_RELEASE, event);
+
     if (mouseMode == MouseMode::CAMERA && event->button() == activeMouseButton) {
         mouseMode = MouseMode::FREE;
         activeMouseButton = -1;
         _camera->mouseReleased(_cameraScratch, event);
+
+        makeCurrent();
+        _navigationResolution.navigationStopped();
     }
     else if (mouseMode == MouseMode::HUD && event->button() == activeMouseButton) {
         mouseMode = MouseMode::FREE;
@@ -662,6 +1269,9 @@ void GLView::mouseReleaseEvent(QMouseEvent* event)
 
 void GLView::mouseMoveEvent(QMouseEvent* event)
 {
+    InputLatency::recordEvent(this, event);
+    recordMouseEvent(JournalEvent::MOUSE_MOVE, event);
+
     if (mouseMode == MouseMode::TOOL) {
         mouseDragEvent(event);
 
@@ -682,7 +1292,11 @@ void GLView::mouseDragEvent(QMouseEvent* event)
         _camera->mouseDragged(_cameraScratch, event);
     }
     else if (mouseMode == MouseMode::TOOL) {
-        _strokePoints.append(Point2(event->pos().x(), height()-event->pos().y()));
+        // sub-pixel positions of high rate mice, moves that stay put add nothing
+        Point2 p(event->localPos().x(), height() - event->localPos().y());
+        if (_strokePoints.isEmpty() || _strokePoints.last().distanceToPoint(p) >= STROKE_MIN_POINT_DISTANCE) {
+            _strokePoints.append(p);
+        }
     }
 
     update();
@@ -704,6 +1318,24 @@ void GLView::resizeEvent(QResizeEvent *event)
 
 void GLView::keyPressEvent(QKeyEvent *event)
 {
+    if (StrokeJournal::isRecording()) {
+        JournalEntry entry;
+        entry.type = JournalEvent::KEY_PRESS;
+        entry.key = event->key();
+        entry.modifiers = event->modifiers();
+        recordJournalEntry(entry);
+    }
+
+    if (event->key() == Qt::Key_F2) {
+        Profiler::setOverlayVisible(!Profiler::overlayVisible());
+        foreach (GLView* view, _glViews) {
+            view->update();
+        }
+    } else if (event->key() == Qt::Key_F3) {
+        InputLatency::setLowLatency(!InputLatency::lowLatency());
+        setBusyMessage(InputLatency::lowLatency() ? "low latency cursor" : "regular cursor", 400);
+    }
+
     if (mouseMode == MouseMode::FREE) {
         if (event->key() == Qt::Key_Space) {
             bakePaintLayer();
@@ -711,8 +1343,171 @@ void GLView::keyPressEvent(QKeyEvent *event)
             settings()->setBrushSize(settings()->brushSize() - 10);
         } else if (event->key() == Qt::Key_BracketRight) {
             settings()->setBrushSize(settings()->brushSize() + 10);
+        } else if (event->key() == Qt::Key_I && event->modifiers() == (Qt::ControlModifier | Qt::ShiftModifier)) {
+            QStringList paths = QFileDialog::getOpenFileNames(this, "Import Textures", QString(),
+                                                              "Images (*.png *.jpg *.jpeg *.tga *.tif *.tiff *.exr);;All Files (*)");
+            if (!paths.isEmpty()) {
+                if (_paintLayerIsDirty) {
+                    bakePaintLayer(); // imports replace the texture with its history
+                }
+                makeCurrent();
+                int queued = TextureImporter::instance()->importFiles(paths);
+                setBusyMessage(QString("importing %1 textures").arg(queued), 1000);
+            }
+        } else if (event->key() == Qt::Key_T) {
+            // resample textures to the texel density plan
+            if (_paintLayerIsDirty) {
+                bakePaintLayer(); // strokes are resampled with the texture
+            }
+            makeCurrent();
+            int resampled = TexelDensity::replan();
+            setBusyMessage(QString("resampled %1 textures").arg(resampled), 1000);
+            foreach (GLView* view, _glViews) {
+                view->update();
+            }
+        } else if (event->key() == Qt::Key_W) {
+            UVWireframe::setVisible(!UVWireframe::isVisible());
+            foreach (GLView* view, _glViews) {
+                view->update();
+            }
+        } else if (event->key() == Qt::Key_M) {
+            // M bakes an occlusion mask, shift M a curvature mask, ctrl M clears
+            if (_paintLayerIsDirty) {
+                bakePaintLayer(); // strokes so far were painted without the mask
+            }
+            makeCurrent();
+            Project* project = Project::activeProject();
+            foreach (Mesh* mesh, project->meshes()) {
+                if (!project->meshVisible(mesh))
+                    continue;
+                if (event->modifiers() & Qt::ControlModifier) {
+                    MaskBaker::instance()->forgetMesh(mesh);
+                } else {
+                    MaskBaker::instance()->bake(mesh, event->modifiers() & Qt::ShiftModifier ? MaskType::CURVATURE
+                                                                                             : MaskType::AMBIENT_OCCLUSION);
+                }
+            }
+            if (event->modifiers() & Qt::ControlModifier) {
+                setBusyMessage("masks cleared", 400);
+            } else {
+                setBusyMessage("baking masks", 1000);
+            }
+        } else if (event->key() == Qt::Key_Comma || event->key() == Qt::Key_Period) {
+            if (_paintLayerIsDirty) {
+                bakePaintLayer(); // strokes keep the brush they were painted with
+            }
+            BrushLibrary* brushes = BrushLibrary::instance();
+            brushes->setActivePreset(brushes->activePreset() + (event->key() == Qt::Key_Period ? 1 : -1));
+            update();
+        } else if (event->key() == Qt::Key_N && event->modifiers() == (Qt::ControlModifier | Qt::ShiftModifier)) {
+            if (_paintLayerIsDirty) {
+                bakePaintLayer(); // strokes belong to the layer they were painted on
+            }
+            makeCurrent();
+            Project* project = Project::activeProject();
+            foreach (Mesh* mesh, project->meshes()) {
+                if (project->meshVisible(mesh)) {
+                    PaintLayers::addLayer(mesh, QString("layer %1").arg(PaintLayers::layerCount(mesh)));
+                }
+            }
+        } else if (event->key() == Qt::Key_PageUp || event->key() == Qt::Key_PageDown) {
+            if (_paintLayerIsDirty) {
+                bakePaintLayer();
+            }
+            int step = event->key() == Qt::Key_PageUp ? 1 : -1;
+            Project* project = Project::activeProject();
+            foreach (Mesh* mesh, project->meshes()) {
+                if (project->meshVisible(mesh)) {
+                    PaintLayers::setActiveLayer(mesh, PaintLayers::activeLayer(mesh) + step);
+                }
+            }
+        } else if (event->matches(QKeySequence::Save) || event->matches(QKeySequence::SaveAs)) {
+            if (_paintLayerIsDirty) {
+                bakePaintLayer(); // save what is on screen
+            }
+            QString path = ProjectArchive::instance()->path();
+            if (path.isEmpty() || event->matches(QKeySequence::SaveAs)) {
+                // projects are directories, saved and opened with the same picker
+                path = QFileDialog::getExistingDirectory(this, "Save Project", path);
+            }
+            if (!path.isEmpty()) {
+                ProjectArchive::instance()->save(path);
+                setBusyMessage("saving", 400);
+            }
+        } else if (event->matches(QKeySequence::Open)) {
+            QString path = QFileDialog::getExistingDirectory(this, "Open Project");
+            if (!path.isEmpty()) {
+                ProjectArchive::instance()->load(path);
+            }
+        } else if (event->matches(QKeySequence::Undo) || event->matches(QKeySequence::Redo)) {
+            if (_paintLayerIsDirty) {
+                bakePaintLayer(); // unbaked strokes become the step undone
+            }
+            makeCurrent();
+            QList<Mesh*> restored = event->matches(QKeySequence::Undo) ? PaintHistory::undo() : PaintHistory::redo();
+            foreach (Mesh* mesh, restored) {
+                ProjectArchive::instance()->markTextureDirty(mesh);
+            }
+            if (!restored.isEmpty()) {
+                foreach (GLView* view, _glViews) {
+                    view->update();
+                }
+            }
         }
     }
 
     // TODO: call base class if not using this event
 }
+
+void GLView::recordJournalEntry(JournalEntry entry)
+{
+    entry.view = _glViews.indexOf(this);
+    entry.time = StrokeJournal::elapsed();
+    StrokeJournal::record(entry);
+}
+
+void GLView::recordCameraState()
+{
+    if (!StrokeJournal::isRecording())
+        return;
+
+    JournalEntry entry;
+    entry.type = JournalEvent::CAMERA;
+    entry.cameraCenter = _camera->center();
+    entry.cameraFov = _camera->fov();
+
+    PerspectiveCamera* perspective = dynamic_cast<PerspectiveCamera*>(_camera);
+    if (perspective) {
+        entry.cameraYRot = perspective->yRot();
+        entry.cameraUpRot = perspective->upRot();
+    }
+
+    recordJournalEntry(entry);
+}
+
+void GLView::recordMouseEvent(int type, QMouseEvent *event)
+{
+    if (!StrokeJournal::isRecording())
+        return;
+
+    JournalEntry entry;
+    entry.type = type;
+    entry.pos = event->localPos();
+    entry.button = event->button();
+    entry.buttons = event->buttons();
+    entry.modifiers = event->modifiers();
+    entry.eventTimestamp = event->timestamp();
+    recordJournalEntry(entry);
+}
+
+void GLView::applyJournalCamera(const JournalEntry &entry)
+{
+    PerspectiveCamera* perspective = dynamic_cast<PerspectiveCamera*>(_camera);
+    if (perspective) {
+        perspective->setYRot(entry.cameraYRot);
+        perspective->setUpRot(entry.cameraUpRot);
+    }
+    _camera->setCenter(entry.cameraCenter);
+
+    update();
+}
@@ -9,7 +9,6 @@
 
 #include <QTime>
 #include <QOpenGLShaderProgram>
-#include <QOpenGLDebugLogger>
 #include <QOpenGLBuffer>
 #include <QOpenGLVertexArrayObject>
 
@@ -18,6 +17,9 @@
 #include "shader.h"
 #include "mesh.h"
 #include "constants.h"
+#include "strokejournal.h"
+#include "adaptiveresolution.h"
+#include "meshbvh.h"
 
 #define PAINT_FBO_WIDTH 2048
 
@@ -47,7 +49,21 @@ public:
     void leaveEvent(QEvent* event);
     void resizeEvent(QResizeEvent *event);
     void keyPressEvent(QKeyEvent* event);
+
+    static const QList<GLView*>& views();
+
+    // brush dab positions for a stroke, including the points filled in
+    // every spacing pixels between consecutive stroke points
+    static QVector<Point2> strokeDabs(const QList<Point2>& points, float spacing = 1);
+
+    // restores the camera pose stored in a CAMERA journal entry
+    void applyJournalCamera(const JournalEntry& entry);
+
+    // closest surface under a point in GL window coordinates (origin bottom left)
+    bool pickSurface(QPointF windowPos, MeshPick& pick);
 signals:
+    // ctrl+click on a mesh
+    void meshPicked(Mesh* mesh);
 
 public slots:
     void messageTimerUpdate();
@@ -56,6 +72,8 @@ public slots:
     void onMeshAdded();
     void onMeshesRemoved(QList<Mesh*> removed);
     void onMeshesAltered(QList<Mesh*> altered);
+    void onMeshProcessed(Mesh* mesh);
+    // times frames for input latency, again until their fences signal
 protected:
     void resizeGL(int w, int h);
     void paintGL();
@@ -70,8 +88,14 @@ protected:
 
     // non-shared GL resources
     QOpenGLShaderProgram*         _meshShader;
+    QOpenGLShaderProgram*         _instancedMeshShader;
     QOpenGLShaderProgram*         _bakeShader;
+    QOpenGLShaderProgram*         _maskMixShader;
+    GLuint                        _bakeCopyTexture = 0; // transfer fbo texels while a mask mixes them
     QOpenGLShaderProgram*         _paintDebugShader;
+    QOpenGLShaderProgram*         _brushShader;
+    QOpenGLBuffer*                _instanceBuffer = 0; // per copy transforms and layers
+    bool                          _instancing = false;
 
     Camera* _camera;
     CameraScratch             _cameraScratch;
@@ -79,20 +103,33 @@ protected:
     static QList<GLView*> _glViews;
 
     void drawPaintStrokes();
+
+    // binds the active brush preset, or the built in brush until presets
+    // are decoded
+    void bindBrush();
+    void releaseBrush();
     void drawPaintLayer();
 
     void setBusyMessage(QString message, int duration);
 
+    void recordJournalEntry(JournalEntry entry);
+    void recordCameraState();
+    void recordMouseEvent(int type, QMouseEvent* event);
+
 private:
     void                     bakePaintLayer();
+    void                     applyBakeMask(Mesh* mesh, GLuint target, QRect dirty);
 
     QList<Point2>             _strokePoints;
     bool                      _paintLayerIsDirty;
+    QRectF                    _strokeBounds; // window area painted since the last bake
+
+    // reduced resolution rendering while the camera moves
+    AdaptiveResolution        _navigationResolution;
 
     QTimer _messageTimer;
     QString _busyMessage = "";
     QTime _messageFinished;
-    QOpenGLDebugLogger* _logger;
 
 };
 
@@ -0,0 +1,185 @@
+#include "inputlatency.h"
+
+#include <QCoreApplication>
+#include <QHash>
+#include <QList>
+#include <QMouseEvent>
+#include <QElapsedTimer>
+#include <QOpenGLContext>
+#include <algorithm>
+
+#include "profiler.h"
+
+namespace {
+    struct PendingFrame
+    {
+        QWidget* view;
+        GLsync fence;
+        qint64 eventNs;        // oldest event the frame shows
+        qint64 submittedNs;
+        qint64 swappedNs = 0;
+        qint64 signaledNs = 0;
+    };
+
+    QElapsedTimer clock;
+    InputSample ring[INPUT_RING_SIZE];
+    int ringHead = 0; // next slot written
+    int ringCount = 0;
+
+    QHash<QWidget*, qint64> unshownSince; // first event not on screen yet
+    int eventsSinceFrame = 0;
+    QList<PendingFrame> pendingFrames;
+    TimingHistogram latchHistogram(0.25f, 200);
+    bool lowLatencyMode = qgetenv("PAINTBUG_LOW_LATENCY") == "1";
+
+    qint64 now()
+    {
+        if (!clock.isValid()) {
+            clock.start();
+        }
+        return clock.nsecsElapsed();
+    }
+
+    const InputSample& sampleAt(int age)
+    {
+        return ring[(ringHead - 1 - age + INPUT_RING_SIZE) % INPUT_RING_SIZE];
+    }
+
+    void deleteFence(const PendingFrame& frame)
+    {
+        QOpenGLContext::currentContext()->extraFunctions()->glDeleteSync(frame.fence);
+    }
+}
+
+void InputLatency::setApplicationAttributes()
+{
+    // moves within a frame are still drawn once per frame
+    if (qgetenv("PAINTBUG_LOW_LATENCY") == "1") {
+        QCoreApplication::setAttribute(Qt::AA_CompressHighFrequencyEvents, false);
+    }
+}
+
+void InputLatency::recordEvent(QWidget *view, const QMouseEvent *event)
+{
+    InputSample& sample = ring[ringHead];
+    sample.view = view;
+    sample.receivedNs = now();
+    sample.timestamp = event->timestamp();
+    sample.pos = event->localPos();
+
+    ringHead = (ringHead + 1) % INPUT_RING_SIZE;
+    ringCount = std::min(ringCount + 1, INPUT_RING_SIZE);
+    eventsSinceFrame++;
+
+    if (!unshownSince.contains(view)) {
+        unshownSince.insert(view, sample.receivedNs);
+    }
+}
+
+void InputLatency::frameSubmitted(QWidget *view)
+{
+    Profiler::setCounter("input", QString("%1 events last frame, low latency %2")
+                         .arg(eventsSinceFrame).arg(lowLatencyMode ? "on" : "off"));
+    eventsSinceFrame = 0;
+
+    if (!unshownSince.contains(view))
+        return; // nothing new on screen
+
+    // frames that never come back (hidden view) don't pile up
+    if (pendingFrames.size() >= INPUT_MAX_PENDING_FRAMES) {
+        deleteFence(pendingFrames.takeFirst());
+    }
+
+    PendingFrame frame;
+    frame.view = view;
+    frame.fence = QOpenGLContext::currentContext()->extraFunctions()->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame.eventNs = unshownSince.take(view);
+    frame.submittedNs = now();
+    pendingFrames.append(frame);
+}
+
+void InputLatency::frameSwapped(QWidget *view)
+{
+    qint64 time = now();
+    for (int i = 0; i < pendingFrames.size(); i++) {
+        if (pendingFrames[i].view == view && !pendingFrames[i].swappedNs) {
+            pendingFrames[i].swappedNs = time;
+        }
+    }
+}
+
+void InputLatency::pollFrames()
+{
+    QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+    qint64 time = now();
+
+    for (int i = 0; i < pendingFrames.size(); ) {
+        PendingFrame& frame = pendingFrames[i];
+        if (!frame.signaledNs && f->glClientWaitSync(frame.fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+            frame.signaledNs = time;
+        }
+        if (!frame.signaledNs || !frame.swappedNs) {
+            i++;
+            continue;
+        }
+        if (frame.signaledNs - frame.swappedNs > INPUT_IDLE_MS * 1000000LL) {
+            deleteFence(frame); // signaled some time while no view drew
+            pendingFrames.removeAt(i);
+            continue;
+        }
+
+        qint64 shownNs = std::max(frame.signaledNs, frame.swappedNs);
+        Profiler::recordInputLatency((shownNs - frame.eventNs) / 1000000.0f);
+        latchHistogram.add((shownNs - frame.submittedNs) / 1000000.0f);
+
+        deleteFence(frame);
+        pendingFrames.removeAt(i);
+    }
+}
+
+QPointF InputLatency::predict(QWidget *view, QPointF pos, float horizonMs)
+{
+    int newest = 0;
+    while (newest < ringCount && sampleAt(newest).view != view) {
+        newest++;
+    }
+    if (newest == ringCount)
+        return pos;
+
+    const InputSample& last = sampleAt(newest);
+    if (now() - last.receivedNs > INPUT_IDLE_MS * 1000000LL)
+        return pos;
+
+    // event timestamps are closer to the hardware than our receive times
+    const InputSample* first = &last;
+    for (int age = newest + 1; age < ringCount; age++) {
+        const InputSample& sample = sampleAt(age);
+        if (sample.view != view || sample.timestamp > last.timestamp ||
+                last.timestamp - sample.timestamp > INPUT_VELOCITY_WINDOW_MS)
+            break;
+        first = &sample;
+    }
+
+    ulong elapsedMs = last.timestamp - first->timestamp;
+    if (elapsedMs == 0)
+        return pos; // one event, or synthetic ones from a replay
+
+    QPointF velocity = (last.pos - first->pos) / elapsedMs;
+    return pos + velocity * std::min(horizonMs, (float)INPUT_PREDICTION_MAX_MS);
+}
+
+float InputLatency::latchToSwapMs()
+{
+    // a frame at 60 Hz until measured
+    return latchHistogram.count() > 0 ? latchHistogram.percentile(0.5f) : 16.0f;
+}
+
+bool InputLatency::lowLatency()
+{
+    return lowLatencyMode;
+}
+
+void InputLatency::setLowLatency(bool enabled)
+{
+    lowLatencyMode = enabled;
+}
@@ -0,0 +1,61 @@
+#ifndef INPUTLATENCY_H
+#define INPUTLATENCY_H
+
+#include <QPointF>
+#include <QOpenGLExtraFunctions>
+
+class QWidget;
+class QMouseEvent;
+
+#define INPUT_RING_SIZE 1024
+#define INPUT_MAX_PENDING_FRAMES 8
+#define INPUT_VELOCITY_WINDOW_MS 24 // recent motion the prediction follows
+#define INPUT_IDLE_MS 40            // no prediction once the mouse rests
+#define INPUT_PREDICTION_MAX_MS 32
+
+struct InputSample
+{
+    QWidget* view = 0;
+    qint64 receivedNs = 0; // when the handler ran
+    ulong timestamp = 0;   // of the event, window system clock in ms
+    QPointF pos;           // widget coordinates
+};
+
+// measures how far what's on screen lags the mouse. Mouse events go into
+// a ring buffer as they arrive; the first frame drawn after an event gets
+// a fence, and the event counts as shown once the fence has signaled and
+// the frame was swapped. That misses the compositor and scanout, but is
+// the part of the latency the app controls. Fences are only polled when a
+// view draws or swaps, a fence found signaled more than INPUT_IDLE_MS after
+// its swap can't be timed and is dropped.
+//
+// In low latency mode views draw the brush cursor last, from the cursor
+// position read just before the swap, pushed ahead along the recent mouse
+// velocity by the typical latch to swap time.
+class InputLatency
+{
+public:
+    // from main() before the QApplication is constructed. With
+    // PAINTBUG_LOW_LATENCY=1 every mouse move of a high rate mouse reaches
+    // the stroke instead of Qt coalescing them.
+    static void setApplicationAttributes();
+
+    // from mouse handlers, before acting on the event
+    static void recordEvent(QWidget* view, const QMouseEvent* event);
+
+    // with the view's GL context current, after its last GL call of a frame
+    static void frameSubmitted(QWidget* view);
+    static void frameSwapped(QWidget* view);
+    // times frames whose fences signaled, from paintGL and frameSwapped
+    static void pollFrames();
+
+    // pos moved horizonMs ahead along the view's recent mouse motion
+    static QPointF predict(QWidget* view, QPointF pos, float horizonMs);
+    // median time from submitting a frame to showing it
+    static float latchToSwapMs();
+
+    static bool lowLatency();
+    static void setLowLatency(bool enabled);
+};
+
+#endif // INPUTLATENCY_H
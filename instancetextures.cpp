@@ -0,0 +1,188 @@
+#include "instancetextures.h"
+
+#include <QHash>
+#include <QSet>
+#include <QPair>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <algorithm>
+
+#include "texturemips.h"
+#include "textureresidency.h"
+#include "projectarchive.h"
+#include "profiler.h"
+
+namespace {
+    struct LayeredTexture
+    {
+        GLuint texture = 0;
+        int size = 0;
+        int layers = 0; // allocated
+        QVector<Mesh*> meshes;
+        QVector<GLuint> sources;        // texture each layer was copied from
+        QVector<quint64> generations;   // ProjectArchive texture generation at the copy
+    };
+
+    // keyed by the first copy and the texture size
+    typedef QPair<Mesh*, int> ArrayKey;
+    QHash<ArrayKey, LayeredTexture> arrays;
+    QSet<ArrayKey> frameArrays;                  // used since the last endFrame
+    QHash<QWidget*, QSet<ArrayKey> > viewArrays; // used in each view's last frame
+
+    GLuint readFbo = 0;
+    GLuint drawFbo = 0;
+
+    int levelCount(int size)
+    {
+#if MESH_TEXTURE_MIPMAPS
+        return TextureMips::levelCount(size);
+#else
+        Q_UNUSED(size);
+        return 1;
+#endif
+    }
+
+    void allocate(LayeredTexture& array, int layers)
+    {
+        QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+
+        if (array.texture) {
+            f->glDeleteTextures(1, &array.texture);
+        }
+        f->glGenTextures(1, &array.texture);
+        f->glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+        int levels = levelCount(array.size);
+        for (int level = 0; level < levels; level++) {
+            int levelSize = std::max(1, array.size >> level);
+            f->glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, levelSize, levelSize, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        }
+        f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        f->glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        array.layers = layers;
+        array.meshes.clear();
+        array.sources.clear();
+        array.generations.clear();
+    }
+
+    // every level of the source, so the other layers' mips stay untouched
+    void copyLayer(const LayeredTexture& array, GLuint source, int layer)
+    {
+        QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+
+        for (int level = 0; level < levelCount(array.size); level++) {
+            int levelSize = std::max(1, array.size >> level);
+            f->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source, level);
+            f->glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array.texture, level, layer);
+            f->glBlitFramebuffer(0, 0, levelSize, levelSize, 0, 0, levelSize, levelSize, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        }
+    }
+}
+
+GLuint InstanceTextures::arrayTexture(const QVector<Mesh*> &meshes, int size)
+{
+    if (meshes.isEmpty())
+        return 0;
+
+    ArrayKey key = qMakePair(meshes.first(), size);
+    frameArrays.insert(key);
+    LayeredTexture& array = arrays[key];
+    array.size = size;
+    if (array.layers < meshes.size()) {
+        allocate(array, std::min(INSTANCE_TEXTURE_MAX_LAYERS, std::max(meshes.size(), array.layers * 2)));
+    }
+    array.meshes.resize(meshes.size());
+    array.sources.resize(meshes.size());
+    array.generations.resize(meshes.size());
+
+    QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+    GLint previousRead = 0, previousDraw = 0;
+    bool bound = false;
+
+    for (int layer = 0; layer < meshes.size(); layer++) {
+        Mesh* mesh = meshes[layer];
+        GLuint source = TextureResidency::textureForDraw(mesh);
+        quint64 generation = ProjectArchive::instance()->textureGeneration(mesh);
+        if (array.meshes[layer] == mesh && array.sources[layer] == source && array.generations[layer] == generation)
+            continue;
+
+        if (!bound) {
+            if (!readFbo) {
+                f->glGenFramebuffers(1, &readFbo);
+                f->glGenFramebuffers(1, &drawFbo);
+            }
+            f->glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+            f->glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDraw);
+            f->glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+            f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFbo);
+            bound = true;
+        }
+
+        copyLayer(array, source, layer);
+        array.meshes[layer] = mesh;
+        array.sources[layer] = source;
+        array.generations[layer] = generation;
+    }
+
+    if (bound) {
+        f->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+        f->glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 0, 0, 0);
+        f->glBindFramebuffer(GL_READ_FRAMEBUFFER, previousRead);
+        f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousDraw);
+    }
+
+    return array.texture;
+}
+
+void InstanceTextures::endFrame(QWidget *view)
+{
+    viewArrays[view] = frameArrays;
+    frameArrays.clear();
+
+    QSet<ArrayKey> used;
+    foreach (const QSet<ArrayKey>& keys, viewArrays) {
+        used.unite(keys);
+    }
+
+    QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+    QHash<ArrayKey, LayeredTexture>::iterator it = arrays.begin();
+    while (it != arrays.end()) {
+        if (!used.contains(it.key())) {
+            f->glDeleteTextures(1, &it->texture);
+            it = arrays.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    TextureResidency::setUnmanagedBytes(totalBytes());
+    Profiler::setCounter("instance textures", QString("%1 MB in %2 arrays")
+                         .arg(totalBytes() / (1024.0 * 1024.0), 0, 'f', 1).arg(arrays.size()));
+}
+
+void InstanceTextures::forgetMesh(Mesh *mesh)
+{
+    QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+
+    QHash<ArrayKey, LayeredTexture>::iterator it = arrays.begin();
+    while (it != arrays.end()) {
+        if (it.key().first == mesh || it->meshes.contains(mesh)) {
+            f->glDeleteTextures(1, &it->texture);
+            it = arrays.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    TextureResidency::setUnmanagedBytes(totalBytes());
+}
+
+qint64 InstanceTextures::totalBytes()
+{
+    qint64 bytes = 0;
+    foreach (const LayeredTexture& array, arrays) {
+        bytes += (qint64)array.size * array.size * 4 * array.layers * 4 / 3; // with mips
+    }
+    return bytes;
+}
@@ -0,0 +1,41 @@
+#ifndef INSTANCETEXTURES_H
+#define INSTANCETEXTURES_H
+
+#include <QOpenGLFunctions>
+#include <QVector>
+
+class QWidget;
+
+#include "mesh.h"
+
+#define INSTANCE_TEXTURE_MAX_LAYERS 256 // the least GL 3 guarantees
+
+#ifndef GL_TEXTURE_2D_ARRAY
+#define GL_TEXTURE_2D_ARRAY 0x8C1A
+#endif
+
+// texture arrays for copies of shared geometry drawn in one instanced call.
+// The copies' textures have one size and each is copied into its own layer,
+// so the copies stay independently painted. A layer is copied again when
+// its mesh's texture was replaced or painted since the last draw, the
+// untouched layers of an array stay as they are. Arrays no view drew in its
+// last frame are deleted, the rest count against the TextureResidency budget.
+//
+// Compressed and evicted textures can't be read through a framebuffer,
+// such copies are drawn on their own. All functions need the shared GL
+// context to be current.
+class InstanceTextures
+{
+public:
+    // array with the current texture of meshes[i] in layer i, at most
+    // INSTANCE_TEXTURE_MAX_LAYERS meshes of this texture size
+    static GLuint arrayTexture(const QVector<Mesh*>& meshes, int size);
+    // after a view's draws, frees the arrays no view used in its last frame
+    static void endFrame(QWidget* view);
+
+    static void forgetMesh(Mesh* mesh);
+
+    static qint64 totalBytes();
+};
+
+#endif // INSTANCETEXTURES_H
@@ -0,0 +1,141 @@
+#include "journalreplayer.h"
+
+#include <QMouseEvent>
+#include <QKeyEvent>
+#include <QJsonDocument>
+#include <QFile>
+#include <iostream>
+
+#include "glview.h"
+#include "sessionsettings.h"
+
+JournalReplayer::JournalReplayer(QString path, Speed speed, QObject *parent)
+    : QObject(parent), _path(path), _speed(speed), _recordedBakes(2.0f, 250)
+{
+    _timer.setSingleShot(true);
+    connect(&_timer, SIGNAL(timeout()), this, SLOT(step()));
+}
+
+bool JournalReplayer::start()
+{
+    if (!StrokeJournal::load(_path, _entries))
+        return false;
+
+    std::cout << "replaying " << _entries.size() << " journal entries from " << _path.toStdString()
+              << (_speed == MAX_SPEED ? " at max speed" : " in real time") << std::endl;
+
+    Profiler::reset();
+    Profiler::setGpuSync(true); // bake latencies should include GPU work
+
+    _next = 0;
+    _recordedBakes.clear();
+    _clock.start();
+    _timer.start(0);
+    return true;
+}
+
+void JournalReplayer::step()
+{
+    while (_next < _entries.size()) {
+        const JournalEntry& entry = _entries[_next];
+
+        if (_speed == REAL_TIME) {
+            qint64 dueMs = entry.time / 1000000 - _clock.elapsed();
+            if (dueMs > 0) {
+                _timer.start(dueMs);
+                return;
+            }
+        }
+
+        dispatch(entry);
+        _next++;
+
+        if (_speed == MAX_SPEED) {
+            // render every event so frame counts match the recording, then
+            // yield so the UI stays responsive
+            foreach (GLView* view, GLView::views()) {
+                view->repaint();
+            }
+            _timer.start(0);
+            return;
+        }
+    }
+
+    finish();
+}
+
+void JournalReplayer::dispatch(const JournalEntry& entry)
+{
+    if (entry.view >= GLView::views().size()) {
+        std::cerr << "journal references view " << (int)entry.view << " which does not exist" << std::endl;
+        return;
+    }
+
+    GLView* view = GLView::views()[entry.view];
+    Qt::MouseButton button = (Qt::MouseButton)entry.button;
+    Qt::MouseButtons buttons = (Qt::MouseButtons)entry.buttons;
+    Qt::KeyboardModifiers modifiers = (Qt::KeyboardModifiers)entry.modifiers;
+
+    switch (entry.type) {
+    case JournalEvent::VIEW_SIZE:
+        if (entry.size != view->size()) {
+            std::cerr << "view " << (int)entry.view << " is " << view->width() << "x" << view->height()
+                      << " but was recorded at " << entry.size.width() << "x" << entry.size.height() << std::endl;
+        }
+        break;
+    case JournalEvent::CAMERA:
+        view->applyJournalCamera(entry);
+        break;
+    case JournalEvent::BRUSH:
+        settings()->setBrushSize(entry.brushSize);
+        settings()->setBrushColor(entry.brushColor);
+        break;
+    case JournalEvent::MOUSE_PRESS: {
+        QMouseEvent event(QEvent::MouseButtonPress, entry.pos, button, buttons, modifiers);
+        view->mousePressEvent(&event);
+        break;
+    }
+    case JournalEvent::MOUSE_MOVE: {
+        QMouseEvent event(QEvent::MouseMove, entry.pos, button, buttons, modifiers);
+        view->mouseMoveEvent(&event);
+        break;
+    }
+    case JournalEvent::MOUSE_RELEASE: {
+        QMouseEvent event(QEvent::MouseButtonRelease, entry.pos, button, buttons, modifiers);
+        view->mouseReleaseEvent(&event);
+        break;
+    }
+    case JournalEvent::KEY_PRESS: {
+        QKeyEvent event(QEvent::KeyPress, entry.key, modifiers);
+        view->keyPressEvent(&event);
+        break;
+    }
+    case JournalEvent::BAKE:
+        // bakes are replayed by the input that caused them, keep the
+        // recorded latency around for comparison
+        _recordedBakes.add(entry.bakeMs);
+        break;
+    }
+}
+
+void JournalReplayer::finish()
+{
+    Profiler::setGpuSync(false);
+
+    QJsonObject report = Profiler::report();
+    report["journal"] = _path;
+    report["entries"] = _entries.size();
+    report["wall_ms"] = (double)_clock.elapsed();
+    report["speed"] = _speed == MAX_SPEED ? "max" : "realtime";
+    report["recorded_bakes"] = _recordedBakes.toJson();
+
+    QByteArray json = QJsonDocument(report).toJson();
+    std::cout << json.constData() << std::endl;
+
+    QFile reportFile(_path + ".report.json");
+    if (reportFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        reportFile.write(json);
+    }
+
+    emit finished(report);
+}
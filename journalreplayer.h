@@ -0,0 +1,44 @@
+#ifndef JOURNALREPLAYER_H
+#define JOURNALREPLAYER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+#include "strokejournal.h"
+#include "profiler.h"
+
+// feeds a recorded stroke journal back into the GLViews and reports
+// frame times, bake latencies and dab throughput once it finishes
+class JournalReplayer : public QObject
+{
+    Q_OBJECT
+public:
+    enum Speed { REAL_TIME, MAX_SPEED };
+
+    explicit JournalReplayer(QString path, Speed speed, QObject *parent = 0);
+
+    bool start();
+
+signals:
+    void finished(QJsonObject report);
+
+private slots:
+    void step();
+
+private:
+    void dispatch(const JournalEntry& entry);
+    void finish();
+
+    QString _path;
+    Speed _speed;
+    QVector<JournalEntry> _entries;
+    int _next = 0;
+
+    QTimer _timer;
+    QElapsedTimer _clock;
+    TimingHistogram _recordedBakes;
+};
+
+#endif // JOURNALREPLAYER_H
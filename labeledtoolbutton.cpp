@@ -1,6 +1,7 @@
 #include "labeledtoolbutton.h"
 
 #include <QPainter>
+#include <QPixmapCache>
 
 LabeledToolButton::LabeledToolButton(QWidget *parent) : QToolButton(parent)
 {
@@ -13,31 +14,48 @@ void LabeledToolButton::paintEvent(QPaintEvent *event)
 
     drawBackground();
 
-    QPainter p(this);
-
-    QFont textFont = p.font();
-    textFont.setPixelSize(9);
-    p.setFont(textFont);
-    const int textHeight = p.fontMetrics().height();
-    QColor textBgColor(200, 200, 200, 240);
-
-    // draw labels
-    //
+    // labels are laid out once per text and size, repaints only blit them
     QString nameText = toolName();
-    if (nameText.length() > 0) {
-        int textWidth = p.fontMetrics().boundingRect(nameText).width();
-        QPoint textP(2, textHeight + 2);
-        p.fillRect(0, 0, textWidth + 4, textHeight + 4, textBgColor);
-        p.setPen(Qt::black);
-        p.drawText(textP, nameText);
-    }
-
     QString valueText = toolValue();
-    if (valueText.length() > 0) {
-        int textWidth = p.fontMetrics().boundingRect(valueText).width();
-        QPoint textP(width() - textWidth - 2, height() - 2);
-        p.fillRect(textP.x() - 2, textP.y() - 2 - textHeight, textWidth + 4, textHeight + 4, textBgColor);
-        p.setPen(Qt::black);
-        p.drawText(textP, valueText);
+    qreal ratio = devicePixelRatioF();
+    QString key = QString("toolbutton-labels:%1:%2:%3x%4@%5").arg(nameText, valueText)
+            .arg(width()).arg(height()).arg(ratio);
+
+    QPixmap labels;
+    if (!QPixmapCache::find(key, &labels)) {
+        labels = QPixmap(size() * ratio);
+        labels.setDevicePixelRatio(ratio);
+        labels.fill(Qt::transparent);
+
+        QPainter lp(&labels);
+        QFont textFont = lp.font();
+        textFont.setPixelSize(9);
+        lp.setFont(textFont);
+        const int textHeight = lp.fontMetrics().height();
+        QColor textBgColor(200, 200, 200, 240);
+
+        // draw labels
+        //
+        if (nameText.length() > 0) {
+            int textWidth = lp.fontMetrics().boundingRect(nameText).width();
+            QPoint textP(2, textHeight + 2);
+            lp.fillRect(0, 0, textWidth + 4, textHeight + 4, textBgColor);
+            lp.setPen(Qt::black);
+            lp.drawText(textP, nameText);
+        }
+
+        if (valueText.length() > 0) {
+            int textWidth = lp.fontMetrics().boundingRect(valueText).width();
+            QPoint textP(width() - textWidth - 2, height() - 2);
+            lp.fillRect(textP.x() - 2, textP.y() - 2 - textHeight, textWidth + 4, textHeight + 4, textBgColor);
+            lp.setPen(Qt::black);
+            lp.drawText(textP, valueText);
+        }
+        lp.end();
+
+        QPixmapCache::insert(key, labels);
     }
+
+    QPainter p(this);
+    p.drawPixmap(0, 0, labels);
 }
@@ -0,0 +1,470 @@
+#include "maskbaker.h"
+
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QOpenGLContext>
+#include <QThreadPool>
+#include <QVector3D>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+#include "meshbvh.h"
+#include "geometrystore.h"
+#include "profiler.h"
+
+namespace {
+    struct MaskTile
+    {
+        int x0, y0, x1, y1;
+        QVector<int> triangles; // overlapping the tile in uv space
+        qint64 rays = 0;
+        qint64 texels = 0;
+    };
+
+    // vertices split at uv or normal seams are joined by position, so
+    // normals and curvature stay continuous across the seam
+    QVector<int> weldByPosition(const QVector<float>& vertices, int& weldedCount)
+    {
+        int vertexCount = vertices.size() / 3;
+        QVector<int> welded(vertexCount);
+        QHash<QByteArray, int> first;
+        first.reserve(vertexCount);
+        weldedCount = 0;
+        for (int v = 0; v < vertexCount; v++) {
+            QByteArray key((const char*)&vertices[v * 3], 3 * sizeof(float));
+            int id = first.value(key, -1);
+            if (id < 0) {
+                id = weldedCount++;
+                first.insert(key, id);
+            }
+            welded[v] = id;
+        }
+        return welded;
+    }
+
+    QVector3D vertexAt(const QVector<float>& vertices, int v)
+    {
+        return QVector3D(vertices[v * 3], vertices[v * 3 + 1], vertices[v * 3 + 2]);
+    }
+
+    float radicalInverse(quint32 bits)
+    {
+        bits = (bits << 16) | (bits >> 16);
+        bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+        bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+        bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+        bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+        return bits * 2.3283064365386963e-10f;
+    }
+
+    // rotates the shared sample set per texel, turning banding into noise
+    float texelAngle(int x, int y)
+    {
+        quint32 h = (quint32)x * 73856093u ^ (quint32)y * 19349663u;
+        h ^= h >> 13;
+        h *= 0x5bd1e995u;
+        h ^= h >> 15;
+        return (h & 0xffff) / 65536.0f * 2 * (float)M_PI;
+    }
+
+    // grows covered texels into uncovered neighbours, one texel per pass
+    void dilate(QVector<uchar>& texels, QVector<uchar>& covered, int size)
+    {
+        QVector<int> rows(size);
+        for (int y = 0; y < size; y++) {
+            rows[y] = y;
+        }
+
+        for (int pass = 0; pass < MASK_DILATE_TEXELS; pass++) {
+            QVector<uchar> nextTexels = texels;
+            QVector<uchar> nextCovered = covered;
+            // detached here, not by the first write on some worker
+            uchar* toTexels = nextTexels.data();
+            uchar* toCovered = nextCovered.data();
+            const uchar* fromTexels = texels.constData();
+            const uchar* fromCovered = covered.constData();
+
+            QtConcurrent::blockingMap(rows, [&](int y) {
+                for (int x = 0; x < size; x++) {
+                    if (fromCovered[y * size + x])
+                        continue;
+                    int sum = 0, count = 0;
+                    const int offsets[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+                    for (int i = 0; i < 4; i++) {
+                        int nx = x + offsets[i][0], ny = y + offsets[i][1];
+                        if (nx >= 0 && ny >= 0 && nx < size && ny < size && fromCovered[ny * size + nx]) {
+                            sum += fromTexels[ny * size + nx];
+                            count++;
+                        }
+                    }
+                    if (count > 0) {
+                        toTexels[y * size + x] = (uchar)(sum / count);
+                        toCovered[y * size + x] = 1;
+                    }
+                }
+            });
+            texels = nextTexels;
+            covered = nextCovered;
+        }
+    }
+}
+
+MaskBaker* MaskBaker::instance()
+{
+    static MaskBaker* baker = new MaskBaker();
+    return baker;
+}
+
+MaskBaker::MaskBaker(QObject *parent) : QObject(parent)
+{
+}
+
+QVector<uchar> MaskBaker::bakeMask(const MaskBakeInput &input, MaskBakeStats *stats, const std::atomic<bool> *cancelled)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const int size = input.size;
+    const int vertexCount = input.vertices.size() / 3;
+    const int triangleCount = input.indices.size() / 3;
+    const bool occlusion = input.type == MaskType::AMBIENT_OCCLUSION;
+
+    QVector<uchar> texels(size * size, occlusion ? 255 : 128);
+    if (size <= 0 || triangleCount == 0 || input.uvStride < 2)
+        return texels;
+
+    QVector3D boundsMin(FLT_MAX, FLT_MAX, FLT_MAX), boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (int v = 0; v < vertexCount; v++) {
+        QVector3D p = vertexAt(input.vertices, v);
+        boundsMin = QVector3D(std::min(boundsMin.x(), p.x()), std::min(boundsMin.y(), p.y()), std::min(boundsMin.z(), p.z()));
+        boundsMax = QVector3D(std::max(boundsMax.x(), p.x()), std::max(boundsMax.y(), p.y()), std::max(boundsMax.z(), p.z()));
+    }
+    float diagonal = (boundsMax - boundsMin).length();
+
+    // area weighted smooth normals over the welded vertices
+    int weldedCount = 0;
+    QVector<int> welded = weldByPosition(input.vertices, weldedCount);
+    QVector<QVector3D> normals(weldedCount);
+    QVector<QVector3D> faceNormals(triangleCount);
+    for (int t = 0; t < triangleCount; t++) {
+        const quint32* tri = input.indices.constData() + t * 3;
+        QVector3D p0 = vertexAt(input.vertices, tri[0]);
+        QVector3D n = QVector3D::crossProduct(vertexAt(input.vertices, tri[1]) - p0, vertexAt(input.vertices, tri[2]) - p0);
+        faceNormals[t] = n.normalized();
+        for (int c = 0; c < 3; c++) {
+            normals[welded[tri[c]]] += n;
+        }
+    }
+    for (int v = 0; v < weldedCount; v++) {
+        normals[v].normalize();
+    }
+
+    // mean curvature along the edges, how fast the normal turns per unit
+    // of length, scaled by the mean edge length so it doesn't depend on
+    // the mesh's units
+    QVector<float> curvature;
+    if (!occlusion) {
+        QVector<QVector3D> positions(weldedCount);
+        for (int v = 0; v < vertexCount; v++) {
+            positions[welded[v]] = vertexAt(input.vertices, v);
+        }
+
+        QVector<float> sums(weldedCount, 0);
+        QVector<int> counts(weldedCount, 0);
+        double edgeLength = 0;
+        for (int t = 0; t < triangleCount; t++) {
+            for (int c = 0; c < 3; c++) {
+                int a = welded[input.indices[t * 3 + c]];
+                int b = welded[input.indices[t * 3 + (c + 1) % 3]];
+                QVector3D edge = positions[b] - positions[a];
+                float lengthSquared = edge.lengthSquared();
+                if (lengthSquared <= 0)
+                    continue;
+                float k = QVector3D::dotProduct(normals[b] - normals[a], edge) / lengthSquared;
+                sums[a] += k; counts[a]++;
+                sums[b] += k; counts[b]++;
+                edgeLength += std::sqrt(lengthSquared);
+            }
+        }
+        edgeLength /= triangleCount * 3;
+
+        curvature.resize(weldedCount);
+        for (int v = 0; v < weldedCount; v++) {
+            float k = counts[v] ? sums[v] / counts[v] : 0;
+            curvature[v] = 0.5f + 0.5f * std::max(-1.0f, std::min(1.0f, k * (float)edgeLength * MASK_CURVATURE_SCALE));
+        }
+    }
+
+    // benchmarks bake arrays without a mesh and its hierarchy
+    std::shared_ptr<const MeshBVH> bvh = input.bvh;
+    if (occlusion && !bvh) {
+        bvh.reset(MeshBVH::build(input.vertices, 3, input.indices));
+    }
+
+    // cosine weighted hemisphere samples around +z
+    QVector3D samples[MASK_AO_RAYS];
+    for (int i = 0; i < MASK_AO_RAYS; i++) {
+        float u = (i + 0.5f) / MASK_AO_RAYS;
+        float phi = 2 * (float)M_PI * radicalInverse(i);
+        float r = std::sqrt(u);
+        samples[i] = QVector3D(r * std::cos(phi), r * std::sin(phi), std::sqrt(1 - u));
+    }
+
+    // bin triangles into tiles by their texel bounds. Tiled uvs outside
+    // the unit square are clipped, not wrapped.
+    int tilesPerSide = (size + MASK_TILE_SIZE - 1) / MASK_TILE_SIZE;
+    QVector<MaskTile> tiles(tilesPerSide * tilesPerSide);
+    for (int ty = 0; ty < tilesPerSide; ty++) {
+        for (int tx = 0; tx < tilesPerSide; tx++) {
+            MaskTile& tile = tiles[ty * tilesPerSide + tx];
+            tile.x0 = tx * MASK_TILE_SIZE;
+            tile.y0 = ty * MASK_TILE_SIZE;
+            tile.x1 = std::min(tile.x0 + MASK_TILE_SIZE, size);
+            tile.y1 = std::min(tile.y0 + MASK_TILE_SIZE, size);
+        }
+    }
+
+    QVector<float> texelUVs(vertexCount * 2);
+    for (int v = 0; v < vertexCount; v++) {
+        texelUVs[v * 2] = input.uvs[v * input.uvStride] * size;
+        texelUVs[v * 2 + 1] = input.uvs[v * input.uvStride + 1] * size;
+    }
+
+    for (int t = 0; t < triangleCount; t++) {
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+        for (int c = 0; c < 3; c++) {
+            const float* uv = texelUVs.constData() + input.indices[t * 3 + c] * 2;
+            minX = std::min(minX, uv[0]); maxX = std::max(maxX, uv[0]);
+            minY = std::min(minY, uv[1]); maxY = std::max(maxY, uv[1]);
+        }
+        int x0 = std::max(0, (int)std::floor(minX - 0.5f)), x1 = std::min(size - 1, (int)std::ceil(maxX - 0.5f));
+        int y0 = std::max(0, (int)std::floor(minY - 0.5f)), y1 = std::min(size - 1, (int)std::ceil(maxY - 0.5f));
+        if (x0 > x1 || y0 > y1)
+            continue;
+        for (int ty = y0 / MASK_TILE_SIZE; ty <= y1 / MASK_TILE_SIZE; ty++) {
+            for (int tx = x0 / MASK_TILE_SIZE; tx <= x1 / MASK_TILE_SIZE; tx++) {
+                tiles[ty * tilesPerSide + tx].triangles.append(t);
+            }
+        }
+    }
+
+    QVector<uchar> covered(size * size, 0);
+    uchar* texelData = texels.data();
+    uchar* coveredData = covered.data();
+    const int* weldedData = welded.constData();
+    const QVector3D* normalData = normals.constData();
+    const QVector3D* faceNormalData = faceNormals.constData();
+    const float* curvatureData = curvature.constData();
+    const float bias = diagonal * MASK_AO_BIAS;
+    const float maxDistance = diagonal * MASK_AO_DISTANCE;
+
+    QtConcurrent::blockingMap(tiles, [&](MaskTile& tile) {
+        if (tile.triangles.isEmpty() || (cancelled && *cancelled))
+            return;
+
+        foreach (int t, tile.triangles) {
+            const quint32* tri = input.indices.constData() + t * 3;
+            const float* a = texelUVs.constData() + tri[0] * 2;
+            const float* b = texelUVs.constData() + tri[1] * 2;
+            const float* c = texelUVs.constData() + tri[2] * 2;
+            float area = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+            if (std::fabs(area) < 1e-12f)
+                continue;
+            float invArea = 1.0f / area;
+
+            int x0 = std::max(tile.x0, (int)std::floor(std::min(a[0], std::min(b[0], c[0])) - 0.5f));
+            int x1 = std::min(tile.x1 - 1, (int)std::ceil(std::max(a[0], std::max(b[0], c[0])) - 0.5f));
+            int y0 = std::max(tile.y0, (int)std::floor(std::min(a[1], std::min(b[1], c[1])) - 0.5f));
+            int y1 = std::min(tile.y1 - 1, (int)std::ceil(std::max(a[1], std::max(b[1], c[1])) - 0.5f));
+
+            for (int y = y0; y <= y1; y++) {
+                for (int x = x0; x <= x1; x++) {
+                    // overlapping uvs keep the first triangle
+                    if (coveredData[y * size + x])
+                        continue;
+
+                    float px = x + 0.5f, py = y + 0.5f;
+                    float w0 = ((b[0] - px) * (c[1] - py) - (b[1] - py) * (c[0] - px)) * invArea;
+                    float w1 = ((c[0] - px) * (a[1] - py) - (c[1] - py) * (a[0] - px)) * invArea;
+                    float w2 = 1 - w0 - w1;
+                    const float edge = -1e-4f;
+                    if (w0 < edge || w1 < edge || w2 < edge)
+                        continue;
+
+                    int v0 = weldedData[tri[0]], v1 = weldedData[tri[1]], v2 = weldedData[tri[2]];
+                    uchar value;
+                    if (occlusion) {
+                        QVector3D position = vertexAt(input.vertices, tri[0]) * w0 + vertexAt(input.vertices, tri[1]) * w1
+                                + vertexAt(input.vertices, tri[2]) * w2;
+                        QVector3D normal = (normalData[v0] * w0 + normalData[v1] * w1 + normalData[v2] * w2).normalized();
+                        QVector3D faceNormal = faceNormalData[t];
+                        if (normal.isNull()) {
+                            normal = faceNormal;
+                        }
+                        if (QVector3D::dotProduct(faceNormal, normal) < 0) {
+                            faceNormal = -faceNormal;
+                        }
+                        QVector3D origin = position + faceNormal * bias;
+
+                        // frame around the normal, rotated per texel
+                        QVector3D helper = std::fabs(normal.x()) < 0.9f ? QVector3D(1, 0, 0) : QVector3D(0, 1, 0);
+                        QVector3D tangent = QVector3D::crossProduct(helper, normal).normalized();
+                        QVector3D bitangent = QVector3D::crossProduct(normal, tangent);
+                        float angle = texelAngle(x, y);
+                        float cosAngle = std::cos(angle), sinAngle = std::sin(angle);
+                        QVector3D rotatedT = tangent * cosAngle + bitangent * sinAngle;
+                        QVector3D rotatedB = bitangent * cosAngle - tangent * sinAngle;
+
+                        int hits = 0;
+                        for (int i = 0; i < MASK_AO_RAYS; i += 4) {
+                            QVector3D directions[4];
+                            for (int lane = 0; lane < 4; lane++) {
+                                const QVector3D& s = samples[i + lane];
+                                directions[lane] = rotatedT * s.x() + rotatedB * s.y() + normal * s.z();
+                            }
+                            int mask = bvh->occluded4(origin, directions, maxDistance);
+                            hits += (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+                        }
+                        tile.rays += MASK_AO_RAYS;
+                        value = (uchar)std::lround(255.0f * (1.0f - hits / (float)MASK_AO_RAYS));
+                    } else {
+                        float k = curvatureData[v0] * w0 + curvatureData[v1] * w1 + curvatureData[v2] * w2;
+                        value = (uchar)std::lround(255.0f * std::max(0.0f, std::min(1.0f, k)));
+                    }
+
+                    texelData[y * size + x] = value;
+                    coveredData[y * size + x] = 1;
+                    tile.texels++;
+                }
+            }
+        }
+    });
+
+    if (cancelled && *cancelled)
+        return QVector<uchar>();
+
+    dilate(texels, covered, size);
+
+    if (stats) {
+        stats->rays = 0;
+        stats->texels = 0;
+        foreach (const MaskTile& tile, tiles) {
+            stats->rays += tile.rays;
+            stats->texels += tile.texels;
+        }
+        stats->ms = timer.nsecsElapsed() / 1000000.0f;
+    }
+    return texels;
+}
+
+void MaskBaker::bake(Mesh *mesh, int type)
+{
+    GeometryStore::ensureHostGeometry(mesh);
+
+    MaskBakeInput input;
+    input.type = type;
+    input.size = mesh->textureSize();
+    input.vertices = mesh->_vertices;
+    input.uvs = mesh->_uvs;
+    int vertexCount = input.vertices.size() / 3;
+    input.uvStride = vertexCount > 0 ? input.uvs.size() / vertexCount : 0;
+    input.indices.resize(mesh->_triangleIndices.size());
+    for (int i = 0; i < input.indices.size(); i++) {
+        input.indices[i] = mesh->_triangleIndices[i];
+    }
+    if (type == MaskType::AMBIENT_OCCLUSION) {
+        input.bvh = MeshBVH::positionBVH(mesh);
+    }
+
+    if (_jobs.contains(mesh)) {
+        *_jobs[mesh] = true;
+    }
+    std::shared_ptr<std::atomic<bool> > cancelled(new std::atomic<bool>(false));
+    _jobs.insert(mesh, cancelled);
+
+    QFutureWatcher<MaskResult>* watcher = new QFutureWatcher<MaskResult>(this);
+    connect(watcher, &QFutureWatcher<MaskResult>::finished, this, [this, watcher, mesh, cancelled]() {
+        watcher->deleteLater();
+
+        // forgotten or replaced by a newer bake
+        if (_jobs.value(mesh) != cancelled)
+            return;
+        _jobs.remove(mesh);
+
+        _finished.append(watcher->result());
+        emit maskFinished(mesh);
+    });
+    watcher->setFuture(QtConcurrent::run([input, mesh, cancelled]() {
+        MaskResult result;
+        result.mesh = mesh;
+        result.type = input.type;
+        result.size = input.size;
+        result.texels = bakeMask(input, &result.stats, cancelled.get());
+        return result;
+    }));
+}
+
+void MaskBaker::update()
+{
+    if (_finished.isEmpty())
+        return;
+
+    QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+
+    foreach (const MaskResult& result, _finished) {
+        clearMask(result.mesh);
+
+        MaskTexture mask;
+        mask.type = result.type;
+        f->glGenTextures(1, &mask.texture);
+        f->glBindTexture(GL_TEXTURE_2D, mask.texture);
+        f->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        f->glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, result.size, result.size, 0, GL_RED, GL_UNSIGNED_BYTE, result.texels.constData());
+        f->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        _masks.insert(result.mesh, mask);
+
+        const MaskBakeStats& stats = result.stats;
+        QString name = result.type == MaskType::AMBIENT_OCCLUSION ? "occlusion" : "curvature";
+        QString line;
+        if (result.type == MaskType::AMBIENT_OCCLUSION) {
+            double raysPerSecond = stats.ms > 0 ? stats.rays / (stats.ms / 1000.0) : 0;
+            line = QString("%1 mask %2x%2, %3 Mrays/s, %4 rays in %5 ms on %6 threads")
+                    .arg(name).arg(result.size).arg(raysPerSecond / 1e6, 0, 'f', 2).arg(stats.rays)
+                    .arg(stats.ms, 0, 'f', 1).arg(QThreadPool::globalInstance()->maxThreadCount());
+        } else {
+            line = QString("%1 mask %2x%2, %3 texels in %4 ms on %5 threads")
+                    .arg(name).arg(result.size).arg(stats.texels).arg(stats.ms, 0, 'f', 1)
+                    .arg(QThreadPool::globalInstance()->maxThreadCount());
+        }
+        Profiler::setCounter("mask", line);
+    }
+    _finished.clear();
+}
+
+void MaskBaker::clearMask(Mesh *mesh)
+{
+    if (!_masks.contains(mesh))
+        return;
+
+    MaskTexture mask = _masks.take(mesh);
+    QOpenGLContext::currentContext()->functions()->glDeleteTextures(1, &mask.texture);
+}
+
+void MaskBaker::forgetMesh(Mesh *mesh)
+{
+    if (_jobs.contains(mesh)) {
+        *_jobs.take(mesh) = true;
+    }
+    for (int i = _finished.size() - 1; i >= 0; i--) {
+        if (_finished[i].mesh == mesh) {
+            _finished.removeAt(i);
+        }
+    }
+    clearMask(mesh);
+}
@@ -0,0 +1,116 @@
+#ifndef MASKBAKER_H
+#define MASKBAKER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include <QOpenGLFunctions>
+#include <atomic>
+#include <memory>
+
+#include "mesh.h"
+
+class MeshBVH;
+
+#define MASK_TILE_SIZE 32          // texels per side of a work item
+#define MASK_AO_RAYS 32            // per texel, a multiple of 4
+#define MASK_AO_DISTANCE 0.25f     // ray length as a fraction of the mesh diagonal
+#define MASK_AO_BIAS 0.0005f       // origin offset as a fraction of the mesh diagonal
+#define MASK_CURVATURE_SCALE 4.0f  // curvature times edge length mapped to full range
+#define MASK_DILATE_TEXELS 4       // padding around uv islands against seams
+
+namespace MaskType {
+    enum {
+        AMBIENT_OCCLUSION,
+        CURVATURE
+    };
+}
+
+// what a bake needs from the mesh, copied so the bake doesn't race mesh
+// edits or GeometryStore releasing the arrays
+struct MaskBakeInput
+{
+    int type = MaskType::AMBIENT_OCCLUSION;
+    int size = 0;
+    QVector<float> vertices;   // xyz
+    QVector<float> uvs;
+    int uvStride = 2;
+    QVector<quint32> indices;
+    std::shared_ptr<const MeshBVH> bvh; // over the positions, built by the bake when null
+};
+
+struct MaskBakeStats
+{
+    qint64 rays = 0;
+    qint64 texels = 0; // covered by a triangle
+    float ms = 0;
+};
+
+// bakes grayscale masks strokes can be multiplied with: ambient occlusion,
+// dark in cavities, and curvature, bright on convex edges and dark in
+// creases with 0.5 on flat areas.
+//
+// Triangles are rasterized in uv space on the CPU and the texture is cut
+// into tiles spread over the global thread pool. Occlusion casts cosine
+// weighted hemisphere rays from each texel, four at a time as a packet
+// through the mesh's MeshBVH over the positions. Curvature comes from
+// vertex adjacency and is interpolated across the triangles. Finished
+// masks are uploaded as single channel textures that bakes mix the baked
+// texels with, see GLView::applyBakeMask.
+class MaskBaker : public QObject
+{
+    Q_OBJECT
+public:
+    static MaskBaker* instance();
+
+    // starts baking on worker threads, replacing a bake in progress
+    void bake(Mesh* mesh, int type);
+    bool isBaking(Mesh* mesh) const { return _jobs.contains(mesh); }
+
+    // once per drawn frame with the shared GL context current, uploads
+    // finished masks
+    void update();
+
+    bool hasMask(Mesh* mesh) const { return _masks.contains(mesh); }
+    GLuint maskTexture(Mesh* mesh) const { return _masks.value(mesh).texture; }
+    int maskType(Mesh* mesh) const { return _masks.value(mesh).type; }
+
+    // with the shared GL context current
+    void clearMask(Mesh* mesh);
+    void forgetMesh(Mesh* mesh);
+
+    // the whole bake on the calling thread, tiles go to the global pool.
+    // Returns size * size texels in GL row order.
+    static QVector<uchar> bakeMask(const MaskBakeInput& input, MaskBakeStats* stats,
+                                   const std::atomic<bool>* cancelled = 0);
+
+signals:
+    // views redraw on this to show the new mask
+    void maskFinished(Mesh* mesh);
+
+private:
+    struct MaskResult
+    {
+        Mesh* mesh = 0;
+        int type = 0;
+        int size = 0;
+        QVector<uchar> texels;
+        MaskBakeStats stats;
+    };
+
+    struct MaskTexture
+    {
+        GLuint texture = 0;
+        int type = 0;
+    };
+
+    explicit MaskBaker(QObject *parent = 0);
+
+    // cancelled bakes keep running until their current tiles are done
+    QHash<Mesh*, std::shared_ptr<std::atomic<bool> > > _jobs;
+    QList<MaskResult> _finished;
+    QHash<Mesh*, MaskTexture> _masks;
+};
+
+#endif // MASKBAKER_H
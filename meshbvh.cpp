@@ -0,0 +1,681 @@
+#include "meshbvh.h"
+
+#include <QHash>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "project.h"
+
+namespace {
+    struct Bounds
+    {
+        float min[3];
+        float max[3];
+
+        Bounds()
+        {
+            min[0] = min[1] = min[2] = FLT_MAX;
+            max[0] = max[1] = max[2] = -FLT_MAX;
+        }
+
+        void grow(const float* p)
+        {
+            for (int i = 0; i < 3; i++) {
+                min[i] = std::min(min[i], p[i]);
+                max[i] = std::max(max[i], p[i]);
+            }
+        }
+
+        void grow(const Bounds& b)
+        {
+            for (int i = 0; i < 3; i++) {
+                min[i] = std::min(min[i], b.min[i]);
+                max[i] = std::max(max[i], b.max[i]);
+            }
+        }
+
+        float area() const
+        {
+            float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+            if (dx < 0)
+                return 0; // empty
+            return 2 * (dx * dy + dy * dz + dz * dx);
+        }
+    };
+
+    struct BuildInput
+    {
+        QVector<Bounds> triangleBounds;
+        QVector<float> centroids; // xyz per triangle
+        QVector<int> order;       // triangles, partitioned in place while building
+    };
+
+    struct BuildNode
+    {
+        Bounds bounds;
+        int first = 0;
+        int count = 0;
+        BuildNode* left = 0;
+        BuildNode* right = 0;
+    };
+
+    struct Bin
+    {
+        Bounds bounds;
+        int count = 0;
+    };
+
+    // returns the split position in order, or -1 to make a leaf
+    int splitSAH(BuildInput& input, int first, int count, const Bounds& bounds)
+    {
+        const int* order = input.order.constData() + first;
+        const float* centroids = input.centroids.constData();
+
+        Bounds centroidBounds;
+        for (int i = 0; i < count; i++) {
+            centroidBounds.grow(centroids + order[i] * 3);
+        }
+
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        int bestBin = 0;
+
+        for (int axis = 0; axis < 3; axis++) {
+            float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+            if (extent <= 0)
+                continue;
+
+            Bin bins[BVH_SAH_BINS];
+            float scale = BVH_SAH_BINS / extent;
+            for (int i = 0; i < count; i++) {
+                int tri = order[i];
+                int b = std::min(BVH_SAH_BINS - 1, (int)((centroids[tri * 3 + axis] - centroidBounds.min[axis]) * scale));
+                bins[b].count++;
+                bins[b].bounds.grow(input.triangleBounds[tri]);
+            }
+
+            // sweep from the right, then evaluate splits sweeping from the left
+            float rightArea[BVH_SAH_BINS];
+            int rightCount[BVH_SAH_BINS];
+            Bounds right;
+            int rightTotal = 0;
+            for (int b = BVH_SAH_BINS - 1; b > 0; b--) {
+                right.grow(bins[b].bounds);
+                rightTotal += bins[b].count;
+                rightArea[b] = right.area();
+                rightCount[b] = rightTotal;
+            }
+
+            Bounds left;
+            int leftTotal = 0;
+            for (int b = 0; b < BVH_SAH_BINS - 1; b++) {
+                left.grow(bins[b].bounds);
+                leftTotal += bins[b].count;
+                if (leftTotal == 0 || rightCount[b + 1] == 0)
+                    continue;
+                float cost = left.area() * leftTotal + rightArea[b + 1] * rightCount[b + 1];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+
+        // traversal costs about as much as testing one group of four
+        float leafCost = (count + 3) / 4;
+        float splitCost = 1 + bestCost / (4 * std::max(bounds.area(), 1e-20f));
+
+        if (bestAxis < 0) {
+            if (count <= BVH_MAX_LEAF_TRIANGLES)
+                return -1;
+            return first + count / 2; // coincident centroids, any split will do
+        }
+        if (count <= BVH_MAX_LEAF_TRIANGLES && leafCost <= splitCost)
+            return -1;
+
+        float extent = centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis];
+        float scale = BVH_SAH_BINS / extent;
+        float minimum = centroidBounds.min[bestAxis];
+        int* begin = input.order.data() + first;
+        int* middle = std::partition(begin, begin + count, [&](int tri) {
+            int b = std::min(BVH_SAH_BINS - 1, (int)((centroids[tri * 3 + bestAxis] - minimum) * scale));
+            return b <= bestBin;
+        });
+        return first + (int)(middle - begin);
+    }
+
+    BuildNode* buildNode(BuildInput& input, int first, int count, int depth)
+    {
+        BuildNode* node = new BuildNode();
+        node->first = first;
+        node->count = count;
+        for (int i = 0; i < count; i++) {
+            node->bounds.grow(input.triangleBounds[input.order[first + i]]);
+        }
+
+        // deeper trees would overflow the traversal stack
+        if (depth >= BVH_MAX_DEPTH)
+            return node;
+
+        int split = splitSAH(input, first, count, node->bounds);
+        if (split < 0)
+            return node;
+
+        // ranges don't overlap, so both halves can partition concurrently
+        int leftCount = split - first;
+        int rightCount = count - leftCount;
+        if (count >= BVH_PARALLEL_TRIANGLES) {
+            QFuture<BuildNode*> left = QtConcurrent::run([&input, first, leftCount, depth]() {
+                return buildNode(input, first, leftCount, depth + 1);
+            });
+            node->right = buildNode(input, split, rightCount, depth + 1);
+            node->left = left.result();
+        } else {
+            node->left = buildNode(input, first, leftCount, depth + 1);
+            node->right = buildNode(input, split, rightCount, depth + 1);
+        }
+        node->count = 0;
+        return node;
+    }
+
+    int flatten(BuildNode* node, QVector<BVHNode>& nodes)
+    {
+        int index = nodes.size();
+        nodes.append(BVHNode());
+        for (int i = 0; i < 3; i++) {
+            nodes[index].boundsMin[i] = node->bounds.min[i];
+            nodes[index].boundsMax[i] = node->bounds.max[i];
+        }
+
+        if (node->count > 0) {
+            nodes[index].rightOrFirst = node->first;
+            nodes[index].count = node->count;
+        } else {
+            flatten(node->left, nodes);
+            int right = flatten(node->right, nodes);
+            nodes[index].rightOrFirst = right;
+            nodes[index].count = 0;
+        }
+
+        delete node;
+        return index;
+    }
+
+    // entry distance of the ray into the node, FLT_MAX on a miss
+    inline float slab(const BVHNode& node, const float* origin, const float* inverse, float maxDistance)
+    {
+        float tmin = 0;
+        float tmax = maxDistance;
+        for (int i = 0; i < 3; i++) {
+            float t0 = (node.boundsMin[i] - origin[i]) * inverse[i];
+            float t1 = (node.boundsMax[i] - origin[i]) * inverse[i];
+            tmin = std::max(tmin, std::min(t0, t1));
+            tmax = std::min(tmax, std::max(t0, t1));
+        }
+        return tmin <= tmax ? tmin : FLT_MAX;
+    }
+
+    // four rays from one origin, lane i of each array belongs to ray i
+    struct RayPacket
+    {
+        float origin[3];
+        float direction[3][4];
+        float inverse[3][4];
+        float maxDistance;
+    };
+
+    // mask of the active rays entering the node
+    inline int packetSlab(const BVHNode& node, const RayPacket& packet, int active)
+    {
+#ifdef __SSE__
+        __m128 tmin = _mm_setzero_ps();
+        __m128 tmax = _mm_set1_ps(packet.maxDistance);
+        for (int i = 0; i < 3; i++) {
+            __m128 inverse = _mm_loadu_ps(packet.inverse[i]);
+            __m128 t0 = _mm_mul_ps(_mm_set1_ps(node.boundsMin[i] - packet.origin[i]), inverse);
+            __m128 t1 = _mm_mul_ps(_mm_set1_ps(node.boundsMax[i] - packet.origin[i]), inverse);
+            tmin = _mm_max_ps(tmin, _mm_min_ps(t0, t1));
+            tmax = _mm_min_ps(tmax, _mm_max_ps(t0, t1));
+        }
+        return _mm_movemask_ps(_mm_cmple_ps(tmin, tmax)) & active;
+#else
+        int hit = 0;
+        for (int lane = 0; lane < 4; lane++) {
+            if (!(active & (1 << lane)))
+                continue;
+            float inverse[3] = { packet.inverse[0][lane], packet.inverse[1][lane], packet.inverse[2][lane] };
+            if (slab(node, packet.origin, inverse, packet.maxDistance) != FLT_MAX)
+                hit |= 1 << lane;
+        }
+        return hit;
+#endif
+    }
+
+    // mask of the rays hitting one triangle, Moller-Trumbore double sided.
+    // The origin is shared so the terms without the direction are scalar.
+    inline int packetTriangle(const float* p0, const float* p1, const float* p2, const RayPacket& packet)
+    {
+        float v0[3], e1[3], e2[3];
+        for (int axis = 0; axis < 3; axis++) {
+            v0[axis] = p0[axis];
+            e1[axis] = p1[axis] - p0[axis];
+            e2[axis] = p2[axis] - p0[axis];
+        }
+        float s[3] = { packet.origin[0] - v0[0], packet.origin[1] - v0[1], packet.origin[2] - v0[2] };
+        float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+        float tq = e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2];
+
+#ifdef __SSE__
+        __m128 dx = _mm_loadu_ps(packet.direction[0]);
+        __m128 dy = _mm_loadu_ps(packet.direction[1]);
+        __m128 dz = _mm_loadu_ps(packet.direction[2]);
+
+        __m128 px = _mm_sub_ps(_mm_mul_ps(dy, _mm_set1_ps(e2[2])), _mm_mul_ps(dz, _mm_set1_ps(e2[1])));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(dz, _mm_set1_ps(e2[0])), _mm_mul_ps(dx, _mm_set1_ps(e2[2])));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, _mm_set1_ps(e2[1])), _mm_mul_ps(dy, _mm_set1_ps(e2[0])));
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(e1[0]), px), _mm_mul_ps(_mm_set1_ps(e1[1]), py)),
+                                _mm_mul_ps(_mm_set1_ps(e1[2]), pz));
+
+        __m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+        __m128 valid = _mm_cmpgt_ps(absDet, _mm_set1_ps(1e-12f));
+        __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+        __m128 uu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(s[0]), px), _mm_mul_ps(_mm_set1_ps(s[1]), py)),
+                                          _mm_mul_ps(_mm_set1_ps(s[2]), pz)), invDet);
+        __m128 vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_set1_ps(q[0])), _mm_mul_ps(dy, _mm_set1_ps(q[1]))),
+                                          _mm_mul_ps(dz, _mm_set1_ps(q[2]))), invDet);
+        __m128 tt = _mm_mul_ps(_mm_set1_ps(tq), invDet);
+
+        __m128 zero = _mm_setzero_ps();
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(uu, zero));
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(vv, zero));
+        valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(uu, vv), _mm_set1_ps(1.0f)));
+        valid = _mm_and_ps(valid, _mm_cmpgt_ps(tt, zero));
+        valid = _mm_and_ps(valid, _mm_cmplt_ps(tt, _mm_set1_ps(packet.maxDistance)));
+        return _mm_movemask_ps(valid);
+#else
+        int hit = 0;
+        for (int lane = 0; lane < 4; lane++) {
+            float d[3] = { packet.direction[0][lane], packet.direction[1][lane], packet.direction[2][lane] };
+            float px = d[1] * e2[2] - d[2] * e2[1];
+            float py = d[2] * e2[0] - d[0] * e2[2];
+            float pz = d[0] * e2[1] - d[1] * e2[0];
+            float det = e1[0] * px + e1[1] * py + e1[2] * pz;
+            if (std::fabs(det) <= 1e-12f)
+                continue;
+            float invDet = 1.0f / det;
+            float u = (s[0] * px + s[1] * py + s[2] * pz) * invDet;
+            float v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * invDet;
+            float t = tq * invDet;
+            if (u >= 0 && v >= 0 && u + v <= 1 && t > 0 && t < packet.maxDistance)
+                hit |= 1 << lane;
+        }
+        return hit;
+#endif
+    }
+
+    // shared with bakes still running on worker threads
+    struct MeshHierarchies
+    {
+        std::shared_ptr<const MeshBVH> positions;
+        std::shared_ptr<const MeshBVH> uvs;
+    };
+
+    QHash<Mesh*, MeshHierarchies> hierarchies;
+}
+
+MeshBVH* MeshBVH::build(const QVector<float> &vertices, int components, const QVector<quint32> &indices)
+{
+    MeshBVH* bvh = new MeshBVH();
+
+    int triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || components < 2)
+        return bvh;
+
+    BuildInput input;
+    input.triangleBounds.resize(triangleCount);
+    input.centroids.resize(triangleCount * 3);
+    input.order.resize(triangleCount);
+
+    const float* v = vertices.constData();
+    for (int tri = 0; tri < triangleCount; tri++) {
+        Bounds& bounds = input.triangleBounds[tri];
+        for (int corner = 0; corner < 3; corner++) {
+            const float* p = v + indices[tri * 3 + corner] * components;
+            float point[3] = { p[0], p[1], components > 2 ? p[2] : 0.0f };
+            bounds.grow(point);
+        }
+        for (int i = 0; i < 3; i++) {
+            input.centroids[tri * 3 + i] = (bounds.min[i] + bounds.max[i]) * 0.5f;
+        }
+        input.order[tri] = tri;
+    }
+
+    BuildNode* root = buildNode(input, 0, triangleCount, 0);
+    bvh->_nodes.reserve(triangleCount * 2 / BVH_MAX_LEAF_TRIANGLES + 1);
+    flatten(root, bvh->_nodes);
+    bvh->_nodes.squeeze();
+
+    // corners in leaf order so a leaf reads one contiguous run, and the
+    // mesh arrays aren't referenced after the build
+    bvh->_corners.resize(triangleCount * 9);
+    bvh->_triangleIds.resize(triangleCount);
+    float* corners = bvh->_corners.data();
+    for (int slot = 0; slot < triangleCount; slot++) {
+        int tri = input.order[slot];
+        for (int corner = 0; corner < 3; corner++) {
+            const float* p = v + indices[tri * 3 + corner] * components;
+            float* out = corners + slot * 9 + corner * 3;
+            out[0] = p[0];
+            out[1] = p[1];
+            out[2] = components > 2 ? p[2] : 0.0f;
+        }
+        bvh->_triangleIds[slot] = tri;
+    }
+
+    return bvh;
+}
+
+bool MeshBVH::intersect(QVector3D origin, QVector3D direction, MeshPick &pick, float maxDistance) const
+{
+    if (_nodes.isEmpty())
+        return false;
+
+    float o[3] = { origin.x(), origin.y(), origin.z() };
+    float d[3] = { direction.x(), direction.y(), direction.z() };
+    float inverse[3];
+    for (int i = 0; i < 3; i++) {
+        inverse[i] = 1.0f / (std::fabs(d[i]) > 1e-12f ? d[i] : (d[i] < 0 ? -1e-12f : 1e-12f));
+    }
+
+    const BVHNode* nodes = _nodes.constData();
+    const float* corners = _corners.constData();
+
+    float best = maxDistance;
+    int bestSlot = -1;
+    float bestU = 0, bestV = 0;
+
+    int stack[BVH_MAX_DEPTH + 1];
+    int stackSize = 0;
+    int current = 0;
+
+    if (slab(nodes[0], o, inverse, best) == FLT_MAX)
+        return false;
+
+    while (true) {
+        const BVHNode& node = nodes[current];
+
+        if (node.count > 0) {
+            // four triangles per pass, short groups repeat their last triangle
+            for (int base = 0; base < node.count; base += 4) {
+                float v0[3][4], e1[3][4], e2[3][4];
+                for (int lane = 0; lane < 4; lane++) {
+                    int slot = node.rightOrFirst + std::min(base + lane, node.count - 1);
+                    const float* p = corners + slot * 9;
+                    for (int axis = 0; axis < 3; axis++) {
+                        v0[axis][lane] = p[axis];
+                        e1[axis][lane] = p[3 + axis] - p[axis];
+                        e2[axis][lane] = p[6 + axis] - p[axis];
+                    }
+                }
+
+                float t[4], u[4], v[4];
+                int hitMask = 0;
+#ifdef __SSE__
+                // Moller-Trumbore, double sided
+                __m128 e1x = _mm_loadu_ps(e1[0]), e1y = _mm_loadu_ps(e1[1]), e1z = _mm_loadu_ps(e1[2]);
+                __m128 e2x = _mm_loadu_ps(e2[0]), e2y = _mm_loadu_ps(e2[1]), e2z = _mm_loadu_ps(e2[2]);
+                __m128 dx = _mm_set1_ps(d[0]), dy = _mm_set1_ps(d[1]), dz = _mm_set1_ps(d[2]);
+
+                __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+                __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+                __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+                __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+
+                __m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+                __m128 valid = _mm_cmpgt_ps(absDet, _mm_set1_ps(1e-12f));
+                __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+                __m128 sx = _mm_sub_ps(_mm_set1_ps(o[0]), _mm_loadu_ps(v0[0]));
+                __m128 sy = _mm_sub_ps(_mm_set1_ps(o[1]), _mm_loadu_ps(v0[1]));
+                __m128 sz = _mm_sub_ps(_mm_set1_ps(o[2]), _mm_loadu_ps(v0[2]));
+                __m128 uu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+                __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+                __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+                __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+                __m128 vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+                __m128 tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+                __m128 zero = _mm_setzero_ps();
+                valid = _mm_and_ps(valid, _mm_cmpge_ps(uu, zero));
+                valid = _mm_and_ps(valid, _mm_cmpge_ps(vv, zero));
+                valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(uu, vv), _mm_set1_ps(1.0f)));
+                valid = _mm_and_ps(valid, _mm_cmpgt_ps(tt, zero));
+                valid = _mm_and_ps(valid, _mm_cmplt_ps(tt, _mm_set1_ps(best)));
+
+                hitMask = _mm_movemask_ps(valid);
+                _mm_storeu_ps(t, tt);
+                _mm_storeu_ps(u, uu);
+                _mm_storeu_ps(v, vv);
+#else
+                for (int lane = 0; lane < 4; lane++) {
+                    float px = d[1] * e2[2][lane] - d[2] * e2[1][lane];
+                    float py = d[2] * e2[0][lane] - d[0] * e2[2][lane];
+                    float pz = d[0] * e2[1][lane] - d[1] * e2[0][lane];
+                    float det = e1[0][lane] * px + e1[1][lane] * py + e1[2][lane] * pz;
+                    if (std::fabs(det) <= 1e-12f)
+                        continue;
+                    float invDet = 1.0f / det;
+                    float sx = o[0] - v0[0][lane], sy = o[1] - v0[1][lane], sz = o[2] - v0[2][lane];
+                    u[lane] = (sx * px + sy * py + sz * pz) * invDet;
+                    float qx = sy * e1[2][lane] - sz * e1[1][lane];
+                    float qy = sz * e1[0][lane] - sx * e1[2][lane];
+                    float qz = sx * e1[1][lane] - sy * e1[0][lane];
+                    v[lane] = (d[0] * qx + d[1] * qy + d[2] * qz) * invDet;
+                    t[lane] = (e2[0][lane] * qx + e2[1][lane] * qy + e2[2][lane] * qz) * invDet;
+                    if (u[lane] >= 0 && v[lane] >= 0 && u[lane] + v[lane] <= 1 && t[lane] > 0 && t[lane] < best)
+                        hitMask |= 1 << lane;
+                }
+#endif
+                for (int lane = 0; lane < 4; lane++) {
+                    if ((hitMask & (1 << lane)) && t[lane] < best) {
+                        best = t[lane];
+                        bestSlot = node.rightOrFirst + std::min(base + lane, node.count - 1);
+                        bestU = u[lane];
+                        bestV = v[lane];
+                    }
+                }
+            }
+        } else {
+            // nearer child first, the other waits on the stack
+            int left = current + 1;
+            int right = node.rightOrFirst;
+            float leftT = slab(nodes[left], o, inverse, best);
+            float rightT = slab(nodes[right], o, inverse, best);
+
+            if (leftT != FLT_MAX && rightT != FLT_MAX) {
+                if (rightT < leftT)
+                    std::swap(left, right);
+                stack[stackSize++] = right;
+                current = left;
+                continue;
+            } else if (leftT != FLT_MAX) {
+                current = left;
+                continue;
+            } else if (rightT != FLT_MAX) {
+                current = right;
+                continue;
+            }
+        }
+
+        // pop, skipping nodes that are now behind the closest hit
+        bool found = false;
+        while (stackSize > 0) {
+            current = stack[--stackSize];
+            if (slab(nodes[current], o, inverse, best) != FLT_MAX) {
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            break;
+    }
+
+    if (bestSlot < 0)
+        return false;
+
+    const float* p = corners + bestSlot * 9;
+    QVector3D p0(p[0], p[1], p[2]), p1(p[3], p[4], p[5]), p2(p[6], p[7], p[8]);
+
+    QVector3D normal = QVector3D::crossProduct(p1 - p0, p2 - p0).normalized();
+    if (QVector3D::dotProduct(normal, direction) > 0) {
+        normal = -normal;
+    }
+
+    pick.triangle = _triangleIds[bestSlot];
+    pick.distance = best;
+    pick.position = origin + direction * best;
+    pick.normal = normal;
+    pick.barycentric = QVector2D(bestU, bestV);
+    return true;
+}
+
+int MeshBVH::occluded4(QVector3D origin, const QVector3D directions[4], float maxDistance) const
+{
+    if (_nodes.isEmpty())
+        return 0;
+
+    RayPacket packet;
+    packet.origin[0] = origin.x();
+    packet.origin[1] = origin.y();
+    packet.origin[2] = origin.z();
+    packet.maxDistance = maxDistance;
+    for (int lane = 0; lane < 4; lane++) {
+        for (int i = 0; i < 3; i++) {
+            float d = directions[lane][i];
+            packet.direction[i][lane] = d;
+            packet.inverse[i][lane] = 1.0f / (std::fabs(d) > 1e-12f ? d : (d < 0 ? -1e-12f : 1e-12f));
+        }
+    }
+
+    const BVHNode* nodes = _nodes.constData();
+    const float* corners = _corners.constData();
+
+    // rays leave the packet once they hit anything, the nodes on the
+    // stack remember which rays entered them
+    int occluded = 0;
+    int stack[BVH_MAX_DEPTH + 1];
+    int stackMasks[BVH_MAX_DEPTH + 1];
+    int stackSize = 0;
+    int current = 0;
+    int active = packetSlab(nodes[0], packet, 0xf);
+
+    while (active) {
+        const BVHNode& node = nodes[current];
+
+        if (node.count > 0) {
+            for (int i = 0; i < node.count && active; i++) {
+                int slot = node.rightOrFirst + i;
+                const float* p = corners + slot * 9;
+                int hit = packetTriangle(p, p + 3, p + 6, packet) & active;
+                occluded |= hit;
+                active &= ~hit;
+            }
+        } else {
+            int left = packetSlab(nodes[current + 1], packet, active);
+            int right = packetSlab(nodes[node.rightOrFirst], packet, active);
+
+            if (left && right) {
+                stack[stackSize] = node.rightOrFirst;
+                stackMasks[stackSize++] = right;
+                current = current + 1;
+                active = left;
+                continue;
+            } else if (left) {
+                current = current + 1;
+                active = left;
+                continue;
+            } else if (right) {
+                current = node.rightOrFirst;
+                active = right;
+                continue;
+            }
+        }
+
+        // pop, dropping rays that hit since the node was pushed
+        active = 0;
+        while (stackSize > 0 && !active) {
+            stackSize--;
+            current = stack[stackSize];
+            active = stackMasks[stackSize] & ~occluded;
+        }
+    }
+
+    return occluded;
+}
+
+qint64 MeshBVH::bytes() const
+{
+    return _nodes.size() * sizeof(BVHNode) + _corners.size() * sizeof(float) + _triangleIds.size() * sizeof(qint32);
+}
+
+void MeshBVH::setMeshBVH(Mesh *mesh, MeshBVH *positions, MeshBVH *uvs)
+{
+    forgetMesh(mesh);
+
+    MeshHierarchies& entry = hierarchies[mesh];
+    entry.positions.reset(positions);
+    entry.uvs.reset(uvs);
+}
+
+const MeshBVH* MeshBVH::meshBVH(Mesh *mesh, MeshPropType space)
+{
+    if (!hierarchies.contains(mesh))
+        return 0;
+
+    const MeshHierarchies& entry = hierarchies[mesh];
+    return space == MeshPropType::UV ? entry.uvs.get() : entry.positions.get();
+}
+
+std::shared_ptr<const MeshBVH> MeshBVH::positionBVH(Mesh *mesh)
+{
+    return hierarchies.value(mesh).positions;
+}
+
+void MeshBVH::forgetMesh(Mesh *mesh)
+{
+    if (!hierarchies.contains(mesh))
+        return;
+
+    // deleted once no bake holds them anymore
+    hierarchies.remove(mesh);
+}
+
+bool MeshBVH::pick(QVector3D origin, QVector3D direction, MeshPropType space, MeshPick &pick)
+{
+    Project* project = Project::activeProject();
+    direction.normalize();
+
+    bool hit = false;
+    float best = FLT_MAX;
+    foreach (Mesh* mesh, project->meshes()) {
+        if (!project->meshVisible(mesh))
+            continue;
+
+        // meshes still being imported have no hierarchy yet
+        const MeshBVH* bvh = meshBVH(mesh, space);
+        if (bvh && bvh->intersect(origin, direction, pick, best)) {
+            pick.mesh = mesh;
+            best = pick.distance;
+            hit = true;
+        }
+    }
+    return hit;
+}
@@ -0,0 +1,80 @@
+#ifndef MESHBVH_H
+#define MESHBVH_H
+
+#include <QVector>
+#include <QVector2D>
+#include <QVector3D>
+#include <cfloat>
+#include <memory>
+
+#include "mesh.h"
+#include "constants.h"
+
+#define BVH_SAH_BINS 12
+#define BVH_MAX_LEAF_TRIANGLES 8
+#define BVH_MAX_DEPTH 64
+#define BVH_PARALLEL_TRIANGLES 16384 // subtrees at least this big build on their own thread
+
+// flattened depth first, the left child of an interior node directly
+// follows it. 32 bytes so two nodes share a cache line.
+struct BVHNode
+{
+    float boundsMin[3];
+    qint32 rightOrFirst; // right child index, or first triangle of a leaf
+    float boundsMax[3];
+    qint32 count;        // triangles in a leaf, 0 for interior nodes
+};
+
+struct MeshPick
+{
+    Mesh* mesh = 0;
+    int triangle = -1;     // index into the mesh's triangles
+    float distance = 0;    // along the normalized ray
+    QVector3D position;
+    QVector3D normal;      // geometric, facing the ray origin
+    QVector2D barycentric; // weights of the second and third vertex
+};
+
+// triangle bounding volume hierarchy for picking on the CPU. Built with a
+// binned surface area heuristic, subtrees build in parallel. Triangles are
+// tested four at a time with SSE, or four rays at a time for ray packets.
+//
+// Leaves hold their own copy of the triangle corners, nine floats per
+// triangle, so the hierarchy doesn't keep the mesh arrays alive when
+// GeometryStore releases them.
+class MeshBVH
+{
+public:
+    // components is the stride of vertices, 2 for uvs (z taken as 0)
+    static MeshBVH* build(const QVector<float>& vertices, int components, const QVector<quint32>& indices);
+
+    // closest hit nearer than maxDistance, direction must be normalized
+    bool intersect(QVector3D origin, QVector3D direction, MeshPick& pick, float maxDistance = FLT_MAX) const;
+
+    // any hit test for a packet of four rays leaving one point, traversed
+    // together. Returns a mask with bit i set when ray i hits a triangle
+    // nearer than maxDistance.
+    int occluded4(QVector3D origin, const QVector3D directions[4], float maxDistance) const;
+
+    int nodeCount() const { return _nodes.size(); }
+    qint64 bytes() const;
+
+    // per mesh hierarchies over positions and uvs, set by MeshProcessor
+    static void setMeshBVH(Mesh* mesh, MeshBVH* positions, MeshBVH* uvs);
+    static const MeshBVH* meshBVH(Mesh* mesh, MeshPropType space);
+    // for worker threads, stays valid after the mesh is forgotten
+    static std::shared_ptr<const MeshBVH> positionBVH(Mesh* mesh);
+    static void forgetMesh(Mesh* mesh);
+
+    // closest visible mesh along the ray, in object space
+    static bool pick(QVector3D origin, QVector3D direction, MeshPropType space, MeshPick& pick);
+
+private:
+    MeshBVH() {}
+
+    QVector<BVHNode> _nodes;
+    QVector<float> _corners;      // three xyz corners per triangle, in leaf order
+    QVector<qint32> _triangleIds; // original triangle of each leaf slot
+};
+
+#endif // MESHBVH_H
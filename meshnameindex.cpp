@@ -0,0 +1,207 @@
+#include "meshnameindex.h"
+
+#include <QStringList>
+#include <algorithm>
+
+#include "project.h"
+
+#define NAME_INDEX_GRAM 3 // longest indexed run of characters
+
+namespace {
+    // length in the top bits keeps "a", "a\0" and "a\0\0" apart
+    quint64 gramKey(const QChar* text, int length)
+    {
+        quint64 key = length;
+        for (int i = 0; i < length; i++) {
+            key = (key << 16) | text[i].unicode();
+        }
+        return key;
+    }
+
+    QVector<quint64> nameGrams(const QString& name)
+    {
+        QVector<quint64> grams;
+        for (int length = 1; length <= NAME_INDEX_GRAM; length++) {
+            for (int i = 0; i + length <= name.size(); i++) {
+                grams.append(gramKey(name.constData() + i, length));
+            }
+        }
+        std::sort(grams.begin(), grams.end());
+        grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+        return grams;
+    }
+
+    bool globMatch(const QString& name, const QString& pattern)
+    {
+        int i = 0, j = 0;
+        int star = -1, resume = 0;
+        while (i < name.size()) {
+            if (j < pattern.size() && pattern[j] == '*') {
+                star = j++;
+                resume = i;
+            } else if (j < pattern.size() && (pattern[j] == '?' || pattern[j] == name[i])) {
+                i++;
+                j++;
+            } else if (star >= 0) {
+                // let the last star swallow one more character
+                j = star + 1;
+                i = ++resume;
+            } else {
+                return false;
+            }
+        }
+        while (j < pattern.size() && pattern[j] == '*') {
+            j++;
+        }
+        return j == pattern.size();
+    }
+}
+
+MeshNameIndex::MeshNameIndex(QObject *parent) : QObject(parent)
+{
+    connect(Project::activeProject(), SIGNAL(meshAdded()), this, SLOT(onMeshAdded()));
+    connect(Project::activeProject(), SIGNAL(meshesRemoved(QList<Mesh*>)), this, SLOT(onMeshesRemoved(QList<Mesh*>)));
+
+    foreach (Mesh* mesh, Project::activeProject()->meshes()) {
+        addMesh(mesh);
+    }
+}
+
+MeshNameIndex* MeshNameIndex::instance()
+{
+    static MeshNameIndex* index = new MeshNameIndex();
+    return index;
+}
+
+void MeshNameIndex::indexName(int slot, bool insert)
+{
+    foreach (quint64 gram, nameGrams(_entries[slot].name)) {
+        QVector<int>& slots = _postings[gram];
+        QVector<int>::iterator it = std::lower_bound(slots.begin(), slots.end(), slot);
+        if (insert) {
+            slots.insert(it, slot); // new slots mostly land at the end
+        } else if (it != slots.end() && *it == slot) {
+            slots.erase(it);
+            if (slots.isEmpty()) {
+                _postings.remove(gram);
+            }
+        }
+    }
+}
+
+void MeshNameIndex::addMesh(Mesh *mesh)
+{
+    if (_slots.contains(mesh))
+        return;
+
+    int slot;
+    if (_freeSlots.isEmpty()) {
+        slot = _entries.size();
+        _entries.append(Entry());
+    } else {
+        slot = _freeSlots.takeLast();
+    }
+
+    _entries[slot].mesh = mesh;
+    _entries[slot].name = mesh->meshName().toLower();
+    _slots.insert(mesh, slot);
+    indexName(slot, true);
+}
+
+void MeshNameIndex::removeMesh(Mesh *mesh)
+{
+    if (!_slots.contains(mesh))
+        return;
+
+    int slot = _slots.take(mesh);
+    indexName(slot, false);
+    _entries[slot] = Entry();
+    _freeSlots.append(slot);
+}
+
+void MeshNameIndex::renameMesh(Mesh *mesh)
+{
+    if (!_slots.contains(mesh))
+        return;
+
+    int slot = _slots[mesh];
+    QString name = mesh->meshName().toLower();
+    if (name == _entries[slot].name)
+        return;
+
+    indexName(slot, false);
+    _entries[slot].name = name;
+    indexName(slot, true);
+    emit namesChanged();
+}
+
+void MeshNameIndex::onMeshAdded()
+{
+    // meshes are appended, walk back to the first one already indexed
+    QVector<Mesh*> meshes = Project::activeProject()->meshes();
+    for (int i = meshes.size() - 1; i >= 0 && !_slots.contains(meshes[i]); i--) {
+        addMesh(meshes[i]);
+    }
+    emit namesChanged();
+}
+
+void MeshNameIndex::onMeshesRemoved(QList<Mesh *> removed)
+{
+    foreach (Mesh* mesh, removed) {
+        removeMesh(mesh);
+    }
+    emit namesChanged();
+}
+
+bool MeshNameIndex::matches(const QString &name, const QString &pattern, bool glob) const
+{
+    return glob ? globMatch(name, pattern) : name.contains(pattern);
+}
+
+QVector<Mesh*> MeshNameIndex::query(QString pattern) const
+{
+    QString lowered = pattern.toLower();
+    bool glob = lowered.contains('*') || lowered.contains('?');
+
+    // every literal run of the pattern has to be in a matching name
+    QString literalText = lowered;
+    literalText.replace('?', '*');
+    QStringList literals = literalText.split('*', QString::SkipEmptyParts);
+
+    QVector<const QVector<int>*> lists;
+    foreach (QString literal, literals) {
+        int length = std::min(literal.size(), NAME_INDEX_GRAM);
+        for (int i = 0; i + length <= literal.size(); i++) {
+            QHash<quint64, QVector<int> >::const_iterator it = _postings.constFind(gramKey(literal.constData() + i, length));
+            if (it == _postings.constEnd())
+                return QVector<Mesh*>();
+            lists.append(&it.value());
+        }
+    }
+
+    QVector<Mesh*> result;
+    if (lists.isEmpty()) {
+        foreach (const Entry& entry, _entries) {
+            if (entry.mesh && (!glob || globMatch(entry.name, lowered))) {
+                result.append(entry.mesh);
+            }
+        }
+        return result;
+    }
+
+    std::sort(lists.begin(), lists.end(),
+              [](const QVector<int>* a, const QVector<int>* b) { return a->size() < b->size(); });
+
+    // a substring no longer than a gram is exactly its list
+    bool exact = !glob && lowered.size() <= NAME_INDEX_GRAM;
+    foreach (int slot, *lists.first()) {
+        bool inAll = true;
+        for (int i = 1; i < lists.size() && inAll; i++) {
+            inAll = std::binary_search(lists[i]->begin(), lists[i]->end(), slot);
+        }
+        if (inAll && (exact || matches(_entries[slot].name, lowered, glob))) {
+            result.append(_entries[slot].mesh);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,58 @@
+#ifndef MESHNAMEINDEX_H
+#define MESHNAMEINDEX_H
+
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <QString>
+
+#include "mesh.h"
+
+// n-gram index over the lower-cased names of the active project's meshes.
+// Every distinct 1, 2 and 3 character run of a name has a sorted list of
+// the meshes containing it, so a query intersects a few lists, starting
+// with the shortest, and only checks the names that survive. Meshes are
+// indexed as they are added and removed; renames go through renameMesh.
+class MeshNameIndex : public QObject
+{
+    Q_OBJECT
+public:
+    static MeshNameIndex* instance();
+
+    // after mesh->setMeshName
+    void renameMesh(Mesh* mesh);
+
+    // case insensitive. A pattern with * or ? is a glob over the whole
+    // name, anything else matches as a substring. Empty matches everything.
+    QVector<Mesh*> query(QString pattern) const;
+
+    int meshCount() const { return _slots.size(); }
+
+signals:
+    void namesChanged();
+
+private slots:
+    void onMeshAdded();
+    void onMeshesRemoved(QList<Mesh*> removed);
+
+private:
+    struct Entry
+    {
+        Mesh* mesh = 0; // 0 for a free slot
+        QString name;   // lower-cased
+    };
+
+    explicit MeshNameIndex(QObject *parent = 0);
+
+    void addMesh(Mesh* mesh);
+    void removeMesh(Mesh* mesh);
+    void indexName(int slot, bool insert);
+    bool matches(const QString& name, const QString& pattern, bool glob) const;
+
+    QVector<Entry> _entries; // by slot
+    QVector<int> _freeSlots;
+    QHash<Mesh*, int> _slots;
+    QHash<quint64, QVector<int> > _postings; // gram -> sorted slots
+};
+
+#endif // MESHNAMEINDEX_H
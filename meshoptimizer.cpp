@@ -0,0 +1,152 @@
+#include "meshoptimizer.h"
+
+QVector<quint32> MeshOptimizer::optimizeVertexCache(const QVector<quint32> &indices, int vertexCount, int cacheSize)
+{
+    const int triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || vertexCount == 0)
+        return indices;
+
+    // vertex -> triangle adjacency in CSR form
+    QVector<int> liveTriangles(vertexCount, 0);
+    for (int i = 0; i < triangleCount * 3; i++) {
+        liveTriangles[indices[i]]++;
+    }
+
+    QVector<int> adjacencyOffset(vertexCount + 1, 0);
+    for (int v = 0; v < vertexCount; v++) {
+        adjacencyOffset[v+1] = adjacencyOffset[v] + liveTriangles[v];
+    }
+
+    QVector<int> adjacency(adjacencyOffset[vertexCount]);
+    QVector<int> fill = adjacencyOffset;
+    for (int t = 0; t < triangleCount; t++) {
+        for (int c = 0; c < 3; c++) {
+            adjacency[fill[indices[t*3+c]]++] = t;
+        }
+    }
+
+    QVector<int> cacheTime(vertexCount, 0);
+    QVector<bool> emitted(triangleCount, false);
+    QVector<int> deadEnds;
+    QVector<int> candidates;
+
+    QVector<quint32> output;
+    output.reserve(triangleCount * 3);
+
+    int fanning = 0;
+    int time = cacheSize + 1;
+    int cursor = 1;
+
+    auto skipDeadEnd = [&]() -> int {
+        while (!deadEnds.isEmpty()) {
+            int d = deadEnds.takeLast();
+            if (liveTriangles[d] > 0)
+                return d;
+        }
+        while (cursor < vertexCount) {
+            if (liveTriangles[cursor] > 0)
+                return cursor;
+            cursor++;
+        }
+        return -1;
+    };
+
+    while (fanning >= 0) {
+        candidates.clear();
+
+        // emit every remaining triangle around the fanning vertex
+        for (int a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning+1]; a++) {
+            int t = adjacency[a];
+            if (emitted[t])
+                continue;
+
+            for (int c = 0; c < 3; c++) {
+                quint32 v = indices[t*3+c];
+                output.append(v);
+                deadEnds.append(v);
+                candidates.append(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = time;
+                    time++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // prefer the candidate still in cache with the most work left
+        int next = -1;
+        int bestPriority = -1;
+        foreach (int v, candidates) {
+            if (liveTriangles[v] <= 0)
+                continue;
+
+            int priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+                priority = time - cacheTime[v];
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+
+        fanning = next >= 0 ? next : skipDeadEnd();
+    }
+
+    return output;
+}
+
+QVector<int> MeshOptimizer::optimizeVertexFetch(QVector<quint32> &indices, int vertexCount)
+{
+    QVector<int> remap(vertexCount, -1);
+    int next = 0;
+
+    for (int i = 0; i < indices.size(); i++) {
+        quint32 v = indices[i];
+        if (remap[v] < 0) {
+            remap[v] = next++;
+        }
+        indices[i] = remap[v];
+    }
+
+    // keep unreferenced vertices at the end so attribute arrays stay whole
+    for (int v = 0; v < vertexCount; v++) {
+        if (remap[v] < 0) {
+            remap[v] = next++;
+        }
+    }
+
+    return remap;
+}
+
+QVector<float> MeshOptimizer::remapAttribute(const QVector<float> &attribute, const QVector<int> &remap, int components)
+{
+    QVector<float> out(attribute.size());
+    for (int v = 0; v < remap.size(); v++) {
+        for (int c = 0; c < components; c++) {
+            out[remap[v]*components + c] = attribute[v*components + c];
+        }
+    }
+    return out;
+}
+
+float MeshOptimizer::acmr(const QVector<quint32> &indices, int vertexCount, int cacheSize)
+{
+    const int triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return 0;
+
+    // FIFO cache simulated with insertion timestamps
+    QVector<int> insertedAt(vertexCount, -cacheSize - 1);
+    int misses = 0;
+    for (int i = 0; i < triangleCount * 3; i++) {
+        quint32 v = indices[i];
+        if (misses - insertedAt[v] > cacheSize - 1) {
+            insertedAt[v] = misses;
+            misses++;
+        }
+    }
+
+    return misses / (float)triangleCount;
+}
@@ -0,0 +1,30 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <QVector>
+
+#define VERTEX_CACHE_SIZE 16
+
+// index buffer optimizations that work on plain arrays so they can run on
+// worker threads without touching the Mesh
+class MeshOptimizer
+{
+public:
+    // reorders triangles for post-transform vertex cache locality using
+    // Tipsify (Sander et al. 2007)
+    static QVector<quint32> optimizeVertexCache(const QVector<quint32>& indices, int vertexCount, int cacheSize = VERTEX_CACHE_SIZE);
+
+    // renumbers vertices in the order they are first fetched. Rewrites
+    // indices in place and returns the new position of each old vertex.
+    static QVector<int> optimizeVertexFetch(QVector<quint32>& indices, int vertexCount);
+
+    // moves per-vertex attributes with the given number of components to
+    // the positions returned by optimizeVertexFetch
+    static QVector<float> remapAttribute(const QVector<float>& attribute, const QVector<int>& remap, int components);
+
+    // average cache miss ratio (transformed vertices per triangle) of a
+    // FIFO cache
+    static float acmr(const QVector<quint32>& indices, int vertexCount, int cacheSize = VERTEX_CACHE_SIZE);
+};
+
+#endif // MESHOPTIMIZER_H
@@ -0,0 +1,139 @@
+#include "meshprocessor.h"
+
+#include <QtConcurrent>
+#include <QElapsedTimer>
+
+#include "project.h"
+#include "meshoptimizer.h"
+#include "meshsimplifier.h"
+#include "geometrycache.h"
+#include "geometrystore.h"
+#include "meshbvh.h"
+#include "profiler.h"
+
+#define LOD_LEVELS 3
+
+MeshProcessor::MeshProcessor(QObject *parent) : QObject(parent)
+{
+}
+
+MeshProcessor* MeshProcessor::instance()
+{
+    static MeshProcessor* processor = new MeshProcessor();
+    return processor;
+}
+
+void MeshProcessor::process(Mesh *mesh)
+{
+    if (_pending.contains(mesh))
+        return;
+
+    GeometryStore::ensureHostGeometry(mesh);
+
+    // the worker only sees copies, so the mesh stays drawable meanwhile
+    MeshProcessingJob* job = new MeshProcessingJob();
+    job->mesh = mesh;
+    job->name = mesh->meshName();
+    job->vertices = mesh->_vertices;
+    job->uvs = mesh->_uvs;
+    job->vertexCount = mesh->_vertices.size() / 3;
+    job->uvComponents = job->vertexCount > 0 ? mesh->_uvs.size() / job->vertexCount : 0;
+    job->indices.resize(mesh->_triangleIndices.size());
+    for (int i = 0; i < mesh->_triangleIndices.size(); i++) {
+        job->indices[i] = mesh->_triangleIndices[i];
+    }
+
+    _pending.append(mesh);
+
+    QFutureWatcher<MeshProcessingJob*>* watcher = new QFutureWatcher<MeshProcessingJob*>(this);
+    connect(watcher, SIGNAL(finished()), this, SLOT(onJobFinished()));
+    watcher->setFuture(QtConcurrent::run(&MeshProcessor::runJob, job));
+}
+
+bool MeshProcessor::isProcessing(Mesh *mesh) const
+{
+    return _pending.contains(mesh);
+}
+
+MeshProcessingJob* MeshProcessor::runJob(MeshProcessingJob *job)
+{
+    // vertex cache order, then vertices renumbered to match fetch order
+    job->acmrBefore = MeshOptimizer::acmr(job->indices, job->vertexCount);
+    job->indices = MeshOptimizer::optimizeVertexCache(job->indices, job->vertexCount);
+
+    // islands become contiguous triangle runs, fetch order then follows them
+    job->islands = UVIslands::build(job->indices, job->uvs, job->uvComponents);
+
+    QVector<int> remap = MeshOptimizer::optimizeVertexFetch(job->indices, job->vertexCount);
+    job->vertices = MeshOptimizer::remapAttribute(job->vertices, remap, 3);
+    job->uvs = MeshOptimizer::remapAttribute(job->uvs, remap, job->uvComponents);
+    job->acmrAfter = MeshOptimizer::acmr(job->indices, job->vertexCount);
+
+    // each level halves the previous one, simplifying from the last level
+    // keeps the chain cheap to build
+    QVector<quint32> lod = job->indices;
+    for (int level = 0; level < LOD_LEVELS; level++) {
+        int target = lod.size() / 3 / 2;
+        QVector<quint32> simplified = MeshSimplifier::simplify(job->vertices, lod, target);
+        if (simplified.size() >= lod.size() * 0.9f)
+            break; // locked seams stop the chain early
+        lod = MeshOptimizer::optimizeVertexCache(simplified, job->vertexCount);
+        job->lods.append(lod);
+    }
+
+    // the uv hierarchy builds alongside, only views in uv space pick with it
+    QElapsedTimer bvhTimer;
+    bvhTimer.start();
+    QFuture<MeshBVH*> uvBVH;
+    if (job->uvComponents >= 2) {
+        uvBVH = QtConcurrent::run(&MeshBVH::build, job->uvs, job->uvComponents, job->indices);
+    }
+    job->positionBVH = MeshBVH::build(job->vertices, 3, job->indices);
+    if (job->uvComponents >= 2) {
+        job->uvBVH = uvBVH.result();
+    }
+    job->bvhMs = bvhTimer.elapsed();
+
+    return job;
+}
+
+void MeshProcessor::onJobFinished()
+{
+    QFutureWatcher<MeshProcessingJob*>* watcher = static_cast<QFutureWatcher<MeshProcessingJob*>*>(sender());
+    MeshProcessingJob* job = watcher->result();
+    watcher->deleteLater();
+
+    _pending.removeAll(job->mesh);
+
+    // the mesh may have been removed while the job ran
+    if (Project::activeProject()->meshes().contains(job->mesh)) {
+        applyJob(job);
+    } else {
+        delete job->positionBVH;
+        delete job->uvBVH;
+    }
+
+    delete job;
+}
+
+void MeshProcessor::applyJob(MeshProcessingJob *job)
+{
+    Mesh* mesh = job->mesh;
+
+    mesh->_vertices = job->vertices;
+    mesh->_uvs = job->uvs;
+    for (int i = 0; i < job->indices.size(); i++) {
+        mesh->_triangleIndices[i] = job->indices[i];
+    }
+
+    GeometryCache::setMeshLods(mesh, job->lods);
+    GeometryStore::invalidate(mesh);
+    MeshBVH::setMeshBVH(mesh, job->positionBVH, job->uvBVH);
+    UVIslands::setMeshIslands(mesh, job->islands);
+
+    Profiler::setCounter("mesh processing", QString("%1: ACMR %2 -> %3, %4 LODs, %5 islands, BVH in %6 ms")
+                         .arg(job->name).arg(job->acmrBefore, 0, 'f', 2).arg(job->acmrAfter, 0, 'f', 2)
+                         .arg(job->lods.size()).arg(job->islands.size()).arg(job->bvhMs));
+
+    emit meshProcessed(mesh);
+}
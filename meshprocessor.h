@@ -0,0 +1,67 @@
+#ifndef MESHPROCESSOR_H
+#define MESHPROCESSOR_H
+
+#include <QObject>
+#include <QVector>
+#include <QFutureWatcher>
+
+#include "mesh.h"
+#include "uvislands.h"
+
+class MeshBVH;
+
+// copy of a mesh's arrays processed on a worker thread and written back on
+// the main thread once every stage has run
+struct MeshProcessingJob
+{
+    Mesh* mesh = 0;
+    QString name;
+
+    QVector<float> vertices;
+    QVector<float> uvs;
+    QVector<quint32> indices;
+    int vertexCount = 0;
+    int uvComponents = 0;
+
+    float acmrBefore = 0;
+    float acmrAfter = 0;
+    qint64 bvhMs = 0;
+
+    // uv islands, each a contiguous run of triangles in indices
+    QVector<UVIsland> islands;
+
+    // simplified index buffers for the perspective preview, coarsest last
+    QVector<QVector<quint32> > lods;
+
+    // picking hierarchies over the final arrays
+    MeshBVH* positionBVH = 0;
+    MeshBVH* uvBVH = 0;
+};
+
+// runs the one-time import stages for newly added meshes off the GUI thread
+class MeshProcessor : public QObject
+{
+    Q_OBJECT
+public:
+    static MeshProcessor* instance();
+
+    void process(Mesh* mesh);
+    bool isProcessing(Mesh* mesh) const;
+
+signals:
+    // mesh arrays were replaced, GPU copies need to be rebuilt
+    void meshProcessed(Mesh* mesh);
+
+private slots:
+    void onJobFinished();
+
+private:
+    explicit MeshProcessor(QObject *parent = 0);
+
+    static MeshProcessingJob* runJob(MeshProcessingJob* job);
+    void applyJob(MeshProcessingJob* job);
+
+    QList<Mesh*> _pending;
+};
+
+#endif // MESHPROCESSOR_H
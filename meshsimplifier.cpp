@@ -0,0 +1,234 @@
+#include "meshsimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+namespace {
+    // symmetric 4x4 matrix of a sum of squared plane distances
+    struct Quadric
+    {
+        double q[10] = {0,0,0,0,0,0,0,0,0,0};
+
+        void addPlane(double a, double b, double c, double d, double weight)
+        {
+            q[0] += weight*a*a; q[1] += weight*a*b; q[2] += weight*a*c; q[3] += weight*a*d;
+            q[4] += weight*b*b; q[5] += weight*b*c; q[6] += weight*b*d;
+            q[7] += weight*c*c; q[8] += weight*c*d;
+            q[9] += weight*d*d;
+        }
+
+        void add(const Quadric& o)
+        {
+            for (int i = 0; i < 10; i++)
+                q[i] += o.q[i];
+        }
+
+        double error(double x, double y, double z) const
+        {
+            return q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x
+                 + q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y
+                 + q[7]*z*z + 2*q[8]*z
+                 + q[9];
+        }
+    };
+
+    // queued with the versions of both vertices, a collapse is stale once
+    // either vertex changed after it was queued
+    struct Collapse
+    {
+        double cost;
+        quint32 from;
+        quint32 to;
+        quint32 fromVersion;
+        quint32 toVersion;
+
+        // cheapest on top of a std::priority_queue
+        bool operator<(const Collapse& o) const { return cost > o.cost; }
+    };
+
+    void triangleNormal(const float* a, const float* b, const float* c, double* n)
+    {
+        double e1[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+        double e2[3] = { c[0]-a[0], c[1]-a[1], c[2]-a[2] };
+        n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+        n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+        n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+    }
+}
+
+QVector<quint32> MeshSimplifier::simplify(const QVector<float> &positions, const QVector<quint32> &indices, int targetTriangles)
+{
+    const int vertexCount = positions.size() / 3;
+    const float* p = positions.constData();
+
+    QVector<quint32> tris = indices;
+    if (tris.size() / 3 <= targetTriangles)
+        return tris;
+
+    // area weighted plane quadrics
+    QVector<Quadric> quadrics(vertexCount);
+    for (int t = 0; t < tris.size() / 3; t++) {
+        quint32 v[3] = { tris[t*3], tris[t*3+1], tris[t*3+2] };
+        double n[3];
+        triangleNormal(p + v[0]*3, p + v[1]*3, p + v[2]*3, n);
+        double length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        if (length == 0)
+            continue;
+        n[0] /= length; n[1] /= length; n[2] /= length;
+        double d = -(n[0]*p[v[0]*3] + n[1]*p[v[0]*3+1] + n[2]*p[v[0]*3+2]);
+        for (int c = 0; c < 3; c++) {
+            quadrics[v[c]].addPlane(n[0], n[1], n[2], d, length * 0.5);
+        }
+    }
+
+    QVector<bool> locked(vertexCount, false);
+
+    // uv seams: several vertices share one position
+    QVector<int> byPosition(vertexCount);
+    for (int v = 0; v < vertexCount; v++)
+        byPosition[v] = v;
+    auto positionLess = [p](int a, int b) {
+        return std::lexicographical_compare(p + a*3, p + a*3 + 3, p + b*3, p + b*3 + 3);
+    };
+    std::sort(byPosition.begin(), byPosition.end(), positionLess);
+    for (int i = 1; i < vertexCount; i++) {
+        int a = byPosition[i-1], b = byPosition[i];
+        if (!positionLess(a, b) && !positionLess(b, a)) {
+            locked[a] = locked[b] = true;
+        }
+    }
+
+    // open boundaries: edges used by a single triangle
+    QVector<quint64> edges;
+    edges.reserve(tris.size());
+    for (int i = 0; i < tris.size(); i += 3) {
+        for (int c = 0; c < 3; c++) {
+            quint64 a = tris[i+c], b = tris[i+(c+1)%3];
+            edges.append(a < b ? (a << 32 | b) : (b << 32 | a));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    for (int i = 0; i < edges.size(); ) {
+        int j = i;
+        while (j < edges.size() && edges[j] == edges[i])
+            j++;
+        if (j - i == 1) {
+            locked[edges[i] >> 32] = locked[edges[i] & 0xffffffff] = true;
+        }
+        i = j;
+    }
+
+    // vertex -> triangle adjacency, collapses move triangles to the kept vertex
+    const int triangleCount = tris.size() / 3;
+    QVector<QVector<int> > vertexTriangles(vertexCount);
+    for (int i = 0; i < tris.size(); i++)
+        vertexTriangles[tris[i]].append(i / 3);
+    QVector<bool> triangleAlive(triangleCount, true);
+    QVector<quint32> versions(vertexCount, 0);
+
+    std::priority_queue<Collapse> queue;
+    auto push = [&](quint32 from, quint32 to) {
+        if (locked[from])
+            return;
+        Quadric q = quadrics[from];
+        q.add(quadrics[to]);
+        Collapse collapse = { q.error(p[to*3], p[to*3+1], p[to*3+2]), from, to, versions[from], versions[to] };
+        queue.push(collapse);
+    };
+
+    for (int i = 0; i < tris.size(); i += 3) {
+        for (int c = 0; c < 3; c++) {
+            quint32 a = tris[i+c], b = tris[i+(c+1)%3];
+            push(a, b);
+            push(b, a);
+        }
+    }
+
+    int remaining = triangleCount;
+    while (remaining > targetTriangles && !queue.empty()) {
+        Collapse collapse = queue.top();
+        queue.pop();
+        if (collapse.fromVersion != versions[collapse.from] || collapse.toVersion != versions[collapse.to])
+            continue;
+
+        QVector<int>& fromTriangles = vertexTriangles[collapse.from];
+
+        // reject collapses that flip a surviving triangle
+        bool flips = false;
+        int shared = 0;
+        for (int a = 0; a < fromTriangles.size() && !flips; a++) {
+            if (!triangleAlive[fromTriangles[a]])
+                continue;
+            const quint32* t = tris.constData() + fromTriangles[a]*3;
+            if (t[0] == collapse.to || t[1] == collapse.to || t[2] == collapse.to) {
+                shared++;
+                continue;
+            }
+            const float* before[3];
+            const float* after[3];
+            for (int c = 0; c < 3; c++) {
+                before[c] = p + t[c]*3;
+                after[c] = t[c] == collapse.from ? p + collapse.to*3 : before[c];
+            }
+            double n0[3], n1[3];
+            triangleNormal(before[0], before[1], before[2], n0);
+            triangleNormal(after[0], after[1], after[2], n1);
+            flips = n0[0]*n1[0] + n0[1]*n1[1] + n0[2]*n1[2] <= 0;
+        }
+        if (flips || shared == 0)
+            continue; // queued again if a neighbouring collapse changes either vertex
+
+        QVector<int>& toTriangles = vertexTriangles[collapse.to];
+        foreach (int triangle, fromTriangles) {
+            if (!triangleAlive[triangle])
+                continue;
+            quint32* t = tris.data() + triangle*3;
+            if (t[0] == collapse.to || t[1] == collapse.to || t[2] == collapse.to) {
+                triangleAlive[triangle] = false;
+                remaining--;
+                continue;
+            }
+            for (int c = 0; c < 3; c++) {
+                if (t[c] == collapse.from)
+                    t[c] = collapse.to;
+            }
+            toTriangles.append(triangle);
+        }
+        fromTriangles.clear();
+        fromTriangles.squeeze();
+
+        quadrics[collapse.to].add(quadrics[collapse.from]);
+        versions[collapse.from]++;
+        versions[collapse.to]++;
+
+        // requeue the edges around the kept vertex with its new quadric
+        int kept = 0;
+        for (int a = 0; a < toTriangles.size(); a++) {
+            int triangle = toTriangles[a];
+            if (!triangleAlive[triangle])
+                continue;
+            toTriangles[kept++] = triangle;
+            const quint32* t = tris.constData() + triangle*3;
+            for (int c = 0; c < 3; c++) {
+                if (t[c] == collapse.to)
+                    continue;
+                push(t[c], collapse.to);
+                push(collapse.to, t[c]);
+            }
+        }
+        toTriangles.resize(kept);
+    }
+
+    QVector<quint32> simplified;
+    simplified.reserve(remaining * 3);
+    for (int t = 0; t < triangleCount; t++) {
+        if (!triangleAlive[t])
+            continue;
+        simplified.append(tris[t*3]);
+        simplified.append(tris[t*3+1]);
+        simplified.append(tris[t*3+2]);
+    }
+
+    return simplified;
+}
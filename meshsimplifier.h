@@ -0,0 +1,21 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <QVector>
+
+// quadric error metric simplification (Garland & Heckbert 1997) using
+// half-edge collapses, so every level reuses the original vertex arrays and
+// only needs its own index buffer.
+//
+// Vertices on uv seams (positions shared by several vertices) and on open
+// boundaries are never collapsed, which keeps texture mapping intact.
+class MeshSimplifier
+{
+public:
+    // returns an index buffer with at most targetTriangles triangles when
+    // the locked vertices allow it
+    static QVector<quint32> simplify(const QVector<float>& positions, const QVector<quint32>& indices,
+                                     int targetTriangles);
+};
+
+#endif // MESHSIMPLIFIER_H
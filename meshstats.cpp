@@ -0,0 +1,132 @@
+#include "meshstats.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLTimerQuery>
+
+MeshStats::MeshStats(QObject *parent) : QObject(parent)
+{
+    _queries[0] = _queries[1] = 0;
+
+    _refreshTimer.setSingleShot(true);
+    _refreshTimer.setInterval(STATS_REFRESH_MS);
+    connect(&_refreshTimer, SIGNAL(timeout()), this, SLOT(onRefresh()));
+}
+
+MeshStats* MeshStats::instance()
+{
+    static MeshStats* stats = new MeshStats();
+    return stats;
+}
+
+MeshStatsEntry MeshStats::stats(Mesh *mesh) const
+{
+    return _stats.value(mesh);
+}
+
+void MeshStats::changed(Mesh *mesh)
+{
+    _changed.insert(mesh);
+    if (!_refreshTimer.isActive()) {
+        _refreshTimer.start();
+    }
+}
+
+void MeshStats::recordGeometry(Mesh *mesh, int triangles, qint64 vertexBytes)
+{
+    MeshStatsEntry& entry = _stats[mesh];
+    if (entry.triangles != triangles || entry.vertexBytes != vertexBytes) {
+        entry.triangles = triangles;
+        entry.vertexBytes = vertexBytes;
+        changed(mesh);
+    }
+}
+
+void MeshStats::recordTexture(Mesh *mesh, int size, qint64 bytes)
+{
+    MeshStatsEntry& entry = _stats[mesh];
+    if (entry.textureSize != size || entry.textureBytes != bytes) {
+        entry.textureSize = size;
+        entry.textureBytes = bytes;
+        changed(mesh);
+    }
+}
+
+void MeshStats::recordBake(Mesh *mesh, float ms)
+{
+    _stats[mesh].lastBakeMs = ms;
+    changed(mesh);
+}
+
+void MeshStats::beginFrame()
+{
+    if (!_queriesCreated) {
+        _queriesCreated = true;
+        _queryContext = QOpenGLContext::currentContext();
+        _queries[0] = new QOpenGLTimerQuery(this);
+        _queries[1] = new QOpenGLTimerQuery(this);
+        _queriesSupported = _queries[0]->create() && _queries[1]->create();
+    }
+
+    // query objects aren't shared between contexts, only time the first view
+    _timingFrame = _queriesSupported && QOpenGLContext::currentContext() == _queryContext;
+    if (!_timingFrame)
+        return;
+
+    // timestamps instead of begin/end, elapsed queries can't nest with the
+    // whole scene query of AdaptiveResolution
+    if (_queryPending && _queries[1]->isResultAvailable()) {
+        GLuint64 start = _queries[0]->waitForResult();
+        GLuint64 end = _queries[1]->waitForResult();
+        if (_stats.contains(_pendingMesh)) {
+            _stats[_pendingMesh].lastDrawGpuMs = (end - start) / 1000000.0f;
+            changed(_pendingMesh);
+        }
+        _queryPending = false;
+    }
+
+    // pick the next mesh drawn last frame
+    _sampleMesh = 0;
+    if (!_queryPending && !_drawnThisFrame.isEmpty()) {
+        _sampleIndex = (_sampleIndex + 1) % _drawnThisFrame.size();
+        _sampleMesh = _drawnThisFrame[_sampleIndex];
+    }
+    _drawnThisFrame.clear();
+}
+
+void MeshStats::beginDraw(Mesh *mesh)
+{
+    if (!_timingFrame)
+        return;
+
+    _drawnThisFrame.append(mesh);
+    if (mesh == _sampleMesh) {
+        _queries[0]->recordTimestamp();
+    }
+}
+
+void MeshStats::endDraw(Mesh *mesh)
+{
+    if (_timingFrame && mesh == _sampleMesh) {
+        _queries[1]->recordTimestamp();
+        _pendingMesh = mesh;
+        _queryPending = true;
+        _sampleMesh = 0;
+    }
+}
+
+void MeshStats::forgetMesh(Mesh *mesh)
+{
+    _stats.remove(mesh);
+    _changed.remove(mesh);
+    _drawnThisFrame.removeAll(mesh);
+    if (_sampleMesh == mesh) {
+        _sampleMesh = 0;
+    }
+}
+
+void MeshStats::onRefresh()
+{
+    QList<Mesh*> meshes = _changed.toList();
+    _changed.clear();
+    emit statsChanged(meshes);
+}
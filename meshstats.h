@@ -0,0 +1,79 @@
+#ifndef MESHSTATS_H
+#define MESHSTATS_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+
+#include "mesh.h"
+
+class QOpenGLTimerQuery;
+class QOpenGLContext;
+
+#define STATS_REFRESH_MS 500
+
+struct MeshStatsEntry
+{
+    int triangles = 0;
+    qint64 vertexBytes = 0;
+    int textureSize = 0;
+    qint64 textureBytes = 0;
+    float lastBakeMs = -1;    // -1 until measured
+    float lastDrawGpuMs = -1;
+};
+
+// per mesh cost registry fed by the render and bake paths. Listeners get
+// the changed meshes at most every STATS_REFRESH_MS, so views showing the
+// numbers never update at frame rate.
+//
+// GPU draw time is sampled for one mesh per frame with timestamp queries,
+// read back a few frames later to avoid stalls.
+class MeshStats : public QObject
+{
+    Q_OBJECT
+public:
+    static MeshStats* instance();
+
+    MeshStatsEntry stats(Mesh* mesh) const;
+
+    void recordGeometry(Mesh* mesh, int triangles, qint64 vertexBytes);
+    void recordTexture(Mesh* mesh, int size, qint64 bytes);
+    void recordBake(Mesh* mesh, float ms);
+
+    // once per drawn frame, with the GL context current
+    void beginFrame();
+    void beginDraw(Mesh* mesh);
+    void endDraw(Mesh* mesh);
+
+    void forgetMesh(Mesh* mesh);
+
+signals:
+    void statsChanged(QList<Mesh*> meshes);
+
+private slots:
+    void onRefresh();
+
+private:
+    explicit MeshStats(QObject *parent = 0);
+
+    void changed(Mesh* mesh);
+
+    QHash<Mesh*, MeshStatsEntry> _stats;
+    QSet<Mesh*> _changed;
+    QTimer _refreshTimer;
+
+    // round robin draw timing
+    QList<Mesh*> _drawnThisFrame;
+    int _sampleIndex = 0;
+    Mesh* _sampleMesh = 0;
+    Mesh* _pendingMesh = 0;
+    QOpenGLTimerQuery* _queries[2];
+    QOpenGLContext* _queryContext = 0;
+    bool _queriesCreated = false;
+    bool _timingFrame = false;
+    bool _queriesSupported = false;
+    bool _queryPending = false;
+};
+
+#endif // MESHSTATS_H
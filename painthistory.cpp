@@ -0,0 +1,525 @@
+#include "painthistory.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QTemporaryFile>
+#include <QImage>
+#include <QMap>
+#include <QtConcurrent>
+#include <algorithm>
+#include <iostream>
+
+#include "glcache.h"
+#include "texturemips.h"
+#include "textureresidency.h"
+#include "profiler.h"
+#include "paintlayers.h"
+#include "texturecompression.h"
+
+namespace {
+    struct HistoryTile
+    {
+        Mesh* mesh = 0;
+        GLuint texture = 0; // paint layer, 0 for the mesh texture
+        QRect rect; // texels of level 0
+
+        // compressed RGBA8 pixels, in memory until spilled
+        QFuture<QByteArray> before;
+        QFuture<QByteArray> after;
+        qint64 beforeOffset = -1, beforeLength = 0;
+        qint64 afterOffset = -1, afterLength = 0;
+        bool spilled = false;
+    };
+
+    struct HistoryEntry
+    {
+        QList<HistoryTile> tiles;
+        bool spilled = false; // every tile
+    };
+
+    QList<HistoryEntry> undoStack;
+    QList<HistoryEntry> redoStack;
+    HistoryEntry pending;
+    bool recording = false;
+
+    QTemporaryFile* spillFile = 0;
+    qint64 spillEnd = 0;             // the file is in use up to here
+    QMap<qint64, qint64> freeRanges; // offset -> length of dropped tiles below spillEnd
+    GLuint readFbo = 0;
+
+    QRect tileAligned(QRect rect)
+    {
+        const int t = PAINT_HISTORY_TILE_SIZE;
+        int x0 = rect.left() / t * t, y0 = rect.top() / t * t;
+        int x1 = (rect.right() / t + 1) * t, y1 = (rect.bottom() / t + 1) * t;
+        return QRect(x0, y0, x1 - x0, y1 - y0);
+    }
+
+    QByteArray readRegion(GLuint texture, QRect rect)
+    {
+        QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+        if (!readFbo) {
+            f->glGenFramebuffers(1, &readFbo);
+        }
+
+        GLint previousRead;
+        f->glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+        f->glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+        f->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+
+        QByteArray pixels(rect.width() * rect.height() * 4, Qt::Uninitialized);
+        f->glReadPixels(rect.x(), rect.y(), rect.width(), rect.height(), GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+        f->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+        f->glBindFramebuffer(GL_READ_FRAMEBUFFER, previousRead);
+        return pixels;
+    }
+
+    // slices a tile out of a read back region and compresses it off thread
+    QFuture<QByteArray> compressTile(QByteArray region, QRect regionRect, QRect tile)
+    {
+        return QtConcurrent::run([region, regionRect, tile]() {
+            QByteArray pixels(tile.width() * tile.height() * 4, Qt::Uninitialized);
+            const int rowBytes = tile.width() * 4;
+            for (int y = 0; y < tile.height(); y++) {
+                int srcRow = tile.y() - regionRect.y() + y;
+                int srcOffset = (srcRow * regionRect.width() + tile.x() - regionRect.x()) * 4;
+                memcpy(pixels.data() + y * rowBytes, region.constData() + srcOffset, rowBytes);
+            }
+            return qCompress(pixels, 1);
+        });
+    }
+
+    QList<HistoryTile> capture(Mesh* mesh, GLuint texture, QRect dirty)
+    {
+        QList<HistoryTile> tiles;
+        if (dirty.isEmpty())
+            return tiles;
+
+        QRect region = tileAligned(dirty).intersected(QRect(0, 0, mesh->textureSize(), mesh->textureSize()));
+        QByteArray pixels = readRegion(texture, region);
+
+        for (int y = region.top(); y <= region.bottom(); y += PAINT_HISTORY_TILE_SIZE) {
+            for (int x = region.left(); x <= region.right(); x += PAINT_HISTORY_TILE_SIZE) {
+                HistoryTile tile;
+                tile.mesh = mesh;
+                tile.texture = PaintLayers::hasStack(mesh) ? texture : 0;
+                tile.rect = QRect(x, y, PAINT_HISTORY_TILE_SIZE, PAINT_HISTORY_TILE_SIZE).intersected(region);
+                tile.before = compressTile(pixels, region, tile.rect);
+                tiles.append(tile);
+            }
+        }
+        return tiles;
+    }
+
+    qint64 entryBytes(const HistoryEntry& entry)
+    {
+        if (entry.spilled)
+            return 0;
+
+        qint64 bytes = 0;
+        foreach (const HistoryTile& tile, entry.tiles) {
+            if (tile.spilled)
+                continue;
+            if (tile.before.isFinished())
+                bytes += tile.before.result().size();
+            if (tile.after.isFinished())
+                bytes += tile.after.result().size();
+        }
+        return bytes;
+    }
+
+    // first fit in the ranges of dropped tiles, else at the end of the file
+    qint64 allocateSpill(qint64 length)
+    {
+        QMap<qint64, qint64>::iterator it;
+        for (it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+            if (it.value() < length)
+                continue;
+            qint64 offset = it.key();
+            qint64 rest = it.value() - length;
+            freeRanges.erase(it);
+            if (rest > 0)
+                freeRanges.insert(offset + length, rest);
+            return offset;
+        }
+
+        qint64 offset = spillEnd;
+        spillEnd += length;
+        return offset;
+    }
+
+    void releaseSpill(qint64 offset, qint64 length)
+    {
+        if (offset < 0 || length == 0)
+            return;
+
+        // merge with the free neighbours
+        QMap<qint64, qint64>::iterator next = freeRanges.find(offset + length);
+        if (next != freeRanges.end()) {
+            length += next.value();
+            freeRanges.erase(next);
+        }
+        QMap<qint64, qint64>::iterator previous = freeRanges.lowerBound(offset);
+        if (previous != freeRanges.begin()) {
+            --previous;
+            if (previous.key() + previous.value() == offset) {
+                offset = previous.key();
+                length += previous.value();
+                freeRanges.erase(previous);
+            }
+        }
+
+        if (offset + length == spillEnd) {
+            spillEnd = offset;
+            spillFile->resize(spillEnd);
+        } else {
+            freeRanges.insert(offset, length);
+        }
+    }
+
+    void releaseTile(const HistoryTile& tile)
+    {
+        releaseSpill(tile.beforeOffset, tile.beforeLength);
+        releaseSpill(tile.afterOffset, tile.afterLength);
+    }
+
+    void releaseEntry(const HistoryEntry& entry)
+    {
+        foreach (const HistoryTile& tile, entry.tiles) {
+            releaseTile(tile);
+        }
+    }
+
+    qint64 spill(QFuture<QByteArray>& data, qint64& length)
+    {
+        if (data.resultCount() == 0)
+            return -1; // never captured
+
+        QByteArray bytes = data.result();
+        qint64 offset = allocateSpill(bytes.size());
+        spillFile->seek(offset);
+        spillFile->write(bytes);
+        length = bytes.size();
+        data = QFuture<QByteArray>();
+        return offset;
+    }
+
+    // tiles still compressing stay in memory until a later bake spills them,
+    // so spilling never waits for a worker thread
+    void spillEntry(HistoryEntry& entry)
+    {
+        if (!spillFile) {
+            spillFile = new QTemporaryFile();
+            if (!spillFile->open()) {
+                std::cerr << "unable to open paint history spill file" << std::endl;
+                delete spillFile;
+                spillFile = 0;
+                return;
+            }
+        }
+
+        bool spilled = true;
+        for (int i = 0; i < entry.tiles.size(); i++) {
+            HistoryTile& tile = entry.tiles[i];
+            if (tile.spilled)
+                continue;
+            if (!tile.before.isFinished() || !tile.after.isFinished()) {
+                spilled = false;
+                continue;
+            }
+            tile.beforeOffset = spill(tile.before, tile.beforeLength);
+            tile.afterOffset = spill(tile.after, tile.afterLength);
+            tile.spilled = true;
+        }
+        entry.spilled = spilled;
+    }
+
+    // resamples a tile's compressed pixels off thread, spilled tiles come
+    // back into memory
+    QFuture<QByteArray> resizeTile(QFuture<QByteArray> data, qint64& offset, qint64& length, QSize from, QSize to)
+    {
+        QByteArray spilled;
+        if (offset >= 0) {
+            spillFile->seek(offset);
+            spilled = spillFile->read(length);
+            releaseSpill(offset, length);
+            offset = -1;
+            length = 0;
+        } else if (data.resultCount() == 0 && !data.isRunning()) {
+            return QFuture<QByteArray>(); // never captured
+        }
+
+        return QtConcurrent::run([data, spilled, from, to]() {
+            QByteArray pixels = qUncompress(spilled.isEmpty() ? data.result() : spilled);
+            if (pixels.size() != from.width() * from.height() * 4)
+                return QByteArray();
+
+            QImage image((const uchar*)pixels.constData(), from.width(), from.height(), QImage::Format_RGBA8888);
+            QImage scaled = image.scaled(to, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+                    .convertToFormat(QImage::Format_RGBA8888);
+
+            QByteArray resized(to.width() * to.height() * 4, Qt::Uninitialized);
+            const int rowBytes = to.width() * 4;
+            for (int y = 0; y < to.height(); y++) {
+                memcpy(resized.data() + y * rowBytes, scaled.constScanLine(y), rowBytes);
+            }
+            return qCompress(resized, 1);
+        });
+    }
+
+    QByteArray loadPixels(QFuture<QByteArray> data, qint64 offset, qint64 length)
+    {
+        if (offset < 0) {
+            if (data.resultCount() == 0 && !data.isRunning())
+                return QByteArray();
+            return qUncompress(data.result());
+        }
+
+        spillFile->seek(offset);
+        return qUncompress(spillFile->read(length));
+    }
+
+    // uploads the before or after state of an entry
+    QList<Mesh*> restore(const HistoryEntry& entry, bool after)
+    {
+        QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+        QHash<Mesh*, QRect> touched;
+
+        foreach (const HistoryTile& tile, entry.tiles) {
+            TextureResidency::ensureResident(tile.mesh);
+            TextureCompression::ensureUncompressed(tile.mesh);
+
+            QByteArray pixels = after ? loadPixels(tile.after, tile.afterOffset, tile.afterLength)
+                                      : loadPixels(tile.before, tile.beforeOffset, tile.beforeLength);
+            if (pixels.size() != tile.rect.width() * tile.rect.height() * 4)
+                continue;
+
+            GLuint target = tile.texture ? tile.texture : GLCache::meshTextureId(tile.mesh);
+            f->glBindTexture(GL_TEXTURE_2D, target);
+            f->glTexSubImage2D(GL_TEXTURE_2D, 0, tile.rect.x(), tile.rect.y(), tile.rect.width(), tile.rect.height(),
+                               GL_RGBA, GL_UNSIGNED_BYTE, pixels.constData());
+
+            touched[tile.mesh] = touched.value(tile.mesh).united(tile.rect);
+            if (tile.texture && tile.texture != PaintLayers::bakeTarget(tile.mesh)) {
+                PaintLayers::invalidate(tile.mesh);
+            }
+        }
+
+        QHashIterator<Mesh*, QRect> it(touched);
+        while (it.hasNext()) {
+            it.next();
+            if (PaintLayers::hasStack(it.key())) {
+                PaintLayers::recomposite(it.key(), it.value());
+            } else {
+                TextureMips::updateRegion(GLCache::meshTextureId(it.key()), it.key()->textureSize(), it.value());
+            }
+        }
+
+        return touched.keys();
+    }
+}
+
+void PaintHistory::beginBake()
+{
+    pending = HistoryEntry();
+    recording = true;
+}
+
+void PaintHistory::captureBefore(Mesh *mesh, GLuint texture, QRect dirty)
+{
+    if (!recording)
+        return;
+
+    pending.tiles.append(capture(mesh, texture, dirty));
+}
+
+void PaintHistory::captureAfter(Mesh *mesh, GLuint texture, QRect dirty)
+{
+    if (!recording || dirty.isEmpty())
+        return;
+
+    QRect region = tileAligned(dirty).intersected(QRect(0, 0, mesh->textureSize(), mesh->textureSize()));
+    QByteArray pixels = readRegion(texture, region);
+
+    for (int i = 0; i < pending.tiles.size(); i++) {
+        HistoryTile& tile = pending.tiles[i];
+        if (tile.mesh == mesh) {
+            tile.after = compressTile(pixels, region, tile.rect);
+        }
+    }
+}
+
+void PaintHistory::endBake()
+{
+    recording = false;
+    if (pending.tiles.isEmpty())
+        return;
+
+    undoStack.append(pending);
+    pending = HistoryEntry();
+    foreach (const HistoryEntry& entry, redoStack) {
+        releaseEntry(entry);
+    }
+    redoStack.clear(); // a new bake forks history
+
+    while (undoStack.size() > PAINT_HISTORY_MAX_ENTRIES) {
+        releaseEntry(undoStack.takeFirst());
+    }
+
+    // spill the oldest entries still in memory until under budget
+    qint64 budget = (qint64)PAINT_HISTORY_MEMORY_MB * 1024 * 1024;
+    qint64 bytes = memoryBytes();
+    for (int i = 0; i < undoStack.size() - 1 && bytes > budget; i++) {
+        if (undoStack[i].spilled)
+            continue;
+        qint64 entryBefore = entryBytes(undoStack[i]);
+        spillEntry(undoStack[i]);
+        bytes -= entryBefore - entryBytes(undoStack[i]);
+    }
+
+    Profiler::setCounter("history", QString("%1 undo, %2 MB in memory")
+                         .arg(undoStack.size()).arg(bytes / (1024 * 1024)));
+}
+
+bool PaintHistory::canUndo()
+{
+    return !undoStack.isEmpty();
+}
+
+bool PaintHistory::canRedo()
+{
+    return !redoStack.isEmpty();
+}
+
+QList<Mesh*> PaintHistory::undo()
+{
+    if (undoStack.isEmpty())
+        return QList<Mesh*>();
+
+    HistoryEntry entry = undoStack.takeLast();
+    redoStack.append(entry);
+    return restore(entry, false);
+}
+
+QList<Mesh*> PaintHistory::redo()
+{
+    if (redoStack.isEmpty())
+        return QList<Mesh*>();
+
+    HistoryEntry entry = redoStack.takeLast();
+    undoStack.append(entry);
+    return restore(entry, true);
+}
+
+void PaintHistory::forgetMesh(Mesh *mesh)
+{
+    QList<HistoryEntry>* stacks[2] = { &undoStack, &redoStack };
+    for (int s = 0; s < 2; s++) {
+        QList<HistoryEntry>& stack = *stacks[s];
+        for (int i = stack.size() - 1; i >= 0; i--) {
+            QList<HistoryTile>& tiles = stack[i].tiles;
+            for (int t = tiles.size() - 1; t >= 0; t--) {
+                if (tiles[t].mesh == mesh) {
+                    releaseTile(tiles[t]);
+                    tiles.removeAt(t);
+                }
+            }
+            if (tiles.isEmpty()) {
+                stack.removeAt(i);
+            }
+        }
+    }
+}
+
+void PaintHistory::forgetTexture(GLuint texture)
+{
+    QList<HistoryEntry>* stacks[2] = { &undoStack, &redoStack };
+    for (int s = 0; s < 2; s++) {
+        QList<HistoryEntry>& stack = *stacks[s];
+        for (int i = stack.size() - 1; i >= 0; i--) {
+            QList<HistoryTile>& tiles = stack[i].tiles;
+            for (int t = tiles.size() - 1; t >= 0; t--) {
+                if (tiles[t].texture == texture) {
+                    releaseTile(tiles[t]);
+                    tiles.removeAt(t);
+                }
+            }
+            if (tiles.isEmpty()) {
+                stack.removeAt(i);
+            }
+        }
+    }
+}
+
+void PaintHistory::retargetMesh(Mesh *mesh, GLuint texture)
+{
+    QList<HistoryEntry>* stacks[2] = { &undoStack, &redoStack };
+    for (int s = 0; s < 2; s++) {
+        QList<HistoryEntry>& stack = *stacks[s];
+        for (int i = 0; i < stack.size(); i++) {
+            QList<HistoryTile>& tiles = stack[i].tiles;
+            for (int t = 0; t < tiles.size(); t++) {
+                if (tiles[t].mesh == mesh && !tiles[t].texture) {
+                    tiles[t].texture = texture;
+                }
+            }
+        }
+    }
+}
+
+void PaintHistory::retargetTexture(GLuint previous, GLuint texture)
+{
+    QList<HistoryEntry>* stacks[2] = { &undoStack, &redoStack };
+    for (int s = 0; s < 2; s++) {
+        QList<HistoryEntry>& stack = *stacks[s];
+        for (int i = 0; i < stack.size(); i++) {
+            QList<HistoryTile>& tiles = stack[i].tiles;
+            for (int t = 0; t < tiles.size(); t++) {
+                if (tiles[t].texture == previous) {
+                    tiles[t].texture = texture;
+                }
+            }
+        }
+    }
+}
+
+void PaintHistory::resizeMesh(Mesh *mesh, int previousSize, int size)
+{
+    if (previousSize == size || previousSize <= 0)
+        return;
+
+    QList<HistoryEntry>* stacks[2] = { &undoStack, &redoStack };
+    for (int s = 0; s < 2; s++) {
+        QList<HistoryEntry>& stack = *stacks[s];
+        for (int i = 0; i < stack.size(); i++) {
+            QList<HistoryTile>& tiles = stack[i].tiles;
+            for (int t = 0; t < tiles.size(); t++) {
+                HistoryTile& tile = tiles[t];
+                if (tile.mesh != mesh)
+                    continue;
+
+                QRect from = tile.rect;
+                QRect to(from.x() * size / previousSize, from.y() * size / previousSize,
+                         std::max(1, from.width() * size / previousSize), std::max(1, from.height() * size / previousSize));
+                tile.before = resizeTile(tile.before, tile.beforeOffset, tile.beforeLength, from.size(), to.size());
+                tile.after = resizeTile(tile.after, tile.afterOffset, tile.afterLength, from.size(), to.size());
+                tile.rect = to;
+                tile.spilled = false;
+                stack[i].spilled = false;
+            }
+        }
+    }
+}
+
+qint64 PaintHistory::memoryBytes()
+{
+    qint64 bytes = 0;
+    foreach (const HistoryEntry& entry, undoStack) {
+        bytes += entryBytes(entry);
+    }
+    foreach (const HistoryEntry& entry, redoStack) {
+        bytes += entryBytes(entry);
+    }
+    return bytes;
+}
@@ -0,0 +1,52 @@
+#ifndef PAINTHISTORY_H
+#define PAINTHISTORY_H
+
+#include <QOpenGLFunctions>
+#include <QRect>
+#include <QList>
+
+#include "mesh.h"
+
+#define PAINT_HISTORY_TILE_SIZE 64
+#define PAINT_HISTORY_MEMORY_MB 256
+#define PAINT_HISTORY_MAX_ENTRIES 500
+
+// undo/redo for bakes. Before and after each bake only the texture tiles
+// under the bake's dirty rect are read back and compressed on worker
+// threads. Old entries spill to a temporary file once the history uses more
+// than PAINT_HISTORY_MEMORY_MB, so memory stays proportional to what was
+// painted recently. Space of dropped entries in the file is reused.
+//
+// Capture, undo and redo need the shared GL context to be current.
+class PaintHistory
+{
+public:
+    static void beginBake();
+    // texture is the bake target, see PaintLayers::bakeTarget
+    static void captureBefore(Mesh* mesh, GLuint texture, QRect dirty);
+    static void captureAfter(Mesh* mesh, GLuint texture, QRect dirty);
+    static void endBake();
+
+    static bool canUndo();
+    static bool canRedo();
+
+    // restore the tiles of the last entry, returns the meshes they belong to
+    static QList<Mesh*> undo();
+    static QList<Mesh*> redo();
+
+    // drops entries of a mesh that left the project or changed texture size
+    static void forgetMesh(Mesh* mesh);
+    // drops tiles of a deleted paint layer
+    static void forgetTexture(GLuint texture);
+    // tiles captured from the mesh texture now belong to this layer texture
+    static void retargetMesh(Mesh* mesh, GLuint texture);
+    // tiles of a layer texture that was replaced by a resampled copy
+    static void retargetTexture(GLuint previous, GLuint texture);
+    // scales the tiles of a mesh whose textures were resampled, on worker
+    // threads. Sizes are powers of two, so scaled tiles stay aligned.
+    static void resizeMesh(Mesh* mesh, int previousSize, int size);
+
+    static qint64 memoryBytes();
+};
+
+#endif // PAINTHISTORY_H
@@ -0,0 +1,433 @@
+#include "paintlayers.h"
+
+#include <QHash>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+
+#include "glcache.h"
+#include "shader.h"
+#include "texturemips.h"
+#include "textureresidency.h"
+#include "painthistory.h"
+#include "projectarchive.h"
+#include "texturecompression.h"
+
+namespace {
+    struct LayerStack
+    {
+        QList<PaintLayer> layers;
+        int active = 0;
+        int size = 0;
+
+        // composites of the layers under and over the active one
+        GLuint below = 0;
+        GLuint above = 0;
+        bool aboveCached = false; // only when every layer over is NORMAL
+        bool cachesValid = false;
+    };
+
+    QHash<Mesh*, LayerStack> stacks;
+    QOpenGLShaderProgram* compositeShader = 0;
+    GLuint targetFbo = 0;
+    GLuint sourceFbo = 0;
+
+    // previous state restored by endTarget
+    GLint previousDraw;
+    GLint previousViewport[4];
+    GLboolean previousBlend;
+    GLboolean previousScissor;
+
+    QOpenGLExtraFunctions* gl()
+    {
+        return QOpenGLContext::currentContext()->extraFunctions();
+    }
+
+    GLuint createTexture(int size)
+    {
+        QOpenGLExtraFunctions* f = gl();
+        GLuint textureId;
+        f->glGenTextures(1, &textureId);
+        f->glBindTexture(GL_TEXTURE_2D, textureId);
+        f->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return textureId;
+    }
+
+    void beginTarget(GLuint texture, int size, QRect rect)
+    {
+        QOpenGLExtraFunctions* f = gl();
+        if (!targetFbo) {
+            f->glGenFramebuffers(1, &targetFbo);
+            f->glGenFramebuffers(1, &sourceFbo);
+        }
+
+        f->glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDraw);
+        f->glGetIntegerv(GL_VIEWPORT, previousViewport);
+        previousBlend = f->glIsEnabled(GL_BLEND);
+        previousScissor = f->glIsEnabled(GL_SCISSOR_TEST);
+
+        f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFbo);
+        f->glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        f->glViewport(0, 0, size, size);
+        f->glEnable(GL_SCISSOR_TEST);
+        f->glScissor(rect.x(), rect.y(), rect.width(), rect.height());
+
+        f->glClearColor(0, 0, 0, 0);
+        f->glClear(GL_COLOR_BUFFER_BIT);
+        f->glEnable(GL_BLEND);
+
+        if (!compositeShader) {
+            compositeShader = ShaderFactory::buildLayerCompositeShader(0);
+        }
+        compositeShader->bind();
+        compositeShader->setUniformValue("layerTexture", 0);
+    }
+
+    void endTarget()
+    {
+        QOpenGLExtraFunctions* f = gl();
+        compositeShader->release();
+
+        f->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        if (!previousBlend)
+            f->glDisable(GL_BLEND);
+        if (!previousScissor)
+            f->glDisable(GL_SCISSOR_TEST);
+
+        f->glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+        f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousDraw);
+        f->glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    }
+
+    // blends a layer over the current target. The shader outputs
+    // premultiplied color, which keeps every mode a plain blend func
+    void drawLayer(GLuint texture, int blend, float opacity, bool premultiplied)
+    {
+        QOpenGLExtraFunctions* f = gl();
+
+        switch (blend) {
+        case LayerBlend::MULTIPLY:
+            f->glBlendFuncSeparate(GL_DST_COLOR, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+            break;
+        case LayerBlend::SCREEN:
+            f->glBlendFuncSeparate(GL_ONE, GL_ONE_MINUS_SRC_COLOR, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+            break;
+        case LayerBlend::ADD:
+            f->glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+            break;
+        default:
+            f->glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        }
+
+        compositeShader->setUniformValue("opacity", opacity);
+        compositeShader->setUniformValue("premultiplied", premultiplied ? 1.0f : 0.0f);
+
+        f->glActiveTexture(GL_TEXTURE0);
+        f->glBindTexture(GL_TEXTURE_2D, texture);
+
+        glBegin(GL_QUADS);
+        {
+            glVertex2f(0,0);
+            glVertex2f(1,0);
+            glVertex2f(1,1);
+            glVertex2f(0,1);
+        }
+        glEnd();
+    }
+
+    void drawLayers(const LayerStack& stack, int first, int last)
+    {
+        for (int i = first; i < last; i++) {
+            const PaintLayer& layer = stack.layers[i];
+            if (layer.visible) {
+                drawLayer(layer.texture, layer.blend, layer.opacity, false);
+            }
+        }
+    }
+
+    void rebuildCaches(LayerStack& stack)
+    {
+        const QRect all(0, 0, stack.size, stack.size);
+
+        if (!stack.below) {
+            stack.below = createTexture(stack.size);
+            stack.above = createTexture(stack.size);
+        }
+
+        beginTarget(stack.below, stack.size, all);
+        drawLayers(stack, 0, stack.active);
+        endTarget();
+
+        // normal blending is associative, other modes need the layers under
+        stack.aboveCached = true;
+        for (int i = stack.active + 1; i < stack.layers.size(); i++) {
+            if (stack.layers[i].blend != LayerBlend::NORMAL) {
+                stack.aboveCached = false;
+            }
+        }
+
+        if (stack.aboveCached) {
+            beginTarget(stack.above, stack.size, all);
+            drawLayers(stack, stack.active + 1, stack.layers.size());
+            endTarget();
+        }
+
+        stack.cachesValid = true;
+    }
+
+    void copyTexture(GLuint source, GLuint target, int size)
+    {
+        QOpenGLExtraFunctions* f = gl();
+        if (!targetFbo) {
+            f->glGenFramebuffers(1, &targetFbo);
+            f->glGenFramebuffers(1, &sourceFbo);
+        }
+
+        GLint previousRead, previousDraw;
+        f->glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+        f->glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDraw);
+
+        f->glBindFramebuffer(GL_READ_FRAMEBUFFER, sourceFbo);
+        f->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source, 0);
+        f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFbo);
+        f->glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, 0);
+
+        f->glBlitFramebuffer(0, 0, size, size, 0, 0, size, size, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+        f->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+        f->glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+        f->glBindFramebuffer(GL_READ_FRAMEBUFFER, previousRead);
+        f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousDraw);
+    }
+
+    void deleteTexture(GLuint& texture)
+    {
+        if (texture) {
+            gl()->glDeleteTextures(1, &texture);
+            texture = 0;
+        }
+    }
+}
+
+bool PaintLayers::hasStack(Mesh *mesh)
+{
+    return stacks.contains(mesh);
+}
+
+int PaintLayers::layerCount(Mesh *mesh)
+{
+    return stacks.contains(mesh) ? stacks[mesh].layers.size() : 1;
+}
+
+PaintLayer PaintLayers::layer(Mesh *mesh, int index)
+{
+    if (!stacks.contains(mesh)) {
+        PaintLayer base;
+        base.name = "base";
+        base.texture = GLCache::meshTextureId(mesh);
+        return base;
+    }
+    return stacks[mesh].layers.value(index);
+}
+
+int PaintLayers::addLayer(Mesh *mesh, QString name)
+{
+    TextureResidency::ensureResident(mesh);
+    TextureCompression::ensureUncompressed(mesh);
+    if (!GLCache::hasMeshTexture(mesh))
+        return -1;
+
+    if (!stacks.contains(mesh)) {
+        LayerStack stack;
+        stack.size = mesh->textureSize();
+
+        PaintLayer base;
+        base.name = "base";
+        base.texture = createTexture(stack.size);
+        copyTexture(GLCache::meshTextureId(mesh), base.texture, stack.size);
+        stack.layers.append(base);
+
+        stacks.insert(mesh, stack);
+        PaintHistory::retargetMesh(mesh, base.texture);
+    }
+
+    LayerStack& stack = stacks[mesh];
+
+    PaintLayer layer;
+    layer.name = name;
+    layer.texture = createTexture(stack.size);
+
+    // starts transparent, the flattened texture stays as is
+    beginTarget(layer.texture, stack.size, QRect(0, 0, stack.size, stack.size));
+    endTarget();
+
+    stack.active = stack.active + 1;
+    stack.layers.insert(stack.active, layer);
+    stack.cachesValid = false;
+
+    return stack.active;
+}
+
+void PaintLayers::removeLayer(Mesh *mesh, int index)
+{
+    if (!stacks.contains(mesh))
+        return;
+
+    LayerStack& stack = stacks[mesh];
+    if (stack.layers.size() < 2 || index < 0 || index >= stack.layers.size())
+        return;
+
+    PaintLayer layer = stack.layers.takeAt(index);
+    PaintHistory::forgetTexture(layer.texture);
+    deleteTexture(layer.texture);
+
+    if (stack.active >= index && stack.active > 0) {
+        stack.active--;
+    }
+    stack.cachesValid = false;
+
+    recomposite(mesh, QRect(0, 0, stack.size, stack.size));
+}
+
+int PaintLayers::activeLayer(Mesh *mesh)
+{
+    return stacks.contains(mesh) ? stacks[mesh].active : 0;
+}
+
+void PaintLayers::setActiveLayer(Mesh *mesh, int index)
+{
+    if (!stacks.contains(mesh))
+        return;
+
+    LayerStack& stack = stacks[mesh];
+    if (index < 0 || index >= stack.layers.size() || index == stack.active)
+        return;
+
+    stack.active = index;
+    stack.cachesValid = false; // rebuilt by the next bake
+}
+
+void PaintLayers::setBlend(Mesh *mesh, int index, int blend)
+{
+    if (!stacks.contains(mesh) || index < 0 || index >= stacks[mesh].layers.size())
+        return;
+
+    LayerStack& stack = stacks[mesh];
+    stack.layers[index].blend = blend;
+    stack.cachesValid = false;
+    recomposite(mesh, QRect(0, 0, stack.size, stack.size));
+}
+
+void PaintLayers::setOpacity(Mesh *mesh, int index, float opacity)
+{
+    if (!stacks.contains(mesh) || index < 0 || index >= stacks[mesh].layers.size())
+        return;
+
+    LayerStack& stack = stacks[mesh];
+    stack.layers[index].opacity = qBound(0.0f, opacity, 1.0f);
+    stack.cachesValid = false;
+    recomposite(mesh, QRect(0, 0, stack.size, stack.size));
+}
+
+void PaintLayers::setVisible(Mesh *mesh, int index, bool visible)
+{
+    if (!stacks.contains(mesh) || index < 0 || index >= stacks[mesh].layers.size())
+        return;
+
+    LayerStack& stack = stacks[mesh];
+    stack.layers[index].visible = visible;
+    stack.cachesValid = false;
+    recomposite(mesh, QRect(0, 0, stack.size, stack.size));
+}
+
+GLuint PaintLayers::bakeTarget(Mesh *mesh)
+{
+    if (!stacks.contains(mesh))
+        return GLCache::meshTextureId(mesh);
+
+    const LayerStack& stack = stacks[mesh];
+    return stack.layers[stack.active].texture;
+}
+
+void PaintLayers::recomposite(Mesh *mesh, QRect dirty)
+{
+    if (!stacks.contains(mesh))
+        return;
+
+    LayerStack& stack = stacks[mesh];
+    dirty = dirty.intersected(QRect(0, 0, stack.size, stack.size));
+    if (dirty.isEmpty())
+        return;
+
+    TextureResidency::ensureResident(mesh);
+    TextureCompression::ensureUncompressed(mesh);
+
+    if (!stack.cachesValid) {
+        rebuildCaches(stack);
+    }
+
+    // below, then the active layer, then above
+    GLuint flattened = GLCache::meshTextureId(mesh);
+    beginTarget(flattened, stack.size, dirty);
+
+    drawLayer(stack.below, LayerBlend::NORMAL, 1, true);
+    drawLayers(stack, stack.active, stack.active + 1);
+    if (stack.aboveCached) {
+        drawLayer(stack.above, LayerBlend::NORMAL, 1, true);
+    } else {
+        drawLayers(stack, stack.active + 1, stack.layers.size());
+    }
+
+    endTarget();
+
+    TextureMips::updateRegion(flattened, stack.size, dirty);
+    ProjectArchive::instance()->markTextureDirty(mesh);
+}
+
+void PaintLayers::invalidate(Mesh *mesh)
+{
+    if (stacks.contains(mesh)) {
+        stacks[mesh].cachesValid = false;
+    }
+}
+
+void PaintLayers::resizeMesh(Mesh *mesh, int size)
+{
+    if (!stacks.contains(mesh))
+        return;
+
+    LayerStack& stack = stacks[mesh];
+    if (stack.size == size)
+        return;
+
+    for (int i = 0; i < stack.layers.size(); i++) {
+        GLuint previous = stack.layers[i].texture;
+        if (size < stack.size) {
+            TextureMips::generate(previous); // deleted below, shrinking reads its levels
+        }
+        stack.layers[i].texture = TextureMips::resample(previous, stack.size, size, false);
+        PaintHistory::retargetTexture(previous, stack.layers[i].texture);
+        deleteTexture(previous);
+    }
+
+    // rebuilt from the resampled layers by the next bake
+    deleteTexture(stack.below);
+    deleteTexture(stack.above);
+    stack.cachesValid = false;
+    stack.size = size;
+}
+
+void PaintLayers::forgetMesh(Mesh *mesh)
+{
+    if (!stacks.contains(mesh))
+        return;
+
+    LayerStack stack = stacks.take(mesh);
+    for (int i = 0; i < stack.layers.size(); i++) {
+        deleteTexture(stack.layers[i].texture);
+    }
+    deleteTexture(stack.below);
+    deleteTexture(stack.above);
+}
@@ -0,0 +1,68 @@
+#ifndef PAINTLAYERS_H
+#define PAINTLAYERS_H
+
+#include <QOpenGLFunctions>
+#include <QString>
+#include <QRect>
+
+#include "mesh.h"
+
+namespace LayerBlend {
+    enum {
+        NORMAL,
+        MULTIPLY,
+        SCREEN,
+        ADD
+    };
+}
+
+struct PaintLayer
+{
+    QString name;
+    GLuint texture = 0;
+    int blend = LayerBlend::NORMAL;
+    float opacity = 1;
+    bool visible = true;
+};
+
+// per mesh stack of paint layers. The mesh texture in GLCache holds the
+// flattened result, so drawing and exporting sample a single texture no
+// matter how many layers there are. The layers under and over the active one
+// are cached as composites, so a bake only recomposites its dirty rect from
+// three textures.
+//
+// A mesh starts without a stack and bakes straight into its GLCache texture.
+// All functions need the shared GL context to be current.
+class PaintLayers
+{
+public:
+    static bool hasStack(Mesh* mesh);
+    static int layerCount(Mesh* mesh);
+    static PaintLayer layer(Mesh* mesh, int index);
+
+    // the first call moves the current texture into a base layer.
+    // The new layer is placed over the active one and becomes active
+    static int addLayer(Mesh* mesh, QString name);
+    static void removeLayer(Mesh* mesh, int index);
+
+    static int activeLayer(Mesh* mesh);
+    static void setActiveLayer(Mesh* mesh, int index);
+
+    static void setBlend(Mesh* mesh, int index, int blend);
+    static void setOpacity(Mesh* mesh, int index, float opacity);
+    static void setVisible(Mesh* mesh, int index, bool visible);
+
+    // texture strokes bake into, the active layer or the mesh texture
+    static GLuint bakeTarget(Mesh* mesh);
+    // rebuilds the flattened texture under dirty after the bake target changed
+    static void recomposite(Mesh* mesh, QRect dirty);
+    // call when a layer other than the active one was written to
+    static void invalidate(Mesh* mesh);
+    // resamples every layer to a new texture size, before the mesh texture
+    // of that size is set. Undo tiles follow the layers' new textures.
+    static void resizeMesh(Mesh* mesh, int size);
+
+    static void forgetMesh(Mesh* mesh);
+};
+
+#endif // PAINTLAYERS_H
@@ -0,0 +1,219 @@
+#include "profiler.h"
+
+#include <QPainter>
+#include <QJsonArray>
+#include <algorithm>
+#include <cmath>
+
+TimingHistogram::TimingHistogram(float bucketMs, int bucketCount)
+    : _bucketMs(bucketMs), _buckets(bucketCount + 1, 0)
+{
+    clear();
+}
+
+void TimingHistogram::add(float ms)
+{
+    int bucket = std::min((int)(std::max(ms, 0.f) / _bucketMs), _buckets.size() - 1);
+    _buckets[bucket]++;
+    _count++;
+    _sum += ms;
+    _max = std::max(_max, ms);
+}
+
+void TimingHistogram::clear()
+{
+    _buckets.fill(0);
+    _count = 0;
+    _sum = 0;
+    _max = 0;
+}
+
+float TimingHistogram::mean() const
+{
+    return _count > 0 ? _sum / _count : 0;
+}
+
+float TimingHistogram::percentile(float p) const
+{
+    if (_count == 0)
+        return 0;
+
+    int target = std::max(1, (int)std::ceil(p * _count));
+    int seen = 0;
+    for (int i = 0; i < _buckets.size(); i++) {
+        seen += _buckets[i];
+        if (seen >= target) {
+            // overflow bucket has no upper bound, report the worst sample
+            return i == _buckets.size() - 1 ? _max : (i + 1) * _bucketMs;
+        }
+    }
+    return _max;
+}
+
+QJsonObject TimingHistogram::toJson() const
+{
+    QJsonObject json;
+    json["count"] = _count;
+    json["mean_ms"] = mean();
+    json["p50_ms"] = percentile(0.5f);
+    json["p90_ms"] = percentile(0.9f);
+    json["p99_ms"] = percentile(0.99f);
+    json["max_ms"] = _max;
+    json["bucket_ms"] = _bucketMs;
+
+    // sparse buckets keep journals of short runs readable
+    QJsonArray buckets;
+    for (int i = 0; i < _buckets.size(); i++) {
+        if (_buckets[i] == 0)
+            continue;
+        QJsonArray bucket;
+        bucket.append(i * _bucketMs);
+        bucket.append(_buckets[i]);
+        buckets.append(bucket);
+    }
+    json["buckets"] = buckets;
+    return json;
+}
+
+namespace {
+    TimingHistogram frameHistogram;
+    TimingHistogram bakeHistogram(2.0f, 250);
+    TimingHistogram inputHistogram;
+    qint64 dabCount = 0;
+    QElapsedTimer dabClock;
+    bool syncGpu = false;
+    bool showOverlay = false;
+    QMap<QString, QString> counters;
+}
+
+void Profiler::recordFrame(float ms)
+{
+    frameHistogram.add(ms);
+}
+
+void Profiler::recordBake(float ms)
+{
+    bakeHistogram.add(ms);
+}
+
+void Profiler::recordInputLatency(float ms)
+{
+    inputHistogram.add(ms);
+}
+
+void Profiler::recordDabs(int count)
+{
+    if (!dabClock.isValid())
+        dabClock.start();
+    dabCount += count;
+}
+
+bool Profiler::gpuSync()
+{
+    return syncGpu;
+}
+
+void Profiler::setGpuSync(bool sync)
+{
+    syncGpu = sync;
+}
+
+const TimingHistogram& Profiler::frameTimes()
+{
+    return frameHistogram;
+}
+
+const TimingHistogram& Profiler::bakeTimes()
+{
+    return bakeHistogram;
+}
+
+const TimingHistogram& Profiler::inputLatencyTimes()
+{
+    return inputHistogram;
+}
+
+float Profiler::dabsPerSecond()
+{
+    if (!dabClock.isValid() || dabClock.elapsed() == 0)
+        return 0;
+    return dabCount * 1000.0f / dabClock.elapsed();
+}
+
+void Profiler::setCounter(QString name, QString value)
+{
+    counters[name] = value;
+}
+
+void Profiler::reset()
+{
+    frameHistogram.clear();
+    bakeHistogram.clear();
+    inputHistogram.clear();
+    dabCount = 0;
+    dabClock.invalidate();
+}
+
+QJsonObject Profiler::report()
+{
+    QJsonObject json;
+    json["frames"] = frameHistogram.toJson();
+    json["bakes"] = bakeHistogram.toJson();
+    json["input_latency"] = inputHistogram.toJson();
+    json["dabs"] = (double)dabCount;
+    json["dabs_per_second"] = dabsPerSecond();
+
+    QMapIterator<QString, QString> it(counters);
+    while (it.hasNext()) {
+        it.next();
+        json[it.key()] = it.value();
+    }
+    return json;
+}
+
+bool Profiler::overlayVisible()
+{
+    return showOverlay;
+}
+
+void Profiler::setOverlayVisible(bool visible)
+{
+    showOverlay = visible;
+}
+
+void Profiler::drawOverlay(QPainter* painter, int x, int y)
+{
+    QStringList lines;
+    lines << QString("frame  p50 %1 ms  p99 %2 ms  max %3 ms")
+             .arg(frameHistogram.percentile(0.5f), 0, 'f', 1)
+             .arg(frameHistogram.percentile(0.99f), 0, 'f', 1)
+             .arg(frameHistogram.max(), 0, 'f', 1);
+    lines << QString("bake   p50 %1 ms  max %2 ms  (%3 bakes)")
+             .arg(bakeHistogram.percentile(0.5f), 0, 'f', 1)
+             .arg(bakeHistogram.max(), 0, 'f', 1)
+             .arg(bakeHistogram.count());
+    lines << QString("input  p50 %1 ms  p99 %2 ms  max %3 ms")
+             .arg(inputHistogram.percentile(0.5f), 0, 'f', 1)
+             .arg(inputHistogram.percentile(0.99f), 0, 'f', 1)
+             .arg(inputHistogram.max(), 0, 'f', 1);
+    lines << QString("dabs/s %1").arg(dabsPerSecond(), 0, 'f', 0);
+
+    QMapIterator<QString, QString> it(counters);
+    while (it.hasNext()) {
+        it.next();
+        lines << it.key() + "  " + it.value();
+    }
+
+    QFontMetrics fm(painter->font());
+    QRect bgRect(x - 4, y - fm.ascent() - 4, 0, lines.size() * fm.height() + 8);
+    foreach (QString line, lines) {
+        bgRect.setWidth(std::max(bgRect.width(), fm.boundingRect(line).width() + 8));
+    }
+
+    painter->fillRect(bgRect, QColor(0,0,0, 160));
+    painter->setPen(QColor(255,255,255));
+    foreach (QString line, lines) {
+        painter->drawText(x, y, line);
+        y += fm.height();
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QVector>
+#include <QString>
+#include <QJsonObject>
+#include <QElapsedTimer>
+#include <QMap>
+
+class QPainter;
+
+// fixed-bucket histogram of durations in milliseconds, cheap enough to
+// update every frame
+class TimingHistogram
+{
+public:
+    TimingHistogram(float bucketMs = 0.5f, int bucketCount = 200);
+
+    void add(float ms);
+    void clear();
+
+    int count() const { return _count; }
+    float mean() const;
+    float max() const { return _max; }
+    float percentile(float p) const; // p in [0,1]
+
+    QJsonObject toJson() const;
+
+private:
+    float _bucketMs;
+    QVector<int> _buckets; // last bucket collects overflow
+    int _count;
+    double _sum;
+    float _max;
+};
+
+// global timing statistics for frames, bakes, brush dabs and input latency
+class Profiler
+{
+public:
+    static void recordFrame(float ms);
+    static void recordBake(float ms);
+    static void recordDabs(int count);
+    // from input event to the frame showing it on screen
+    static void recordInputLatency(float ms);
+
+    // when enabled, timed sections call glFinish so the GPU work is included
+    static bool gpuSync();
+    static void setGpuSync(bool sync);
+
+    static const TimingHistogram& frameTimes();
+    static const TimingHistogram& bakeTimes();
+    static const TimingHistogram& inputLatencyTimes();
+    static float dabsPerSecond();
+
+    // named status line shown in the overlay and included in reports
+    static void setCounter(QString name, QString value);
+
+    static void reset();
+    static QJsonObject report();
+
+    static bool overlayVisible();
+    static void setOverlayVisible(bool visible);
+    static void drawOverlay(QPainter* painter, int x, int y);
+};
+
+#endif // PROFILER_H
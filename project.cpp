@@ -5,6 +5,7 @@
 //#include <assimp/postprocess.h>     // Post processing flags
 
 #include "mesh.h"
+#include "meshprocessor.h"
 
 #define CREATE_TEST_QUAD 0
 
@@ -47,6 +48,7 @@ Project* Project::activeProject()
 void Project::addMesh(Mesh *mesh)
 {
     _meshes.append(mesh);
+    MeshProcessor::instance()->process(mesh);
     emit meshAdded();
 }
 
@@ -0,0 +1,454 @@
+#include "projectarchive.h"
+
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtConcurrent>
+#include <algorithm>
+#include <iostream>
+
+#include "project.h"
+#include "glcache.h"
+#include "glview.h"
+#include "meshprocessor.h"
+#include "textureresidency.h"
+#include "texturecompression.h"
+#include "geometrystore.h"
+#include "profiler.h"
+
+#define GEOMETRY_BLOB_MAGIC 0x50424745
+#define TEXTURE_BLOB_MAGIC 0x50425458
+
+namespace {
+    QString geometryFileName(int id, quint64 generation)
+    {
+        return QString("meshes/%1-%2.geom").arg(id).arg(generation);
+    }
+
+    QString textureFileName(int id, quint64 generation)
+    {
+        return QString("textures/%1-%2.tex").arg(id).arg(generation);
+    }
+
+    // writes next to the target and renames over it on commit
+    bool writeBlob(QString path, const QByteArray& data, QString& error)
+    {
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+            error = QString("unable to write %1: %2").arg(path).arg(file.errorString());
+            return false;
+        }
+        return true;
+    }
+
+    QByteArray encodeGeometry(const ArchiveMeshSnapshot& snapshot)
+    {
+        QByteArray data;
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+        stream << (quint32)GEOMETRY_BLOB_MAGIC << (quint32)PROJECT_ARCHIVE_VERSION;
+        stream << snapshot.vertices << snapshot.uvs << snapshot.indices;
+        return data;
+    }
+
+    QByteArray encodeTexture(const ArchiveMeshSnapshot& snapshot)
+    {
+        QByteArray data;
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream << (quint32)TEXTURE_BLOB_MAGIC << (quint32)PROJECT_ARCHIVE_VERSION;
+        stream << (qint32)snapshot.textureSize << qCompress(snapshot.pixels, 1);
+        return data;
+    }
+
+    QByteArray readFile(QString path)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            std::cerr << "unable to read file path: " << path.toStdString() << std::endl;
+            return QByteArray();
+        }
+        return file.readAll();
+    }
+}
+
+ProjectArchive::ProjectArchive(QObject *parent) : QObject(parent)
+{
+    connect(&_autosaveTimer, SIGNAL(timeout()), this, SLOT(onAutosave()));
+    _autosaveTimer.setInterval(AUTOSAVE_INTERVAL_MS);
+
+    connect(Project::activeProject(), &Project::meshesRemoved, this, [this](QList<Mesh*> removed) {
+        foreach (Mesh* mesh, removed) {
+            forgetMesh(mesh);
+        }
+        _structureGeneration++;
+    });
+    connect(Project::activeProject(), &Project::meshesAltered, this, [this](QList<Mesh*>) {
+        _structureGeneration++;
+    });
+    connect(MeshProcessor::instance(), &MeshProcessor::meshProcessed, this, [this](Mesh* mesh) {
+        if (!_loadedGeometry.remove(mesh)) {
+            markGeometryDirty(mesh);
+        }
+    });
+}
+
+ProjectArchive* ProjectArchive::instance()
+{
+    static ProjectArchive* archive = new ProjectArchive();
+    return archive;
+}
+
+int ProjectArchive::meshId(Mesh *mesh)
+{
+    if (!_meshIds.contains(mesh)) {
+        _meshIds[mesh] = _nextMeshId++;
+        _structureGeneration++;
+        _textureGenerations[mesh] = 1;
+        _geometryGenerations[mesh] = 1;
+    }
+    return _meshIds[mesh];
+}
+
+void ProjectArchive::markTextureDirty(Mesh *mesh)
+{
+    meshId(mesh);
+    _textureGenerations[mesh]++;
+}
+
+void ProjectArchive::markGeometryDirty(Mesh *mesh)
+{
+    meshId(mesh);
+    _geometryGenerations[mesh]++;
+}
+
+void ProjectArchive::forgetMesh(Mesh *mesh)
+{
+    _meshIds.remove(mesh);
+    _textureGenerations.remove(mesh);
+    _geometryGenerations.remove(mesh);
+    _savedTextureGenerations.remove(mesh);
+    _savedGeometryGenerations.remove(mesh);
+    _loadedTextures.remove(mesh);
+    _loadedGeometry.remove(mesh);
+}
+
+bool ProjectArchive::isSaving() const
+{
+    return _saving;
+}
+
+bool ProjectArchive::hasUnsavedChanges() const
+{
+    QHashIterator<Mesh*, int> it(_meshIds);
+    while (it.hasNext()) {
+        it.next();
+        if (_textureGenerations.value(it.key()) != _savedTextureGenerations.value(it.key()) ||
+            _geometryGenerations.value(it.key()) != _savedGeometryGenerations.value(it.key()))
+            return true;
+    }
+    return _structureGeneration != _savedStructureGeneration ||
+           _meshIds.size() != Project::activeProject()->meshes().size();
+}
+
+QString ProjectArchive::path() const
+{
+    return _path;
+}
+
+void ProjectArchive::setAutosaveInterval(int ms)
+{
+    _autosaveTimer.setInterval(ms);
+}
+
+bool ProjectArchive::save(QString path)
+{
+    if (_saving)
+        return false;
+
+    // a new location has none of the blobs yet
+    if (path != _path) {
+        _path = path;
+        _savedTextureGenerations.clear();
+        _savedGeometryGenerations.clear();
+    }
+
+    // textures are read back through the shared context
+    if (!GLView::views().isEmpty()) {
+        GLView::views().first()->makeCurrent();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    ArchiveSaveJob* job = new ArchiveSaveJob();
+    job->path = path;
+
+    Project* project = Project::activeProject();
+    foreach (Mesh* mesh, project->meshes()) {
+        ArchiveMeshSnapshot snapshot;
+        snapshot.mesh = mesh;
+        snapshot.id = meshId(mesh);
+        snapshot.name = mesh->meshName();
+        snapshot.visible = project->meshVisible(mesh);
+
+        snapshot.geometryGeneration = _geometryGenerations[mesh];
+        snapshot.geometryFile = geometryFileName(snapshot.id, snapshot.geometryGeneration);
+        if (_savedGeometryGenerations.value(mesh) != snapshot.geometryGeneration) {
+            GeometryStore::ensureHostGeometry(mesh);
+
+            snapshot.writeGeometry = true;
+            snapshot.vertices = mesh->_vertices; // shared until the mesh changes
+            snapshot.uvs = mesh->_uvs;
+            snapshot.indices.resize(mesh->_triangleIndices.size());
+            for (int i = 0; i < mesh->_triangleIndices.size(); i++) {
+                snapshot.indices[i] = mesh->_triangleIndices[i];
+            }
+        }
+
+        snapshot.textureGeneration = _textureGenerations[mesh];
+        // textures of meshes never drawn since the load are still on the host
+        bool pendingUpload = _loadedTextures.contains(mesh);
+        bool hasTexture = GLCache::hasMeshTexture(mesh) || TextureResidency::isEvicted(mesh) || pendingUpload;
+        bool textureSaved = _savedTextureGenerations.value(mesh) == snapshot.textureGeneration;
+
+        if (hasTexture || textureSaved) {
+            snapshot.textureFile = textureFileName(snapshot.id, snapshot.textureGeneration);
+            snapshot.textureSize = _loadedTextures.contains(mesh) ? _loadedTextures[mesh].first : mesh->textureSize();
+        }
+        if (hasTexture && !textureSaved) {
+            snapshot.writeTexture = true;
+            if (pendingUpload) {
+                snapshot.pixels = _loadedTextures[mesh].second;
+            } else {
+                TextureResidency::ensureResident(mesh);
+                TextureCompression::readPixels(mesh, snapshot.pixels);
+            }
+        }
+
+        job->meshes.append(snapshot);
+    }
+
+    job->structureGeneration = _structureGeneration;
+    job->snapshotMs = timer.elapsed();
+    _saving = true;
+
+    QFutureWatcher<ArchiveSaveJob*>* watcher = new QFutureWatcher<ArchiveSaveJob*>(this);
+    connect(watcher, SIGNAL(finished()), this, SLOT(onSaveFinished()));
+    watcher->setFuture(QtConcurrent::run(&ProjectArchive::runSave, job));
+
+    if (!_autosaveTimer.isActive()) {
+        _autosaveTimer.start();
+    }
+
+    return true;
+}
+
+ArchiveSaveJob* ProjectArchive::runSave(ArchiveSaveJob *job)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QDir dir(job->path);
+    if (!dir.mkpath("meshes") || !dir.mkpath("textures")) {
+        job->error = "unable to create " + job->path;
+        return job;
+    }
+
+    // blobs are independent, encode and write them in parallel
+    QVector<QString> errors(job->meshes.size());
+    QVector<qint64> written(job->meshes.size(), 0);
+    QVector<int> indices(job->meshes.size());
+    for (int i = 0; i < indices.size(); i++) {
+        indices[i] = i;
+    }
+
+    QtConcurrent::blockingMap(indices, [&](int i) {
+        const ArchiveMeshSnapshot& snapshot = job->meshes[i];
+        if (snapshot.writeGeometry) {
+            QByteArray data = encodeGeometry(snapshot);
+            if (writeBlob(dir.filePath(snapshot.geometryFile), data, errors[i]))
+                written[i] += data.size();
+        }
+        if (snapshot.writeTexture) {
+            QByteArray data = encodeTexture(snapshot);
+            if (writeBlob(dir.filePath(snapshot.textureFile), data, errors[i]))
+                written[i] += data.size();
+        }
+    });
+
+    QSet<QString> referenced;
+    QJsonArray meshes;
+    for (int i = 0; i < job->meshes.size(); i++) {
+        const ArchiveMeshSnapshot& snapshot = job->meshes[i];
+        if (!errors[i].isEmpty()) {
+            job->error = errors[i];
+            return job; // keep the previous manifest
+        }
+        job->bytesWritten += written[i];
+        job->filesWritten += (snapshot.writeGeometry ? 1 : 0) + (snapshot.writeTexture ? 1 : 0);
+
+        QJsonObject mesh;
+        mesh["id"] = snapshot.id;
+        mesh["name"] = snapshot.name;
+        mesh["visible"] = snapshot.visible;
+        mesh["geometry"] = snapshot.geometryFile;
+        mesh["geometryGeneration"] = QString::number(snapshot.geometryGeneration);
+        if (!snapshot.textureFile.isEmpty()) {
+            mesh["texture"] = snapshot.textureFile;
+            mesh["textureGeneration"] = QString::number(snapshot.textureGeneration);
+            mesh["textureSize"] = snapshot.textureSize;
+        }
+        meshes.append(mesh);
+
+        referenced.insert(snapshot.geometryFile);
+        referenced.insert(snapshot.textureFile);
+    }
+
+    QJsonObject manifest;
+    manifest["version"] = PROJECT_ARCHIVE_VERSION;
+    manifest["meshes"] = meshes;
+
+    QByteArray manifestData = QJsonDocument(manifest).toJson();
+    if (!writeBlob(dir.filePath("manifest.json"), manifestData, job->error))
+        return job;
+    job->bytesWritten += manifestData.size();
+
+    // blobs of older generations are unreachable once the manifest is in place
+    QStringList subdirs = QStringList() << "meshes" << "textures";
+    foreach (QString subdir, subdirs) {
+        foreach (QString name, QDir(dir.filePath(subdir)).entryList(QDir::Files)) {
+            QString relative = subdir + "/" + name;
+            if (!referenced.contains(relative)) {
+                dir.remove(relative);
+            }
+        }
+    }
+
+    job->writeMs = timer.elapsed();
+    job->ok = true;
+    return job;
+}
+
+void ProjectArchive::onSaveFinished()
+{
+    QFutureWatcher<ArchiveSaveJob*>* watcher = static_cast<QFutureWatcher<ArchiveSaveJob*>*>(sender());
+    ArchiveSaveJob* job = watcher->result();
+    watcher->deleteLater();
+
+    _saving = false;
+
+    if (job->ok && job->path == _path) {
+        _savedStructureGeneration = job->structureGeneration;
+        foreach (const ArchiveMeshSnapshot& snapshot, job->meshes) {
+            if (!_meshIds.contains(snapshot.mesh))
+                continue; // removed while saving
+            _savedGeometryGenerations[snapshot.mesh] = snapshot.geometryGeneration;
+            if (!snapshot.textureFile.isEmpty()) {
+                _savedTextureGenerations[snapshot.mesh] = snapshot.textureGeneration;
+            }
+        }
+
+        std::cout << "saved " << job->path.toStdString() << ": " << job->filesWritten << " files, "
+                  << job->bytesWritten / 1024 << " KB, snapshot " << job->snapshotMs
+                  << " ms, write " << job->writeMs << " ms" << std::endl;
+        Profiler::setCounter("save", QString("%1 files, %2 ms").arg(job->filesWritten).arg(job->snapshotMs + job->writeMs));
+    } else if (!job->ok) {
+        std::cerr << "save failed: " << job->error.toStdString() << std::endl;
+    }
+
+    emit saveFinished(job->ok);
+    delete job;
+}
+
+void ProjectArchive::onAutosave()
+{
+    if (!_path.isEmpty() && !_saving && hasUnsavedChanges()) {
+        save(_path);
+    }
+}
+
+bool ProjectArchive::load(QString path)
+{
+    QJsonDocument document = QJsonDocument::fromJson(readFile(QDir(path).filePath("manifest.json")));
+    QJsonObject manifest = document.object();
+    if (manifest["version"].toInt() != PROJECT_ARCHIVE_VERSION) {
+        std::cerr << "unsupported project: " << path.toStdString() << std::endl;
+        return false;
+    }
+
+    Project* project = Project::activeProject();
+    project->reset();
+
+    QDir dir(path);
+    foreach (QJsonValue value, manifest["meshes"].toArray()) {
+        QJsonObject entry = value.toObject();
+
+        QByteArray geometry = readFile(dir.filePath(entry["geometry"].toString()));
+        QDataStream stream(geometry);
+        stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+        quint32 magic, version;
+        QVector<float> vertices, uvs;
+        QVector<quint32> indices;
+        stream >> magic >> version >> vertices >> uvs >> indices;
+        if (magic != GEOMETRY_BLOB_MAGIC || stream.status() != QDataStream::Ok) {
+            std::cerr << "skipping corrupt mesh " << entry["name"].toString().toStdString() << std::endl;
+            continue;
+        }
+
+        Mesh* mesh = new Mesh();
+        mesh->_vertices = vertices;
+        mesh->_uvs = uvs;
+        for (int i = 0; i + 2 < indices.size(); i += 3) {
+            mesh->addTriangle(indices[i], indices[i+1], indices[i+2]);
+        }
+        mesh->setMeshName(entry["name"].toString());
+
+        // the files on disk already match this mesh
+        int id = entry["id"].toInt();
+        _meshIds[mesh] = id;
+        _nextMeshId = std::max(_nextMeshId, id + 1);
+        _geometryGenerations[mesh] = _savedGeometryGenerations[mesh] = entry["geometryGeneration"].toString().toULongLong();
+        _textureGenerations[mesh] = 1;
+
+        if (entry.contains("texture")) {
+            QByteArray texture = readFile(dir.filePath(entry["texture"].toString()));
+            QDataStream textureStream(texture);
+            qint32 size;
+            QByteArray compressed;
+            textureStream >> magic >> version >> size >> compressed;
+            QByteArray pixels = qUncompress(compressed);
+            if (magic == TEXTURE_BLOB_MAGIC && pixels.size() == size * size * 4) {
+                _loadedTextures[mesh] = qMakePair((int)size, pixels);
+                _textureGenerations[mesh] = _savedTextureGenerations[mesh] = entry["textureGeneration"].toString().toULongLong();
+            }
+        }
+
+        _loadedGeometry.insert(mesh);
+        project->addMesh(mesh);
+        project->setMeshVisibility(mesh, entry["visible"].toBool(true));
+    }
+
+    _path = path;
+    _savedStructureGeneration = _structureGeneration;
+    if (!_autosaveTimer.isActive()) {
+        _autosaveTimer.start();
+    }
+    return true;
+}
+
+bool ProjectArchive::takeLoadedTexture(Mesh *mesh, QByteArray &pixels, int &size)
+{
+    if (!_loadedTextures.contains(mesh))
+        return false;
+
+    QPair<int, QByteArray> texture = _loadedTextures.take(mesh);
+    size = texture.first;
+    pixels = texture.second;
+    return true;
+}
@@ -0,0 +1,119 @@
+#ifndef PROJECTARCHIVE_H
+#define PROJECTARCHIVE_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+#include <QVector>
+#include <QFutureWatcher>
+
+#include "mesh.h"
+
+#define PROJECT_ARCHIVE_VERSION 1
+#define AUTOSAVE_INTERVAL_MS 120000
+
+// what a save writes for one mesh, copied from the GPU and the mesh on the
+// main thread so the worker never touches either
+struct ArchiveMeshSnapshot
+{
+    Mesh* mesh = 0;
+    int id = 0;
+    QString name;
+    bool visible = true;
+
+    QString geometryFile;
+    quint64 geometryGeneration = 0;
+    bool writeGeometry = false;
+    QVector<float> vertices;
+    QVector<float> uvs;
+    QVector<quint32> indices;
+
+    QString textureFile;
+    quint64 textureGeneration = 0;
+    bool writeTexture = false;
+    int textureSize = 0;
+    QByteArray pixels; // RGBA8, bottom row first like GL
+};
+
+struct ArchiveSaveJob
+{
+    QString path;
+    QList<ArchiveMeshSnapshot> meshes;
+    quint64 structureGeneration = 0;
+
+    bool ok = false;
+    QString error;
+    qint64 snapshotMs = 0;
+    qint64 writeMs = 0;
+    qint64 bytesWritten = 0;
+    int filesWritten = 0;
+};
+
+// saves the project as a directory holding manifest.json plus a geometry
+// and a texture blob per mesh. Each texture and geometry has a generation
+// counter bumped whenever it changes, and a save only writes blobs whose
+// generation moved since the last save to the same path. Blob names carry
+// the generation and the manifest is replaced last with an atomic rename,
+// so an interrupted save leaves the previous one readable.
+class ProjectArchive : public QObject
+{
+    Q_OBJECT
+public:
+    static ProjectArchive* instance();
+
+    void markTextureDirty(Mesh* mesh);
+    void markGeometryDirty(Mesh* mesh);
+    void forgetMesh(Mesh* mesh);
+
+    // moves with every markTextureDirty, for caches of texture contents
+    quint64 textureGeneration(Mesh* mesh) const { return _textureGenerations.value(mesh); }
+
+    // snapshots on the calling thread and writes in the background.
+    // Returns false if a save is already running
+    bool save(QString path);
+    bool isSaving() const;
+    bool hasUnsavedChanges() const;
+
+    // replaces the project with a saved one, textures are uploaded on first draw
+    bool load(QString path);
+    bool takeLoadedTexture(Mesh* mesh, QByteArray& pixels, int& size);
+
+    QString path() const;
+    void setAutosaveInterval(int ms);
+
+signals:
+    void saveFinished(bool ok);
+
+private slots:
+    void onSaveFinished();
+    void onAutosave();
+
+private:
+    explicit ProjectArchive(QObject *parent = 0);
+
+    int meshId(Mesh* mesh);
+    static ArchiveSaveJob* runSave(ArchiveSaveJob* job);
+
+    QString _path;
+    QTimer _autosaveTimer;
+    bool _saving = false;
+
+    // bumped when meshes are added, removed or change visibility
+    quint64 _structureGeneration = 1;
+    quint64 _savedStructureGeneration = 0;
+
+    int _nextMeshId = 1;
+    QHash<Mesh*, int> _meshIds;
+    QHash<Mesh*, quint64> _textureGenerations;
+    QHash<Mesh*, quint64> _geometryGenerations;
+
+    // generations found in the files at _path
+    QHash<Mesh*, quint64> _savedTextureGenerations;
+    QHash<Mesh*, quint64> _savedGeometryGenerations;
+
+    QHash<Mesh*, QPair<int, QByteArray> > _loadedTextures;
+    QSet<Mesh*> _loadedGeometry; // on disk already, import reordering is not a change
+};
+
+#endif // PROJECTARCHIVE_H
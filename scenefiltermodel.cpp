@@ -0,0 +1,82 @@
+#include "scenefiltermodel.h"
+#include "scenetablecolumns.h"
+#include "meshnameindex.h"
+
+SceneFilterModel::SceneFilterModel(QObject *parent)
+    : QSortFilterProxyModel(parent)
+{
+    setSortRole(SCENE_SORT_ROLE);
+    connect(MeshNameIndex::instance(), SIGNAL(namesChanged()), this, SLOT(onNamesChanged()));
+}
+
+void SceneFilterModel::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    if (this->sourceModel()) {
+        disconnect(this->sourceModel(), 0, this, SLOT(onSourceRowsChanging()));
+    }
+
+    // connected after the proxy's own handlers, so the bitmap is marked
+    // stale before the proxy filters the new rows
+    QSortFilterProxyModel::setSourceModel(sourceModel);
+    _acceptedRowsValid = false;
+    if (sourceModel) {
+        connect(sourceModel, SIGNAL(rowsAboutToBeInserted(QModelIndex,int,int)), this, SLOT(onSourceRowsChanging()));
+        connect(sourceModel, SIGNAL(rowsAboutToBeRemoved(QModelIndex,int,int)), this, SLOT(onSourceRowsChanging()));
+        connect(sourceModel, SIGNAL(rowsAboutToBeMoved(QModelIndex,int,int,QModelIndex,int)), this, SLOT(onSourceRowsChanging()));
+        connect(sourceModel, SIGNAL(modelAboutToBeReset()), this, SLOT(onSourceRowsChanging()));
+    }
+}
+
+void SceneFilterModel::setNamePattern(QString pattern)
+{
+    if (pattern == _pattern)
+        return;
+
+    _pattern = pattern;
+    if (_pattern.isEmpty()) {
+        _matches.clear();
+        invalidateFilter();
+    } else {
+        onNamesChanged();
+    }
+}
+
+void SceneFilterModel::onNamesChanged()
+{
+    if (_pattern.isEmpty())
+        return; // nothing filtered
+
+    _matches = MeshNameIndex::instance()->query(_pattern);
+    _acceptedRowsValid = false;
+    invalidateFilter();
+}
+
+void SceneFilterModel::onSourceRowsChanging()
+{
+    _acceptedRowsValid = false;
+}
+
+void SceneFilterModel::updateAcceptedRows() const
+{
+    _acceptedRows.fill(false, sourceModel() ? sourceModel()->rowCount() : 0);
+    foreach (Mesh* mesh, _matches) {
+        int row = SceneRows::row(sourceModel(), mesh);
+        if (row >= 0 && row < _acceptedRows.size()) {
+            _acceptedRows[row] = true;
+        }
+    }
+    _acceptedRowsValid = true;
+}
+
+bool SceneFilterModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
+{
+    Q_UNUSED(sourceParent);
+
+    if (_pattern.isEmpty())
+        return true;
+
+    if (!_acceptedRowsValid) {
+        updateAcceptedRows();
+    }
+    return sourceRow < _acceptedRows.size() && _acceptedRows[sourceRow];
+}
@@ -0,0 +1,41 @@
+#ifndef SCENEFILTERMODEL_H
+#define SCENEFILTERMODEL_H
+
+#include <QSortFilterProxyModel>
+#include <QVector>
+
+#include "mesh.h"
+
+// outliner proxy filtering SceneTableModel rows by mesh name. The matches
+// come from MeshNameIndex and are turned into a bitmap over source rows
+// through SceneRows, so a keystroke costs the matches plus one bit test
+// per row. The bitmap is rebuilt lazily when source rows move.
+class SceneFilterModel : public QSortFilterProxyModel
+{
+    Q_OBJECT
+public:
+    explicit SceneFilterModel(QObject *parent = 0);
+
+    void setSourceModel(QAbstractItemModel *sourceModel);
+
+    // substring or glob (* and ?), case insensitive. Empty shows every row
+    void setNamePattern(QString pattern);
+    QString namePattern() const { return _pattern; }
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const;
+
+private slots:
+    void onNamesChanged();
+    void onSourceRowsChanging();
+
+private:
+    void updateAcceptedRows() const;
+
+    QString _pattern;
+    QVector<Mesh*> _matches;
+    mutable QVector<bool> _acceptedRows; // by source row
+    mutable bool _acceptedRowsValid = false;
+};
+
+#endif // SCENEFILTERMODEL_H
@@ -0,0 +1,36 @@
+#ifndef SCENETABLECOLUMNS_H
+#define SCENETABLECOLUMNS_H
+
+#include <Qt>
+
+#include "mesh.h"
+
+class QAbstractItemModel;
+
+namespace SceneColumn {
+    enum {
+        VISIBLE,
+        NAME,
+        TRIANGLES,
+        VERTEX_BYTES,
+        TEXTURE_SIZE,
+        TEXTURE_BYTES,
+        BAKE_MS,
+        DRAW_GPU_MS,
+        COUNT
+    };
+}
+
+// raw numbers for QSortFilterProxyModel::setSortRole, the display role
+// holds formatted strings that don't sort numerically
+#define SCENE_SORT_ROLE (Qt::UserRole + 1)
+// the row's Mesh* as a void*, for proxies
+#define SCENE_MESH_ROLE (Qt::UserRole + 2)
+
+namespace SceneRows {
+    // row of the mesh in a SceneTableModel, -1 if it has none. The model
+    // keeps the index as rows are inserted, removed and moved
+    int row(const QAbstractItemModel* model, Mesh* mesh);
+}
+
+#endif // SCENETABLECOLUMNS_H
@@ -1,19 +1,111 @@
 #include "scenetablemodel.h"
+#include "scenetablecolumns.h"
 #include "project.h"
+#include "meshstats.h"
+#include "meshnameindex.h"
+#include <QHash>
 #include <algorithm>
 
+namespace {
+    QHash<const QAbstractItemModel*, QHash<Mesh*, int> > rowTables;
+
+    // rows from..to-1 changed their mesh
+    void reindex(const QAbstractItemModel* model, const QVector<Mesh*>& meshes, int from, int to)
+    {
+        QHash<Mesh*, int>& rows = rowTables[model];
+        for (int row = from; row < to; row++) {
+            rows.insert(meshes[row], row);
+        }
+    }
+
+    QString formatBytes(qint64 bytes)
+    {
+        if (bytes >= 1024 * 1024)
+            return QString("%1 MB").arg(bytes / (1024.0 * 1024.0), 0, 'f', 1);
+        return QString("%1 KB").arg(bytes / 1024.0, 0, 'f', 1);
+    }
+
+    QString formatMs(float ms)
+    {
+        return ms < 0 ? QString("-") : QString("%1 ms").arg(ms, 0, 'f', 2);
+    }
+}
+
 SceneTableModel::SceneTableModel(QObject *parent)
     : QAbstractTableModel(parent)
 {
     connect(Project::activeProject(), SIGNAL(meshAdded()), this, SLOT(onMeshAdded()));
+    connect(this, &QObject::destroyed, [this]() { rowTables.remove(this); });
+
+    // stats arrive throttled, refresh only the rows that changed
+    connect(MeshStats::instance(), &MeshStats::statsChanged, this, [this](QList<Mesh*> meshes) {
+        QList<int> rows;
+        foreach (Mesh* mesh, meshes) {
+            int row = SceneRows::row(this, mesh);
+            if (row >= 0) {
+                rows.append(row);
+            }
+        }
+        std::sort(rows.begin(), rows.end());
+
+        for (int i = 0; i < rows.size(); ) {
+            int last = i;
+            while (last + 1 < rows.size() && rows[last + 1] == rows[last] + 1) {
+                last++;
+            }
+            emit dataChanged(index(rows[i], SceneColumn::TRIANGLES), index(rows[last], SceneColumn::COUNT - 1));
+            i = last + 1;
+        }
+    });
+
+    // removed rows go in contiguous runs, bottom first so the rows above
+    // keep their numbers
+    connect(Project::activeProject(), &Project::meshesRemoved, this, [this](QList<Mesh*> removed) {
+        QHash<Mesh*, int>& rowTable = rowTables[this];
+        QList<int> rows;
+        foreach (Mesh* mesh, removed) {
+            int row = rowTable.value(mesh, -1);
+            if (row >= 0) {
+                rows.append(row);
+                rowTable.remove(mesh);
+            }
+        }
+        if (rows.isEmpty())
+            return;
+        std::sort(rows.begin(), rows.end());
+
+        for (int last = rows.size() - 1; last >= 0; ) {
+            int first = last;
+            while (first > 0 && rows[first - 1] == rows[first] - 1) {
+                first--;
+            }
+            beginRemoveRows(QModelIndex(), rows[first], rows[last]);
+            _meshes.erase(_meshes.begin() + rows[first], _meshes.begin() + rows[last] + 1);
+            endRemoveRows();
+            last = first - 1;
+        }
+        reindex(this, _meshes, rows.first(), _meshes.size());
+    });
 
     rebuildTable();
 }
 
 void SceneTableModel::onMeshAdded()
 {
-    _meshes.clear();
-    rebuildTable();
+    // meshes are appended to the project, insert the new ones in name order
+    // instead of sorting the whole table again
+    QVector<Mesh*> meshes = Project::activeProject()->meshes();
+    for (int i = meshes.size() - 1; i >= 0 && SceneRows::row(this, meshes[i]) < 0; i--) {
+        Mesh* mesh = meshes[i];
+        QString name = mesh->meshName();
+        int row = std::upper_bound(_meshes.begin(), _meshes.end(), name,
+                                   [](const QString& name, Mesh* other) { return name < other->meshName(); }) - _meshes.begin();
+
+        beginInsertRows(QModelIndex(), row, row);
+        _meshes.insert(row, mesh);
+        reindex(this, _meshes, row, _meshes.size());
+        endInsertRows();
+    }
 }
 
 void SceneTableModel::rebuildTable()
@@ -26,6 +118,8 @@ void SceneTableModel::rebuildTable()
 
     std::sort(_meshes.begin(), _meshes.end(),
           []( Mesh *a,  Mesh *b) -> bool { return a->meshName() < b->meshName(); });
+    rowTables[this].clear();
+    reindex(this, _meshes, 0, _meshes.size());
 
     QModelIndex topLeft = createIndex(0, 0);
     QModelIndex bottomRight = createIndex(_meshes.count() - 1, 1);
@@ -41,7 +135,13 @@ QVariant SceneTableModel::headerData(int section, Qt::Orientation orientation, i
     if (orientation == Qt::Horizontal) {
         QVariant headers[] = {
             QVariant("Visible?"),
-            QVariant("Mesh Name")
+            QVariant("Mesh Name"),
+            QVariant("Triangles"),
+            QVariant("Vertex Buffers"),
+            QVariant("Texture Size"),
+            QVariant("Texture Memory"),
+            QVariant("Last Bake"),
+            QVariant("Draw (GPU)")
         };
         return headers[section];
     }
@@ -62,7 +162,7 @@ int SceneTableModel::columnCount(const QModelIndex &parent) const
     if (parent.isValid())
         return 0;
 
-    return 2;
+    return SceneColumn::COUNT;
 }
 
 QVariant SceneTableModel::data(const QModelIndex &index, int role) const
@@ -73,13 +173,38 @@ QVariant SceneTableModel::data(const QModelIndex &index, int role) const
     Project* project = Project::activeProject();
     Mesh *mesh = _meshes[index.row()];
 
-    if (role == Qt::CheckStateRole && index.column() == 0) {
+    if (role == Qt::CheckStateRole && index.column() == SceneColumn::VISIBLE) {
         if (project->meshVisible(mesh))
             return Qt::Checked;
         else
             return Qt::Unchecked;
-    } else if (role == Qt::DisplayRole && index.column() == 1) {
+    } else if (role == Qt::DisplayRole && index.column() == SceneColumn::NAME) {
+        return _meshes[index.row()]->meshName();
+    } else if (role == SCENE_SORT_ROLE && index.column() == SceneColumn::NAME) {
         return _meshes[index.row()]->meshName();
+    } else if (role == SCENE_MESH_ROLE) {
+        return QVariant::fromValue((void*)mesh);
+    }
+
+    if (index.column() < SceneColumn::TRIANGLES || (role != Qt::DisplayRole && role != SCENE_SORT_ROLE))
+        return QVariant();
+
+    MeshStatsEntry stats = MeshStats::instance()->stats(mesh);
+    bool display = role == Qt::DisplayRole;
+
+    switch (index.column()) {
+    case SceneColumn::TRIANGLES:
+        return stats.triangles;
+    case SceneColumn::VERTEX_BYTES:
+        return display ? QVariant(formatBytes(stats.vertexBytes)) : QVariant(stats.vertexBytes);
+    case SceneColumn::TEXTURE_SIZE:
+        return display ? QVariant(QString("%1 x %1").arg(stats.textureSize)) : QVariant(stats.textureSize);
+    case SceneColumn::TEXTURE_BYTES:
+        return display ? QVariant(formatBytes(stats.textureBytes)) : QVariant(stats.textureBytes);
+    case SceneColumn::BAKE_MS:
+        return display ? QVariant(formatMs(stats.lastBakeMs)) : QVariant(stats.lastBakeMs);
+    case SceneColumn::DRAW_GPU_MS:
+        return display ? QVariant(formatMs(stats.lastDrawGpuMs)) : QVariant(stats.lastDrawGpuMs);
     }
 
     return QVariant();
@@ -92,13 +217,34 @@ bool SceneTableModel::setData(const QModelIndex &index, const QVariant &value, i
 
     Project* project = Project::activeProject();
 
-    if (role == Qt::CheckStateRole && index.column() == 0) {
+    if (role == Qt::CheckStateRole && index.column() == SceneColumn::VISIBLE) {
         project->setMeshVisibility(_meshes[index.row()], value.toBool());
         emit dataChanged(index, index);
         return true;
-    } else if (index.column() == 1) {
-        _meshes[index.row()]->setMeshName(value.toString());
-        emit dataChanged(index, index);
+    } else if (index.column() == SceneColumn::NAME) {
+        Mesh* mesh = _meshes[index.row()];
+        QString name = value.toString();
+        mesh->setMeshName(name);
+
+        // move the row to its new place in name order, which onMeshAdded
+        // relies on. The others are still sorted, search around the row
+        auto after = [](const QString& key, Mesh* other) { return key < other->meshName(); };
+        int from = index.row();
+        int to = std::upper_bound(_meshes.begin(), _meshes.begin() + from, name, after) - _meshes.begin();
+        if (to == from) {
+            to = std::upper_bound(_meshes.begin() + from + 1, _meshes.end(), name, after) - _meshes.begin() - 1;
+        }
+        if (to != from) {
+            beginMoveRows(QModelIndex(), from, from, QModelIndex(), to > from ? to + 1 : to);
+            _meshes.remove(from);
+            _meshes.insert(to, mesh);
+            reindex(this, _meshes, std::min(from, to), std::max(from, to) + 1);
+            endMoveRows();
+        }
+
+        MeshNameIndex::instance()->renameMesh(mesh);
+        QModelIndex moved = this->index(to, SceneColumn::NAME);
+        emit dataChanged(moved, moved);
         return true;
     }
 
@@ -111,11 +257,19 @@ Qt::ItemFlags SceneTableModel::flags(const QModelIndex &index) const
         return QAbstractTableModel::flags(index) | Qt::ItemIsEnabled;
     }
 
-    if (index.column() == 0) {
+    if (index.column() == SceneColumn::VISIBLE) {
         return QAbstractTableModel::flags(index) | Qt::ItemIsUserCheckable | Qt::ItemIsEnabled;
-    } else if (index.column() == 1) {
+    } else if (index.column() == SceneColumn::NAME) {
         return QAbstractTableModel::flags(index) | Qt::ItemIsEditable | Qt::ItemIsEnabled;
     }
 
     return QAbstractTableModel::flags(index) | Qt::ItemIsEnabled;
 }
+
+int SceneRows::row(const QAbstractItemModel *model, Mesh *mesh)
+{
+    QHash<const QAbstractItemModel*, QHash<Mesh*, int> >::const_iterator rows = rowTables.constFind(model);
+    if (rows == rowTables.constEnd())
+        return -1;
+    return rows->value(mesh, -1);
+}
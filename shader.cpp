@@ -36,6 +36,34 @@ QOpenGLShaderProgram* ShaderFactory::buildMeshShader(QObject *parent)
                             resourceToString(":/main/resources/shaders/mesh.frag"));
 }
 
+// copies of shared geometry in one instanced draw, each with its own
+// transform and texture array layer. Only drawn while navigating, the
+// primitive id target gets nothing as bakes test the ids of settled frames
+QOpenGLShaderProgram* ShaderFactory::buildInstancedMeshShader(QObject *parent)
+{
+    QString vertCode = "#version 130\n"
+            "uniform mat4 cameraPV;\n"
+            "in vec4 position;\n"
+            "in vec2 in_uvs;\n"
+            "in mat4 instanceObjToWorld;\n"
+            "in float instanceLayer;\n"
+            "out vec3 uv;\n"
+            "void main() {\n"
+            "    uv = vec3(in_uvs, instanceLayer);\n"
+            "    gl_Position = cameraPV * instanceObjToWorld * vec4(position.xyz, 1.0);\n"
+            "}\n";
+
+    QString fragCode = "#version 130\n"
+            "uniform sampler2DArray meshTextures;\n"
+            "in vec3 uv;\n"
+            "void main() {\n"
+            "    gl_FragData[0] = texture(meshTextures, uv);\n"
+            "    gl_FragData[1] = vec4(0.0);\n"
+            "}\n";
+
+    return shadersToProgram(parent, vertCode, fragCode);
+}
+
 QOpenGLShaderProgram* ShaderFactory::buildBakeShader(QObject *parent)
 {
     return shadersToProgram(parent,
@@ -43,9 +71,87 @@ QOpenGLShaderProgram* ShaderFactory::buildBakeShader(QObject *parent)
                             resourceToString(":/main/resources/shaders/bake.frag"));
 }
 
+// lets a bake through only as far as the mesh's mask: mixes the target
+// before the bake with the baked texels over the unit square. The baked copy
+// has the size of the transfer fbo, bakedScale maps the target's uvs into it
+QOpenGLShaderProgram* ShaderFactory::buildMaskMixShader(QObject *parent)
+{
+    QString vertCode = VERSION_STRING
+            "varying vec2 uv;\n"
+            "void main() {\n"
+            "    uv = gl_Vertex.xy;\n"
+            "    gl_Position = vec4(gl_Vertex.xy * 2.0 - 1.0, 0.0, 1.0);\n"
+            "}\n";
+
+    QString fragCode = VERSION_STRING
+            "uniform sampler2D targetTexture;\n"
+            "uniform sampler2D bakedTexture;\n"
+            "uniform sampler2D maskTexture;\n"
+            "uniform float bakedScale;\n"
+            "varying vec2 uv;\n"
+            "void main() {\n"
+            "    vec4 before = texture2D(targetTexture, uv);\n"
+            "    vec4 baked = texture2D(bakedTexture, uv * bakedScale);\n"
+            "    gl_FragColor = mix(before, baked, texture2D(maskTexture, uv).r);\n"
+            "}\n";
+
+    return shadersToProgram(parent, vertCode, fragCode);
+}
+
 QOpenGLShaderProgram* ShaderFactory::buildPaintDebugShader(QObject *parent)
 {
     return shadersToProgram(parent,
                             resourceToString(":/main/resources/shaders/paint_debug.vert"),
                             resourceToString(":/main/resources/shaders/paint_debug.frag"));
 }
+
+// draws a layer over the unit square as premultiplied color, the blend mode
+// itself is set up with glBlendFunc by the caller
+QOpenGLShaderProgram* ShaderFactory::buildLayerCompositeShader(QObject *parent)
+{
+    QString vertCode = VERSION_STRING
+            "varying vec2 uv;\n"
+            "void main() {\n"
+            "    uv = gl_Vertex.xy;\n"
+            "    gl_Position = vec4(gl_Vertex.xy * 2.0 - 1.0, 0.0, 1.0);\n"
+            "}\n";
+
+    QString fragCode = VERSION_STRING
+            "uniform sampler2D layerTexture;\n"
+            "uniform float opacity;\n"
+            "uniform float premultiplied;\n"
+            "varying vec2 uv;\n"
+            "void main() {\n"
+            "    vec4 color = texture2D(layerTexture, uv);\n"
+            "    if (premultiplied < 0.5)\n"
+            "        color.rgb *= color.a;\n"
+            "    gl_FragColor = color * opacity;\n"
+            "}\n";
+
+    return shadersToProgram(parent, vertCode, fragCode);
+}
+
+// immediate mode brush quads sampling one layer of the preset array,
+// modulated by the current color like the fixed function path
+QOpenGLShaderProgram* ShaderFactory::buildBrushStrokeShader(QObject *parent)
+{
+    QString vertCode = "#version 130\n"
+            "out vec2 uv;\n"
+            "void main() {\n"
+            "    uv = gl_MultiTexCoord0.xy;\n"
+            "    gl_FrontColor = gl_Color;\n"
+            "    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;\n"
+            "}\n";
+
+    QString fragCode = "#version 130\n"
+            "uniform sampler2DArray brushTextures;\n"
+            "uniform float layer;\n"
+            "uniform float opacity;\n"
+            "in vec2 uv;\n"
+            "void main() {\n"
+            "    vec4 color = texture(brushTextures, vec3(uv, layer)) * gl_Color;\n"
+            "    gl_FragColor = vec4(color.rgb, color.a * opacity);\n"
+            "}\n";
+
+    return shadersToProgram(parent, vertCode, fragCode);
+}
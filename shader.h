@@ -11,8 +11,12 @@ class ShaderFactory
 public:
     static QOpenGLShaderProgram* buildShader(QObject* parent, QString vertFile, QString fragFile);
     static QOpenGLShaderProgram* buildMeshShader(QObject* parent);
+    static QOpenGLShaderProgram* buildInstancedMeshShader(QObject* parent);
     static QOpenGLShaderProgram* buildBakeShader(QObject* parent);
+    static QOpenGLShaderProgram* buildMaskMixShader(QObject* parent);
     static QOpenGLShaderProgram* buildPaintDebugShader(QObject* parent);
+    static QOpenGLShaderProgram* buildLayerCompositeShader(QObject* parent);
+    static QOpenGLShaderProgram* buildBrushStrokeShader(QObject* parent);
 };
 
 #endif // SHADER_H
@@ -0,0 +1,163 @@
+#include "strokejournal.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <iostream>
+
+#define JOURNAL_MAGIC 0x50424a4c // "PBJL"
+#define JOURNAL_VERSION 2 // 2: sub-pixel mouse positions
+
+namespace {
+    QFile* journalFile = 0;
+    QDataStream* journalStream = 0;
+    QElapsedTimer journalClock;
+    bool stopOnExit = false;
+}
+
+bool StrokeJournal::startRecording(QString path)
+{
+    stopRecording();
+
+    journalFile = new QFile(path);
+    if (!journalFile->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        std::cerr << "unable to open journal for writing: " << path.toStdString() << std::endl;
+        delete journalFile;
+        journalFile = 0;
+        return false;
+    }
+
+    journalStream = new QDataStream(journalFile);
+    journalStream->setVersion(QDataStream::Qt_5_0);
+    journalStream->setFloatingPointPrecision(QDataStream::SinglePrecision);
+    *journalStream << (quint32)JOURNAL_MAGIC << (quint32)JOURNAL_VERSION;
+
+    journalClock.start();
+
+    // the buffered tail reaches the file even if nobody stops recording
+    if (!stopOnExit) {
+        qAddPostRoutine(stopRecording);
+        stopOnExit = true;
+    }
+    return true;
+}
+
+void StrokeJournal::stopRecording()
+{
+    if (!journalFile)
+        return;
+
+    delete journalStream;
+    journalStream = 0;
+    journalFile->close();
+    delete journalFile;
+    journalFile = 0;
+}
+
+bool StrokeJournal::isRecording()
+{
+    return journalStream != 0;
+}
+
+qint64 StrokeJournal::elapsed()
+{
+    return journalClock.isValid() ? journalClock.nsecsElapsed() : 0;
+}
+
+void StrokeJournal::record(const JournalEntry& e)
+{
+    if (!journalStream)
+        return;
+
+    QDataStream& s = *journalStream;
+    s << e.type << e.view << e.time;
+
+    switch (e.type) {
+    case JournalEvent::VIEW_SIZE:
+        s << (qint32)e.size.width() << (qint32)e.size.height();
+        break;
+    case JournalEvent::CAMERA:
+        s << e.cameraCenter << e.cameraYRot << e.cameraUpRot << e.cameraFov;
+        break;
+    case JournalEvent::BRUSH:
+        s << e.brushSize << e.brushColor.rgba();
+        break;
+    case JournalEvent::MOUSE_PRESS:
+    case JournalEvent::MOUSE_MOVE:
+    case JournalEvent::MOUSE_RELEASE:
+        s << (float)e.pos.x() << (float)e.pos.y() << e.button << e.buttons << e.modifiers << e.eventTimestamp;
+        break;
+    case JournalEvent::KEY_PRESS:
+        s << e.key << e.modifiers;
+        break;
+    case JournalEvent::BAKE:
+        s << e.bakeMs;
+        break;
+    }
+}
+
+bool StrokeJournal::load(QString path, QVector<JournalEntry>& entries)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        std::cerr << "unable to open journal: " << path.toStdString() << std::endl;
+        return false;
+    }
+
+    QDataStream s(&file);
+    s.setVersion(QDataStream::Qt_5_0);
+    s.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    quint32 magic, version;
+    s >> magic >> version;
+    if (magic != JOURNAL_MAGIC || version != JOURNAL_VERSION) {
+        std::cerr << "not a stroke journal or unsupported version: " << path.toStdString() << std::endl;
+        return false;
+    }
+
+    entries.clear();
+    while (!s.atEnd()) {
+        JournalEntry e;
+        s >> e.type >> e.view >> e.time;
+
+        qint32 x, y;
+        float px, py;
+        QRgb rgba;
+        switch (e.type) {
+        case JournalEvent::VIEW_SIZE:
+            s >> x >> y;
+            e.size = QSize(x, y);
+            break;
+        case JournalEvent::CAMERA:
+            s >> e.cameraCenter >> e.cameraYRot >> e.cameraUpRot >> e.cameraFov;
+            break;
+        case JournalEvent::BRUSH:
+            s >> e.brushSize >> rgba;
+            e.brushColor = QColor::fromRgba(rgba);
+            break;
+        case JournalEvent::MOUSE_PRESS:
+        case JournalEvent::MOUSE_MOVE:
+        case JournalEvent::MOUSE_RELEASE:
+            s >> px >> py >> e.button >> e.buttons >> e.modifiers >> e.eventTimestamp;
+            e.pos = QPointF(px, py);
+            break;
+        case JournalEvent::KEY_PRESS:
+            s >> e.key >> e.modifiers;
+            break;
+        case JournalEvent::BAKE:
+            s >> e.bakeMs;
+            break;
+        default:
+            std::cerr << "corrupt journal entry, stopping at " << entries.size() << " entries" << std::endl;
+            return !entries.isEmpty();
+        }
+
+        if (s.status() != QDataStream::Ok)
+            break; // truncated tail from an interrupted session
+
+        entries.append(e);
+    }
+
+    return true;
+}
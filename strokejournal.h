@@ -0,0 +1,64 @@
+#ifndef STROKEJOURNAL_H
+#define STROKEJOURNAL_H
+
+#include <QVector>
+#include <QString>
+#include <QPointF>
+#include <QSize>
+#include <QColor>
+#include <QVector3D>
+
+namespace JournalEvent {
+    enum { VIEW_SIZE, CAMERA, BRUSH, MOUSE_PRESS, MOUSE_MOVE, MOUSE_RELEASE, KEY_PRESS, BAKE };
+}
+
+// one recorded input event. Only the fields relevant to the event type are
+// written to disk.
+struct JournalEntry
+{
+    quint8 type = JournalEvent::MOUSE_MOVE;
+    quint8 view = 0;          // index into GLView::views()
+    qint64 time = 0;          // nanoseconds since recording started
+
+    // VIEW_SIZE, mouse events
+    QPointF pos;              // QMouseEvent::localPos(), strokes are sub-pixel
+    QSize size;
+    quint32 button = 0;
+    quint32 buttons = 0;
+    quint32 modifiers = 0;
+    quint64 eventTimestamp = 0; // QInputEvent::timestamp() in ms
+
+    // KEY_PRESS
+    qint32 key = 0;
+
+    // BRUSH
+    qint32 brushSize = 0;
+    QColor brushColor;
+
+    // CAMERA
+    QVector3D cameraCenter;
+    float cameraYRot = 0;
+    float cameraUpRot = 0;
+    float cameraFov = 0;
+
+    // BAKE
+    float bakeMs = 0;
+};
+
+// compact binary log of everything needed to reproduce a painting session.
+// Records are appended as they happen and flushed when recording stops.
+class StrokeJournal
+{
+public:
+    static bool startRecording(QString path);
+    static void stopRecording();
+    static bool isRecording();
+
+    // nanoseconds since recording started
+    static qint64 elapsed();
+    static void record(const JournalEntry& entry);
+
+    static bool load(QString path, QVector<JournalEntry>& entries);
+};
+
+#endif // STROKEJOURNAL_H
@@ -0,0 +1,216 @@
+#include "texeldensity.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QVector3D>
+#include <algorithm>
+#include <cmath>
+
+#include "project.h"
+#include "glcache.h"
+#include "geometrystore.h"
+#include "texturemips.h"
+#include "textureresidency.h"
+#include "texturecompression.h"
+#include "paintlayers.h"
+#include "painthistory.h"
+#include "projectarchive.h"
+#include "profiler.h"
+
+namespace {
+    struct MeshAreas
+    {
+        double surface = 0;
+        double uv = 0;
+    };
+
+    QHash<Mesh*, MeshAreas> areaTable;
+    float density = TEXEL_DENSITY_TARGET;
+    qint64 budgetBytes = (qint64)TEXEL_DENSITY_BUDGET_MB * 1024 * 1024;
+
+    // sizes of the last plan, until meshes or settings change
+    QHash<Mesh*, int> cachedPlan;
+    bool planValid = false;
+
+    const MeshAreas& meshAreas(Mesh* mesh)
+    {
+        if (areaTable.contains(mesh))
+            return areaTable[mesh];
+
+        GeometryStore::ensureHostGeometry(mesh);
+
+        MeshAreas areas;
+        const int vertexCount = mesh->_vertices.size() / 3;
+        const int uvStride = vertexCount > 0 ? mesh->_uvs.size() / vertexCount : 0;
+        const int triangleCount = mesh->_triangleIndices.size() / 3;
+        const float* positions = mesh->_vertices.constData();
+        const float* uvs = mesh->_uvs.constData();
+
+        for (int t = 0; t < triangleCount; t++) {
+            int v[3];
+            for (int c = 0; c < 3; c++) {
+                v[c] = mesh->_triangleIndices[t * 3 + c];
+            }
+
+            QVector3D p0(positions[v[0]*3], positions[v[0]*3+1], positions[v[0]*3+2]);
+            QVector3D p1(positions[v[1]*3], positions[v[1]*3+1], positions[v[1]*3+2]);
+            QVector3D p2(positions[v[2]*3], positions[v[2]*3+1], positions[v[2]*3+2]);
+            areas.surface += 0.5 * QVector3D::crossProduct(p1 - p0, p2 - p0).length();
+
+            if (uvStride >= 2) {
+                float u0 = uvs[v[0]*uvStride], w0 = uvs[v[0]*uvStride+1];
+                float u1 = uvs[v[1]*uvStride], w1 = uvs[v[1]*uvStride+1];
+                float u2 = uvs[v[2]*uvStride], w2 = uvs[v[2]*uvStride+1];
+                areas.uv += 0.5 * std::fabs((u1 - u0) * (w2 - w0) - (w1 - w0) * (u2 - u0));
+            }
+        }
+
+        areaTable.insert(mesh, areas);
+        return areaTable[mesh];
+    }
+}
+
+float TexelDensity::targetDensity()
+{
+    return density;
+}
+
+void TexelDensity::setTargetDensity(float texelsPerUnit)
+{
+    density = texelsPerUnit;
+    planValid = false;
+}
+
+qint64 TexelDensity::budget()
+{
+    return budgetBytes;
+}
+
+void TexelDensity::setBudget(qint64 bytes)
+{
+    budgetBytes = bytes;
+    planValid = false;
+}
+
+double TexelDensity::surfaceArea(Mesh *mesh)
+{
+    return meshAreas(mesh).surface;
+}
+
+double TexelDensity::uvArea(Mesh *mesh)
+{
+    return meshAreas(mesh).uv;
+}
+
+int TexelDensity::idealSize(Mesh *mesh)
+{
+    const MeshAreas& areas = meshAreas(mesh);
+    if (areas.surface <= 0 || areas.uv <= 0)
+        return TEXEL_DENSITY_DEFAULT_SIZE;
+
+    // size * sqrt(uv / surface) texels per world unit
+    double exact = density * std::sqrt(areas.surface / areas.uv);
+    int size = 1 << std::max(0, (int)std::lround(std::log2(exact)));
+    return std::max(TEXEL_DENSITY_MIN_SIZE, std::min(TEXEL_DENSITY_MAX_SIZE, size));
+}
+
+QHash<Mesh*, int> TexelDensity::plan()
+{
+    QVector<Mesh*> meshes = Project::activeProject()->meshes();
+
+    QHash<Mesh*, int> sizes;
+    qint64 total = 0;
+    foreach (Mesh* mesh, meshes) {
+        int size = idealSize(mesh);
+        sizes.insert(mesh, size);
+        total += textureBytes(size);
+    }
+
+    // halve the largest textures first, in project order within a size
+    for (int size = TEXEL_DENSITY_MAX_SIZE; size > TEXEL_DENSITY_MIN_SIZE && total > budgetBytes; size /= 2) {
+        foreach (Mesh* mesh, meshes) {
+            if (total <= budgetBytes)
+                break;
+            if (sizes[mesh] == size) {
+                sizes[mesh] = size / 2;
+                total -= textureBytes(size) - textureBytes(size / 2);
+            }
+        }
+    }
+
+    cachedPlan = sizes;
+    planValid = true;
+    return sizes;
+}
+
+int TexelDensity::plannedSize(Mesh *mesh)
+{
+    // meshes added since the last plan join a new one
+    if (!planValid || !cachedPlan.contains(mesh)) {
+        plan();
+    }
+    return cachedPlan.value(mesh, TEXEL_DENSITY_DEFAULT_SIZE);
+}
+
+int TexelDensity::replan()
+{
+    QHash<Mesh*, int> sizes = plan();
+    QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+
+    qint64 before = 0, after = 0;
+    int changed = 0;
+    foreach (Mesh* mesh, Project::activeProject()->meshes()) {
+        // meshes without a texture yet get the planned size on first draw
+        if (!GLCache::hasMeshTexture(mesh) && !TextureResidency::isEvicted(mesh))
+            continue;
+
+        int size = sizes.value(mesh, mesh->textureSize());
+        before += textureBytes(mesh->textureSize());
+        after += textureBytes(size);
+        if (size == mesh->textureSize())
+            continue;
+
+        TextureResidency::ensureResident(mesh);
+        TextureCompression::ensureUncompressed(mesh);
+        if (!GLCache::hasMeshTexture(mesh))
+            continue;
+
+        // the mesh texture holds the flattened layers, the stack and the
+        // undo tiles are resampled along so painting carries on as before
+        int previousSize = mesh->textureSize();
+        GLuint previous = GLCache::meshTextureId(mesh);
+        GLuint texture = TextureMips::resample(previous, previousSize, size, true);
+        GLCache::removeMeshTexture(mesh);
+        f->glDeleteTextures(1, &previous);
+
+        TextureResidency::forgetMesh(mesh);
+        TextureCompression::forgetMesh(mesh);
+        PaintLayers::resizeMesh(mesh, size);
+        PaintHistory::resizeMesh(mesh, previousSize, size);
+
+        mesh->setTextureSize(size);
+        GLCache::setMeshTexture(mesh, texture);
+        TextureResidency::registerTexture(mesh, size);
+        ProjectArchive::instance()->markTextureDirty(mesh);
+        changed++;
+    }
+
+    QString report = QString("%1 MB before, %2 MB after, %3 textures resampled at %4 texels per unit")
+            .arg(before / (1024.0 * 1024.0), 0, 'f', 1).arg(after / (1024.0 * 1024.0), 0, 'f', 1)
+            .arg(changed).arg(density, 0, 'f', 0);
+    Profiler::setCounter("texel density", report);
+
+    return changed;
+}
+
+qint64 TexelDensity::textureBytes(int size)
+{
+    return (qint64)size * size * 4 * 4 / 3;
+}
+
+void TexelDensity::forgetMesh(Mesh *mesh)
+{
+    areaTable.remove(mesh);
+    cachedPlan.remove(mesh);
+    planValid = false;
+}
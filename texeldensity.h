@@ -0,0 +1,52 @@
+#ifndef TEXELDENSITY_H
+#define TEXELDENSITY_H
+
+#include <QHash>
+
+#include "mesh.h"
+
+#define TEXEL_DENSITY_TARGET 256.0f // texels per world unit
+#define TEXEL_DENSITY_BUDGET_MB 512 // all mesh textures, mips included
+#define TEXEL_DENSITY_MIN_SIZE 64
+#define TEXEL_DENSITY_MAX_SIZE 2048 // bakes go through the PAINT_FBO_WIDTH transfer target
+#define TEXEL_DENSITY_DEFAULT_SIZE 256 // meshes without area or uvs
+
+// picks mesh texture sizes from texel density. A mesh's world surface area
+// and the share of the uv square its triangles cover give the size at which
+// one world unit gets the target number of texels, rounded to a power of
+// two. When the sizes don't fit the budget the largest textures are halved
+// until they do, so small meshes don't lose their detail to big ones.
+//
+// Overlapping or mirrored uvs count once per triangle, such meshes get a
+// texture larger than they need.
+class TexelDensity
+{
+public:
+    static float targetDensity();
+    static void setTargetDensity(float texelsPerUnit);
+    static qint64 budget();
+    static void setBudget(qint64 bytes);
+
+    // cached until the mesh is forgotten
+    static double surfaceArea(Mesh* mesh);
+    static double uvArea(Mesh* mesh);
+
+    // power of two size reaching the target density, ignoring the budget
+    static int idealSize(Mesh* mesh);
+
+    // sizes for every mesh of the active project within the budget
+    static QHash<Mesh*, int> plan();
+    static int plannedSize(Mesh* mesh);
+
+    // resamples existing textures to the planned sizes with the shared GL
+    // context current, along with their paint layers and undo history.
+    // Returns how many textures changed.
+    static int replan();
+
+    // RGBA8 with a full mip chain
+    static qint64 textureBytes(int size);
+
+    static void forgetMesh(Mesh* mesh);
+};
+
+#endif // TEXELDENSITY_H
@@ -1,6 +1,8 @@
 #include "texturebaker.h"
 
 #include "glcache.h"
+#include "textureresidency.h"
+#include "texturecompression.h"
 
 TextureBaker::TextureBaker(QWidget *parent) : QOpenGLWidget(parent)
 {
@@ -12,23 +14,20 @@ bool TextureBaker::writeTextureToFile(Mesh *mesh)
 {
     makeCurrent();
 
+    TextureResidency::ensureResident(mesh);
     if (!GLCache::hasMeshTexture(mesh)) {
         return false;
     }
 
-    GLuint textureId = GLCache::meshTextureId(mesh);
     QString path = mesh->texturePath();
     const int size = mesh->textureSize();
 
-    const int NUM_COLOR_CHANNELS = 3;
-    GLubyte* data = new GLubyte[size* size * NUM_COLOR_CHANNELS];
-
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textureId);
-    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, (void*)data);
+    QByteArray pixels;
+    TextureCompression::readPixels(mesh, pixels);
 
-    QImage out(data, size, size, QImage::Format_RGB888);
-    out.mirrored().save(path);
+    QImage out((const uchar*)pixels.constData(), size, size, QImage::Format_RGBA8888);
+    out.convertToFormat(QImage::Format_RGB888).mirrored().save(path);
 
     return true;
 }
@@ -0,0 +1,315 @@
+#include "texturecompression.h"
+
+#include <QHash>
+#include <QElapsedTimer>
+#include <QOpenGLContext>
+#include <QtConcurrent>
+#include <algorithm>
+
+#include "project.h"
+#include "glcache.h"
+#include "blockencoder.h"
+#include "texturemips.h"
+#include "textureresidency.h"
+#include "profiler.h"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+#define ENCODE_BLOCK_ROWS_PER_TASK 16
+
+namespace {
+    struct EncodedTexture
+    {
+        int size = 0;
+        bool alpha = false;
+        QVector<QByteArray> levels;
+        QByteArray original; // qCompress'd RGBA8 level 0
+    };
+
+    struct CompressionEntry
+    {
+        qint64 lastPaintedMs = 0;
+        quint64 generation = 0; // bumped by paint, stale encodes are dropped
+
+        QFuture<EncodedTexture> encoding;
+        quint64 encodingGeneration = 0;
+
+        GLuint compressedTexture = 0; // matches GLCache while compressed
+        qint64 compressedBytes = 0;
+        QByteArray original; // exact pixels while compressed, the blocks are lossy
+    };
+
+    QHash<Mesh*, CompressionEntry> entries;
+    QElapsedTimer clock;
+    int supported = -1;
+
+    qint64 now()
+    {
+        if (!clock.isValid()) {
+            clock.start();
+        }
+        return clock.elapsed();
+    }
+
+    QByteArray downsample(const QByteArray& pixels, int size)
+    {
+        int half = std::max(size / 2, 1);
+        QByteArray result(half * half * 4, Qt::Uninitialized);
+        const uchar* src = (const uchar*)pixels.constData();
+        uchar* dst = (uchar*)result.data();
+
+        for (int y = 0; y < half; y++) {
+            int y0 = std::min(y * 2, size - 1), y1 = std::min(y * 2 + 1, size - 1);
+            for (int x = 0; x < half; x++) {
+                int x0 = std::min(x * 2, size - 1), x1 = std::min(x * 2 + 1, size - 1);
+                for (int c = 0; c < 4; c++) {
+                    int sum = src[(y0 * size + x0) * 4 + c] + src[(y0 * size + x1) * 4 + c]
+                            + src[(y1 * size + x0) * 4 + c] + src[(y1 * size + x1) * 4 + c];
+                    dst[(y * half + x) * 4 + c] = (sum + 2) / 4;
+                }
+            }
+        }
+        return result;
+    }
+
+    EncodedTexture encode(QByteArray pixels, int size)
+    {
+        EncodedTexture encoded;
+        encoded.size = size;
+        encoded.alpha = BlockEncoder::hasAlpha((const uchar*)pixels.constData(), size * size);
+        // fast compression level, paint textures are mostly flat color
+        encoded.original = qCompress(pixels, 1);
+
+        int levels = MESH_TEXTURE_MIPMAPS ? TextureMips::levelCount(size) : 1;
+        int levelSize = size;
+
+        for (int level = 0; level < levels; level++) {
+            QByteArray blocks(BlockEncoder::encodedSize(levelSize, levelSize, encoded.alpha), Qt::Uninitialized);
+
+            // split the block rows across the pool
+            QVector<int> firstRows;
+            int blockRows = (levelSize + 3) / 4;
+            for (int row = 0; row < blockRows; row += ENCODE_BLOCK_ROWS_PER_TASK) {
+                firstRows.append(row);
+            }
+
+            const uchar* src = (const uchar*)pixels.constData();
+            uchar* dst = (uchar*)blocks.data();
+            bool alpha = encoded.alpha;
+            QtConcurrent::blockingMap(firstRows, [=](int first) {
+                BlockEncoder::encodeRows(src, levelSize, levelSize, alpha, dst, first,
+                                         std::min(first + ENCODE_BLOCK_ROWS_PER_TASK, blockRows));
+            });
+
+            encoded.levels.append(blocks);
+
+            if (level + 1 < levels) {
+                pixels = downsample(pixels, levelSize);
+                levelSize = std::max(levelSize / 2, 1);
+            }
+        }
+
+        return encoded;
+    }
+
+    void swapTexture(Mesh* mesh, GLuint texture, qint64 bytes)
+    {
+        GLuint previous = GLCache::removeMeshTexture(mesh);
+        glDeleteTextures(1, &previous);
+        GLCache::setMeshTexture(mesh, texture);
+        TextureResidency::setTextureBytes(mesh, bytes);
+    }
+
+    void finishEncode(Mesh* mesh, CompressionEntry& entry)
+    {
+        EncodedTexture encoded = entry.encoding.result();
+        entry.encoding = QFuture<EncodedTexture>();
+
+        // painted, evicted or resized while encoding
+        if (entry.encodingGeneration != entry.generation || !GLCache::hasMeshTexture(mesh) ||
+            TextureResidency::isEvicted(mesh) || mesh->textureSize() != encoded.size)
+            return;
+
+        QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+        GLenum format = encoded.alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+
+        GLuint texture;
+        f->glGenTextures(1, &texture);
+        f->glBindTexture(GL_TEXTURE_2D, texture);
+
+        qint64 bytes = 0;
+        int levelSize = encoded.size;
+        for (int level = 0; level < encoded.levels.size(); level++) {
+            const QByteArray& blocks = encoded.levels[level];
+            f->glCompressedTexImage2D(GL_TEXTURE_2D, level, format, levelSize, levelSize, 0, blocks.size(), blocks.constData());
+            bytes += blocks.size();
+            levelSize = std::max(levelSize / 2, 1);
+        }
+
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, encoded.levels.size() - 1);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, encoded.levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        swapTexture(mesh, texture, bytes);
+        entry.compressedTexture = texture;
+        entry.compressedBytes = bytes;
+        entry.original = encoded.original;
+    }
+
+    void startEncode(Mesh* mesh, CompressionEntry& entry)
+    {
+        const int size = mesh->textureSize();
+        QByteArray pixels(size * size * 4, Qt::Uninitialized);
+        glBindTexture(GL_TEXTURE_2D, GLCache::meshTextureId(mesh));
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+        entry.encodingGeneration = entry.generation;
+        entry.encoding = QtConcurrent::run([pixels, size]() { return encode(pixels, size); });
+    }
+}
+
+bool TextureCompression::isSupported()
+{
+    if (supported < 0) {
+        supported = QOpenGLContext::currentContext()->hasExtension("GL_EXT_texture_compression_s3tc") ? 1 : 0;
+    }
+    return TEXTURE_COMPRESSION && supported;
+}
+
+void TextureCompression::markPainted(Mesh *mesh)
+{
+    CompressionEntry& entry = entries[mesh];
+    entry.lastPaintedMs = now();
+    entry.generation++;
+}
+
+void TextureCompression::update()
+{
+    if (!isSupported())
+        return;
+
+    // meshes not tracked yet count as painted now
+    foreach (Mesh* mesh, Project::activeProject()->meshes()) {
+        if (!entries.contains(mesh) && GLCache::hasMeshTexture(mesh)) {
+            markPainted(mesh);
+        }
+    }
+
+    qint64 time = now();
+    int running = 0;
+    bool startedReadback = false;
+
+    QMutableHashIterator<Mesh*, CompressionEntry> it(entries);
+    while (it.hasNext()) {
+        it.next();
+        CompressionEntry& entry = it.value();
+        if (entry.original.size() && !isCompressed(it.key())) {
+            // replaced behind our back, by an eviction restoring the exact pixels
+            entry.compressedTexture = 0;
+            entry.compressedBytes = 0;
+            entry.original = QByteArray();
+        }
+        if (entry.encoding.isRunning()) {
+            running++;
+        } else if (entry.encoding.isFinished() && entry.encoding.resultCount() > 0) {
+            finishEncode(it.key(), entry);
+        }
+    }
+
+    QMutableHashIterator<Mesh*, CompressionEntry> idle(entries);
+    while (idle.hasNext() && running < MAX_CONCURRENT_ENCODES && !startedReadback) {
+        idle.next();
+        Mesh* mesh = idle.key();
+        CompressionEntry& entry = idle.value();
+
+        if (entry.encoding.isRunning() || isCompressed(mesh))
+            continue;
+        if (time - entry.lastPaintedMs < IDLE_COMPRESS_SECONDS * 1000)
+            continue;
+        if (!GLCache::hasMeshTexture(mesh) || TextureResidency::isEvicted(mesh))
+            continue;
+
+        // one readback per frame keeps the stall small
+        startEncode(mesh, entry);
+        startedReadback = true;
+    }
+
+    Profiler::setCounter("compression", QString("%1 MB saved").arg(savedBytes() / (1024 * 1024)));
+}
+
+bool TextureCompression::isCompressed(Mesh *mesh)
+{
+    if (!entries.contains(mesh))
+        return false;
+
+    const CompressionEntry& entry = entries[mesh];
+    return entry.compressedTexture && GLCache::hasMeshTexture(mesh) &&
+           GLCache::meshTextureId(mesh) == entry.compressedTexture;
+}
+
+void TextureCompression::ensureUncompressed(Mesh *mesh)
+{
+    if (!isCompressed(mesh)) {
+        if (entries.contains(mesh)) {
+            markPainted(mesh); // about to be written to
+        }
+        return;
+    }
+
+    // back to the pixels from before the encode, not the decoded blocks,
+    // so idle cycles don't add up compression loss
+    const int size = mesh->textureSize();
+    QByteArray pixels;
+    readPixels(mesh, pixels);
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.constData());
+    TextureMips::generate(texture);
+
+    swapTexture(mesh, texture, (qint64)size * size * 4);
+
+    CompressionEntry& entry = entries[mesh];
+    entry.compressedTexture = 0;
+    entry.compressedBytes = 0;
+    entry.original = QByteArray();
+    markPainted(mesh);
+}
+
+void TextureCompression::readPixels(Mesh *mesh, QByteArray &pixels)
+{
+    if (isCompressed(mesh)) {
+        pixels = qUncompress(entries[mesh].original);
+        return;
+    }
+
+    const int size = mesh->textureSize();
+    pixels.resize(size * size * 4);
+    glBindTexture(GL_TEXTURE_2D, GLCache::meshTextureId(mesh));
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+}
+
+void TextureCompression::forgetMesh(Mesh *mesh)
+{
+    entries.remove(mesh); // a running encode finishes on its own
+}
+
+qint64 TextureCompression::savedBytes()
+{
+    qint64 saved = 0;
+    QHashIterator<Mesh*, CompressionEntry> it(entries);
+    while (it.hasNext()) {
+        it.next();
+        if (isCompressed(it.key())) {
+            qint64 size = it.key()->textureSize();
+            saved += size * size * 4 - it.value().compressedBytes;
+        }
+    }
+    return saved;
+}
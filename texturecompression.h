@@ -0,0 +1,42 @@
+#ifndef TEXTURECOMPRESSION_H
+#define TEXTURECOMPRESSION_H
+
+#include <QOpenGLFunctions>
+
+#include "mesh.h"
+
+#define TEXTURE_COMPRESSION 1
+#define IDLE_COMPRESS_SECONDS 60
+#define MAX_CONCURRENT_ENCODES 2
+
+// transcodes textures of meshes nobody painted for IDLE_COMPRESS_SECONDS to
+// BC1 (opaque) or BC3 (with alpha) on worker threads, cutting their VRAM to
+// 1/8 or 1/4. Compressed textures can't be rendered to, so anything writing
+// to a mesh texture calls ensureUncompressed first. The blocks are lossy, so
+// the exact pixels stay on the host, deflated, and anything reading a mesh
+// texture back goes through readPixels.
+//
+// All functions need the shared GL context to be current.
+class TextureCompression
+{
+public:
+    static bool isSupported();
+
+    static void markPainted(Mesh* mesh);
+
+    // once per drawn frame, swaps in finished encodes and starts new ones
+    static void update();
+
+    static bool isCompressed(Mesh* mesh);
+    // turns the mesh texture back into RGBA8, blocks on the GPU readback
+    static void ensureUncompressed(Mesh* mesh);
+    // RGBA8 level 0 of the resident mesh texture, the exact pixels while
+    // it's compressed
+    static void readPixels(Mesh* mesh, QByteArray& pixels);
+
+    static void forgetMesh(Mesh* mesh);
+
+    static qint64 savedBytes();
+};
+
+#endif // TEXTURECOMPRESSION_H
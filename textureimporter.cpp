@@ -0,0 +1,362 @@
+#include "textureimporter.h"
+
+#include <QFileInfo>
+#include <QImageReader>
+#include <QOpenGLContext>
+#include <QFutureWatcher>
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
+#include <string.h>
+#include <iostream>
+
+#include "project.h"
+#include "glcache.h"
+#include "texturemips.h"
+#include "textureresidency.h"
+#include "texturecompression.h"
+#include "paintlayers.h"
+#include "painthistory.h"
+#include "projectarchive.h"
+#include "glview.h"
+#include "profiler.h"
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+#define TEXTURE_IMPORT_FALLBACK_MAX_SIZE 8192 // until the GL limit is known
+
+namespace {
+    typedef void (QOPENGLF_APIENTRYP BufferStorage)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+    const qint64 MB = 1024 * 1024;
+    const qint64 SEGMENT_BYTES = TEXTURE_UPLOAD_SEGMENT_MB * MB;
+
+    struct DecodedTexture
+    {
+        QString path;
+        QImage image;
+        QString error;
+    };
+
+    DecodedTexture decodeTexture(QString path, int maxSize)
+    {
+        DecodedTexture decoded;
+        decoded.path = path;
+
+        // mesh textures are square, uv space stretches them anyway. Readers
+        // that can scale while decoding (jpeg) skip the full size image.
+        QImageReader reader(path);
+        reader.setAutoTransform(true);
+        QSize size = reader.size();
+        int side = std::min(std::max(size.width(), size.height()), maxSize);
+        if (size.isValid() && size != QSize(side, side)) {
+            reader.setScaledSize(QSize(side, side));
+        }
+
+        QImage image = reader.read();
+        if (image.isNull()) {
+            decoded.error = reader.errorString();
+            return decoded;
+        }
+
+        side = std::min(std::max(image.width(), image.height()), maxSize);
+        if (image.size() != QSize(side, side)) {
+            image = image.scaled(side, side, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        }
+        // float formats (exr) are clamped to [0,1]
+        decoded.image = image.convertToFormat(QImage::Format_RGBA8888);
+        return decoded;
+    }
+
+    qint64 imageBytes(const QImage& image)
+    {
+        return (qint64)image.bytesPerLine() * image.height();
+    }
+}
+
+TextureImporter::TextureImporter(QObject *parent) : QObject(parent)
+{
+    for (int i = 0; i < TEXTURE_UPLOAD_SEGMENTS; i++) {
+        _fences[i] = 0;
+    }
+}
+
+TextureImporter* TextureImporter::instance()
+{
+    static TextureImporter* importer = new TextureImporter();
+    return importer;
+}
+
+bool TextureImporter::meshNameForFile(QString path, QString &meshName)
+{
+    static const QStringList colorMaps = QStringList() << "basecolor" << "base_color" << "albedo"
+            << "diffuse" << "color" << "col";
+    static const QStringList otherMaps = QStringList() << "normal" << "nrm" << "roughness" << "rough"
+            << "metallic" << "metalness" << "height" << "displacement" << "ao" << "occlusion"
+            << "emissive" << "opacity" << "specular" << "gloss";
+
+    meshName = QFileInfo(path).completeBaseName();
+    foreach (QString map, colorMaps + otherMaps) {
+        foreach (QString separator, QStringList() << "_" << "-" << ".") {
+            if (meshName.endsWith(separator + map, Qt::CaseInsensitive)) {
+                meshName.chop(map.size() + 1);
+                return colorMaps.contains(map);
+            }
+        }
+    }
+    return true; // no suffix, the file is the color map
+}
+
+int TextureImporter::importFiles(QStringList paths)
+{
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    if (!_maxTextureSize && context) {
+        context->functions()->glGetIntegerv(GL_MAX_TEXTURE_SIZE, &_maxTextureSize);
+    }
+
+    QVector<Mesh*> meshes = Project::activeProject()->meshes();
+    int queued = 0;
+
+    foreach (QString path, paths) {
+        QString meshName;
+        if (!meshNameForFile(path, meshName)) {
+            std::cout << "skipping " << path.toStdString() << ", meshes only have a color texture" << std::endl;
+            continue;
+        }
+
+        // a lone file for a lone mesh needs no matching name
+        Mesh* target = 0;
+        foreach (Mesh* mesh, meshes) {
+            if (mesh->meshName().compare(meshName, Qt::CaseInsensitive) == 0) {
+                target = mesh;
+                break;
+            }
+        }
+        if (!target && paths.size() == 1 && meshes.size() == 1) {
+            target = meshes.first();
+        }
+        if (!target) {
+            std::cerr << "no mesh named " << meshName.toStdString() << " for " << path.toStdString() << std::endl;
+            continue;
+        }
+
+        ImportJob job = { target, path };
+        _queued.append(job);
+        queued++;
+    }
+
+    startDecodes();
+    return queued;
+}
+
+void TextureImporter::startDecodes()
+{
+    // bakes and readbacks go through the PAINT_FBO_WIDTH transfer target,
+    // larger textures would be cropped there
+    int maxSize = _maxTextureSize ? _maxTextureSize : TEXTURE_IMPORT_FALLBACK_MAX_SIZE;
+    maxSize = std::min(maxSize, PAINT_FBO_WIDTH);
+    int maxDecodes = std::max(1, std::min(QThread::idealThreadCount(), TEXTURE_IMPORT_MAX_DECODES));
+
+    // decoded images wait for the upload, don't let them pile up. Decodes
+    // already running may still overshoot the limit by a few images.
+    while (!_queued.isEmpty() && _decoding.size() < maxDecodes && _pendingBytes < TEXTURE_IMPORT_MAX_PENDING_MB * MB) {
+        ImportJob job = _queued.takeFirst();
+        int id = _nextJobId++;
+        _decoding.insert(id, job.mesh);
+
+        QFutureWatcher<DecodedTexture>* watcher = new QFutureWatcher<DecodedTexture>(this);
+        connect(watcher, &QFutureWatcher<DecodedTexture>::finished, this, [this, watcher, id]() {
+            watcher->deleteLater();
+            DecodedTexture decoded = watcher->result();
+
+            // removed meshes are gone from _decoding already
+            if (_decoding.contains(id)) {
+                Mesh* mesh = _decoding.take(id);
+                if (decoded.image.isNull()) {
+                    std::cerr << "unable to import texture " << decoded.path.toStdString() << ": "
+                              << decoded.error.toStdString() << std::endl;
+                } else {
+                    PendingUpload upload;
+                    upload.mesh = mesh;
+                    upload.path = decoded.path;
+                    upload.image = decoded.image;
+                    _uploads.append(upload);
+                    _pendingBytes += imageBytes(decoded.image);
+                }
+            }
+
+            startDecodes();
+            emit progressChanged();
+        });
+        watcher->setFuture(QtConcurrent::run(decodeTexture, job.path, maxSize));
+    }
+}
+
+void TextureImporter::createRing(QOpenGLExtraFunctions *f)
+{
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    qint64 bytes = TEXTURE_UPLOAD_SEGMENTS * SEGMENT_BYTES;
+
+    f->glGenBuffers(1, &_ringBuffer);
+    f->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _ringBuffer);
+
+    BufferStorage bufferStorage = 0;
+    if (context->hasExtension("GL_ARB_buffer_storage")) {
+        bufferStorage = (BufferStorage)context->getProcAddress("glBufferStorage");
+    }
+    if (bufferStorage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        bufferStorage(GL_PIXEL_UNPACK_BUFFER, bytes, 0, flags);
+        _ringMapping = (uchar*)f->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, flags);
+
+        if (!_ringMapping) { // immutable storage can't be reallocated
+            f->glDeleteBuffers(1, &_ringBuffer);
+            f->glGenBuffers(1, &_ringBuffer);
+            f->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _ringBuffer);
+        }
+    }
+    if (!_ringMapping) {
+        f->glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, 0, GL_STREAM_DRAW);
+    }
+    f->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+bool TextureImporter::uploadSegment(QOpenGLExtraFunctions *f, PendingUpload &upload)
+{
+    // the GPU still reads this segment, try again next frame
+    GLsync& fence = _fences[_nextSegment];
+    if (fence) {
+        if (f->glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            return false;
+        f->glDeleteSync(fence);
+        fence = 0;
+    }
+
+    int size = upload.image.width();
+    int rowBytes = size * 4;
+    int rows = std::min((int)(SEGMENT_BYTES / rowBytes), size - upload.nextRow);
+    qint64 offset = _nextSegment * SEGMENT_BYTES;
+
+    f->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _ringBuffer);
+    uchar* segment = _ringMapping ? _ringMapping + offset
+            : (uchar*)f->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, (qint64)rows * rowBytes,
+                                          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!segment) {
+        f->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return false;
+    }
+
+    // image rows are top first, GL wants the bottom row first
+    for (int row = 0; row < rows; row++) {
+        memcpy(segment + (qint64)row * rowBytes, upload.image.constScanLine(size - 1 - (upload.nextRow + row)), rowBytes);
+    }
+    if (!_ringMapping) {
+        f->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    f->glBindTexture(GL_TEXTURE_2D, upload.texture);
+    f->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    f->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, upload.nextRow, size, rows, GL_RGBA, GL_UNSIGNED_BYTE, (const void*)(quintptr)offset);
+    f->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _nextSegment = (_nextSegment + 1) % TEXTURE_UPLOAD_SEGMENTS;
+    upload.nextRow += rows;
+    return true;
+}
+
+void TextureImporter::finishUpload(PendingUpload &upload)
+{
+    Mesh* mesh = upload.mesh;
+    int size = upload.image.width();
+    TextureMips::generate(upload.texture);
+
+    // the import replaces the texture with its layers and history
+    if (GLCache::hasMeshTexture(mesh)) {
+        GLuint previous = GLCache::removeMeshTexture(mesh);
+        glDeleteTextures(1, &previous);
+    }
+    TextureResidency::forgetMesh(mesh);
+    TextureCompression::forgetMesh(mesh);
+    PaintLayers::forgetMesh(mesh);
+    PaintHistory::forgetMesh(mesh);
+
+    mesh->setTextureSize(size);
+    GLCache::setMeshTexture(mesh, upload.texture);
+    TextureResidency::registerTexture(mesh, size);
+    ProjectArchive::instance()->markTextureDirty(mesh);
+}
+
+void TextureImporter::update()
+{
+    if (_uploads.isEmpty())
+        return;
+
+    QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+    if (!_ringBuffer) {
+        createRing(f);
+    }
+
+    qint64 uploaded = 0;
+    while (!_uploads.isEmpty() && uploaded < TEXTURE_UPLOAD_FRAME_MB * MB) {
+        PendingUpload& upload = _uploads.first();
+        int size = upload.image.width();
+
+        if (!upload.texture) {
+            f->glGenTextures(1, &upload.texture);
+            f->glBindTexture(GL_TEXTURE_2D, upload.texture);
+            f->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        }
+
+        int previousRow = upload.nextRow;
+        if (!uploadSegment(f, upload))
+            break;
+        uploaded += (qint64)(upload.nextRow - previousRow) * size * 4;
+
+        if (upload.nextRow == size) {
+            finishUpload(upload);
+            _pendingBytes -= imageBytes(upload.image);
+            _uploads.removeFirst();
+            startDecodes();
+        }
+    }
+
+    Profiler::setCounter("texture import", QString("%1 decoding, %2 uploading")
+                         .arg(_queued.size() + _decoding.size()).arg(_uploads.size()));
+
+    // keep frames coming until everything is on the GPU
+    if (!_uploads.isEmpty()) {
+        emit progressChanged();
+    }
+}
+
+void TextureImporter::forgetMesh(Mesh *mesh)
+{
+    for (int i = _queued.size() - 1; i >= 0; i--) {
+        if (_queued[i].mesh == mesh) {
+            _queued.removeAt(i);
+        }
+    }
+
+    QMutableHashIterator<int, Mesh*> decoding(_decoding);
+    while (decoding.hasNext()) {
+        if (decoding.next().value() == mesh) {
+            decoding.remove(); // the result is dropped when it arrives
+        }
+    }
+
+    for (int i = _uploads.size() - 1; i >= 0; i--) {
+        if (_uploads[i].mesh == mesh) {
+            if (_uploads[i].texture) {
+                glDeleteTextures(1, &_uploads[i].texture);
+            }
+            _pendingBytes -= imageBytes(_uploads[i].image);
+            _uploads.removeAt(i);
+        }
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef TEXTUREIMPORTER_H
+#define TEXTUREIMPORTER_H
+
+#include <QObject>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QStringList>
+#include <QOpenGLExtraFunctions>
+
+#include "mesh.h"
+
+#define TEXTURE_IMPORT_MAX_DECODES 4       // images decoding at once
+#define TEXTURE_IMPORT_MAX_PENDING_MB 1024 // decoded but not uploaded yet
+#define TEXTURE_UPLOAD_SEGMENTS 3
+#define TEXTURE_UPLOAD_SEGMENT_MB 16
+#define TEXTURE_UPLOAD_FRAME_MB 32         // streamed per drawn frame
+
+// imports texture files as mesh textures. Files are matched to meshes by
+// name, "crate_BaseColor.png" goes to the mesh "crate". Images decode on
+// worker threads (any format QImageReader has a plugin for, EXR needs the
+// kimageformats plugin) and stream to the GPU a few row bands per frame
+// through a ring of pixel unpack buffers, persistently mapped where
+// GL_ARB_buffer_storage exists. Fences keep a segment from being rewritten
+// while the GPU still reads it, and a busy ring ends the frame's uploads
+// instead of stalling. A texture replaces the mesh texture once all its
+// rows are on the GPU. Images are scaled down to PAINT_FBO_WIDTH, the
+// size bakes and readbacks can handle.
+class TextureImporter : public QObject
+{
+    Q_OBJECT
+public:
+    static TextureImporter* instance();
+
+    // queues every file matching a mesh of the active project, returns how
+    // many were queued
+    int importFiles(QStringList paths);
+
+    // once per drawn frame with the shared GL context current
+    void update();
+    bool isUploading() const { return !_uploads.isEmpty(); }
+
+    void forgetMesh(Mesh* mesh);
+
+    // the mesh name a file belongs to, false for maps other than color
+    static bool meshNameForFile(QString path, QString& meshName);
+
+signals:
+    // views redraw on this to keep uploads going
+    void progressChanged();
+
+private:
+    struct ImportJob
+    {
+        Mesh* mesh;
+        QString path;
+    };
+
+    struct PendingUpload
+    {
+        Mesh* mesh = 0;
+        QString path;
+        QImage image; // RGBA8888, square
+        GLuint texture = 0;
+        int nextRow = 0; // in GL order, bottom row first
+    };
+
+    explicit TextureImporter(QObject *parent = 0);
+
+    void startDecodes();
+    void createRing(QOpenGLExtraFunctions* f);
+    bool uploadSegment(QOpenGLExtraFunctions* f, PendingUpload& upload);
+    void finishUpload(PendingUpload& upload);
+
+    QList<ImportJob> _queued;
+    QHash<int, Mesh*> _decoding; // by job id, removed meshes drop out
+    int _nextJobId = 0;
+    QList<PendingUpload> _uploads;
+    qint64 _pendingBytes = 0;
+    int _maxTextureSize = 0;
+
+    GLuint _ringBuffer = 0;
+    uchar* _ringMapping = 0; // null when segments are mapped one by one
+    GLsync _fences[TEXTURE_UPLOAD_SEGMENTS];
+    int _nextSegment = 0;
+};
+
+#endif // TEXTUREIMPORTER_H
@@ -0,0 +1,135 @@
+#include "texturemips.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <algorithm>
+
+namespace {
+    GLuint readFbo = 0;
+    GLuint drawFbo = 0;
+}
+
+int TextureMips::levelCount(int size)
+{
+    int levels = 1;
+    while (size > 1) {
+        size /= 2;
+        levels++;
+    }
+    return levels;
+}
+
+void TextureMips::generate(GLuint texture)
+{
+    QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+
+    f->glBindTexture(GL_TEXTURE_2D, texture);
+#if MESH_TEXTURE_MIPMAPS
+    f->glGenerateMipmap(GL_TEXTURE_2D);
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+#else
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+#endif
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+void TextureMips::updateRegion(GLuint texture, int size, QRect dirty)
+{
+#if MESH_TEXTURE_MIPMAPS
+    QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+
+    dirty = dirty.intersected(QRect(0, 0, size, size));
+    if (dirty.isEmpty())
+        return;
+
+    if (!readFbo) {
+        f->glGenFramebuffers(1, &readFbo);
+        f->glGenFramebuffers(1, &drawFbo);
+    }
+
+    GLint previousRead, previousDraw;
+    f->glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+    f->glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDraw);
+
+    f->glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+    f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFbo);
+
+    // half open texel bounds of the region at the current source level
+    int x0 = dirty.left(), y0 = dirty.top();
+    int x1 = dirty.right() + 1, y1 = dirty.bottom() + 1;
+    int levelSize = size;
+
+    for (int level = 1; levelSize > 1; level++) {
+        // grow to whole 2x2 source blocks so the blit averages complete blocks
+        x0 &= ~1; y0 &= ~1;
+        x1 = std::min((x1 + 1) & ~1, levelSize);
+        y1 = std::min((y1 + 1) & ~1, levelSize);
+
+        f->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, level - 1);
+        f->glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, level);
+
+        f->glBlitFramebuffer(x0, y0, x1, y1, x0 / 2, y0 / 2, x1 / 2, y1 / 2, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+        x0 /= 2; y0 /= 2; x1 /= 2; y1 /= 2;
+        levelSize /= 2;
+    }
+
+    f->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    f->glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+
+    f->glBindFramebuffer(GL_READ_FRAMEBUFFER, previousRead);
+    f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousDraw);
+#else
+    Q_UNUSED(texture);
+    Q_UNUSED(size);
+    Q_UNUSED(dirty);
+#endif
+}
+
+GLuint TextureMips::resample(GLuint source, int sourceSize, int size, bool mipmaps)
+{
+    QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+
+    GLuint texture;
+    f->glGenTextures(1, &texture);
+    f->glBindTexture(GL_TEXTURE_2D, texture);
+    f->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+    int level = 0;
+#if MESH_TEXTURE_MIPMAPS
+    while ((sourceSize >> (level + 1)) >= size) {
+        level++;
+    }
+#endif
+    int levelSize = std::max(1, sourceSize >> level);
+
+    if (!readFbo) {
+        f->glGenFramebuffers(1, &readFbo);
+        f->glGenFramebuffers(1, &drawFbo);
+    }
+
+    GLint previousRead, previousDraw;
+    f->glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+    f->glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDraw);
+
+    f->glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+    f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFbo);
+    f->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source, level);
+    f->glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+
+    f->glBlitFramebuffer(0, 0, levelSize, levelSize, 0, 0, size, size, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+    f->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    f->glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    f->glBindFramebuffer(GL_READ_FRAMEBUFFER, previousRead);
+    f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousDraw);
+
+    if (mipmaps) {
+        generate(texture);
+    } else {
+        f->glBindTexture(GL_TEXTURE_2D, texture);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    return texture;
+}
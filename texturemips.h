@@ -0,0 +1,29 @@
+#ifndef TEXTUREMIPS_H
+#define TEXTUREMIPS_H
+
+#include <QOpenGLFunctions>
+#include <QRect>
+
+#define MESH_TEXTURE_MIPMAPS 1
+
+// mip chains for mesh textures. After a bake only the texels under the
+// changed region are downsampled, level by level, with linear blits that
+// average exactly 2x2 texels (a box filter).
+class TextureMips
+{
+public:
+    static int levelCount(int size);
+
+    // builds the whole chain and switches the texture to trilinear filtering
+    static void generate(GLuint texture);
+
+    // refreshes levels 1..n below a texel rect of level 0
+    static void updateRegion(GLuint texture, int size, QRect dirty);
+
+    // copies into a new texture of another size, from the source's mip level
+    // closest above the new size so shrinking by more than half doesn't
+    // alias. The copy gets its own chain when mipmaps is set.
+    static GLuint resample(GLuint source, int sourceSize, int size, bool mipmaps);
+};
+
+#endif // TEXTUREMIPS_H
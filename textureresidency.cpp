@@ -0,0 +1,249 @@
+#include "textureresidency.h"
+
+#include <QHash>
+#include <QImage>
+#include <QFuture>
+#include <QtConcurrent>
+#include <iostream>
+
+#include "glcache.h"
+#include "profiler.h"
+#include "texturemips.h"
+#include "texturecompression.h"
+
+namespace {
+    struct ResidencyEntry
+    {
+        enum State { RESIDENT, EVICTED, RESTORING };
+
+        State state = RESIDENT;
+        int size = 0;
+        qint64 bytes = 0; // while resident
+        quint64 lastUsedFrame = 0;
+
+        QFuture<QByteArray> compressed; // host copy while evicted
+        QFuture<QByteArray> restored;   // decompressed pixels while restoring
+        GLuint placeholder = 0;
+    };
+
+    qint64 initialBudget()
+    {
+        bool ok;
+        qint64 mb = qgetenv("PAINTBUG_TEXTURE_BUDGET_MB").toLongLong(&ok);
+        return (ok ? mb : DEFAULT_TEXTURE_BUDGET_MB) * 1024 * 1024;
+    }
+
+    QHash<Mesh*, ResidencyEntry> entries;
+    quint64 frame = 0;
+    qint64 budgetBytes = initialBudget();
+    qint64 unmanagedBytes = 0;
+    int evictions = 0;
+
+    qint64 textureBytes(int size)
+    {
+        return (qint64)size * size * 4;
+    }
+
+    GLuint uploadTexture(int size, const void* pixels)
+    {
+        GLuint textureId;
+        glGenTextures(1, &textureId);
+        glBindTexture(GL_TEXTURE_2D, textureId);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        TextureMips::generate(textureId);
+        return textureId;
+    }
+
+    void finishRestore(Mesh* mesh, ResidencyEntry& entry)
+    {
+        QByteArray pixels = entry.restored.result();
+
+        GLuint textureId = uploadTexture(entry.size, pixels.constData());
+        GLCache::setMeshTexture(mesh, textureId);
+        entry.bytes = textureBytes(entry.size);
+
+        glDeleteTextures(1, &entry.placeholder);
+        entry.placeholder = 0;
+        entry.compressed = QFuture<QByteArray>();
+        entry.restored = QFuture<QByteArray>();
+        entry.state = ResidencyEntry::RESIDENT;
+    }
+
+    void startRestore(ResidencyEntry& entry)
+    {
+        QFuture<QByteArray> compressed = entry.compressed;
+        entry.restored = QtConcurrent::run([compressed]() { return qUncompress(compressed.result()); });
+        entry.state = ResidencyEntry::RESTORING;
+    }
+
+    void evict(Mesh* mesh, ResidencyEntry& entry)
+    {
+        GLuint textureId = GLCache::meshTextureId(mesh);
+
+        // exact pixels of compressed textures, restored uncompressed
+        QByteArray pixels;
+        TextureCompression::readPixels(mesh, pixels);
+
+        QImage image((const uchar*)pixels.constData(), entry.size, entry.size, QImage::Format_RGBA8888);
+        QImage small = image.scaled(TEXTURE_PLACEHOLDER_SIZE, TEXTURE_PLACEHOLDER_SIZE,
+                                    Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        entry.placeholder = uploadTexture(TEXTURE_PLACEHOLDER_SIZE, small.constBits());
+
+        // fast compression level, paint textures are mostly flat color
+        entry.compressed = QtConcurrent::run([pixels]() { return qCompress(pixels, 1); });
+
+        GLCache::removeMeshTexture(mesh);
+        glDeleteTextures(1, &textureId);
+
+        entry.state = ResidencyEntry::EVICTED;
+        evictions++;
+    }
+}
+
+void TextureResidency::registerTexture(Mesh *mesh, int size)
+{
+    ResidencyEntry entry;
+    entry.size = size;
+    entry.bytes = textureBytes(size);
+    entry.lastUsedFrame = frame;
+    entries[mesh] = entry;
+}
+
+void TextureResidency::forgetMesh(Mesh *mesh)
+{
+    if (!entries.contains(mesh))
+        return;
+
+    ResidencyEntry entry = entries.take(mesh);
+    if (entry.placeholder) {
+        glDeleteTextures(1, &entry.placeholder);
+    }
+    // running futures finish on their own and drop their data
+}
+
+bool TextureResidency::isEvicted(Mesh *mesh)
+{
+    return entries.contains(mesh) && entries[mesh].state != ResidencyEntry::RESIDENT;
+}
+
+void TextureResidency::beginFrame()
+{
+    frame++;
+
+    QMutableHashIterator<Mesh*, ResidencyEntry> it(entries);
+    while (it.hasNext()) {
+        it.next();
+        ResidencyEntry& entry = it.value();
+        if (entry.state == ResidencyEntry::RESTORING && entry.restored.isFinished()) {
+            finishRestore(it.key(), entry);
+        }
+    }
+}
+
+void TextureResidency::endFrame()
+{
+    qint64 resident = residentBytes();
+
+    while (resident + unmanagedBytes > budgetBytes) {
+        // never evict something drawn this frame, it would just come back
+        Mesh* oldest = 0;
+        quint64 oldestFrame = frame;
+        QHashIterator<Mesh*, ResidencyEntry> it(entries);
+        while (it.hasNext()) {
+            it.next();
+            if (it.value().state == ResidencyEntry::RESIDENT && it.value().lastUsedFrame < oldestFrame) {
+                oldest = it.key();
+                oldestFrame = it.value().lastUsedFrame;
+            }
+        }
+
+        if (!oldest)
+            break; // the visible set alone exceeds the budget
+
+        evict(oldest, entries[oldest]);
+        resident -= entries[oldest].bytes;
+    }
+
+    Profiler::setCounter("textures", QString("%1 / %2 MB resident, %3 evictions")
+                         .arg((resident + unmanagedBytes) / (1024 * 1024)).arg(budgetBytes / (1024 * 1024)).arg(evictions));
+}
+
+GLuint TextureResidency::textureForDraw(Mesh *mesh)
+{
+    if (!entries.contains(mesh))
+        return GLCache::meshTextureId(mesh);
+
+    ResidencyEntry& entry = entries[mesh];
+    entry.lastUsedFrame = frame;
+
+    if (entry.state == ResidencyEntry::EVICTED) {
+        startRestore(entry);
+    }
+
+    if (entry.state == ResidencyEntry::RESTORING)
+        return entry.placeholder;
+
+    return GLCache::meshTextureId(mesh);
+}
+
+void TextureResidency::ensureResident(Mesh *mesh)
+{
+    if (!entries.contains(mesh))
+        return;
+
+    ResidencyEntry& entry = entries[mesh];
+    entry.lastUsedFrame = frame;
+
+    if (entry.state == ResidencyEntry::EVICTED) {
+        startRestore(entry);
+    }
+    if (entry.state == ResidencyEntry::RESTORING) {
+        entry.restored.waitForFinished();
+        finishRestore(mesh, entry);
+    }
+}
+
+void TextureResidency::setTextureBytes(Mesh *mesh, qint64 bytes)
+{
+    if (entries.contains(mesh)) {
+        entries[mesh].bytes = bytes;
+    }
+}
+
+void TextureResidency::setUnmanagedBytes(qint64 bytes)
+{
+    unmanagedBytes = bytes;
+}
+
+qint64 TextureResidency::meshTextureBytes(Mesh *mesh)
+{
+    if (!entries.contains(mesh) || entries[mesh].state != ResidencyEntry::RESIDENT)
+        return 0;
+    return entries[mesh].bytes;
+}
+
+qint64 TextureResidency::budget()
+{
+    return budgetBytes;
+}
+
+void TextureResidency::setBudget(qint64 bytes)
+{
+    budgetBytes = bytes;
+}
+
+qint64 TextureResidency::residentBytes()
+{
+    qint64 resident = 0;
+    foreach (const ResidencyEntry& entry, entries) {
+        if (entry.state == ResidencyEntry::RESIDENT) {
+            resident += entry.bytes;
+        }
+    }
+    return resident;
+}
+
+int TextureResidency::evictionCount()
+{
+    return evictions;
+}
@@ -0,0 +1,49 @@
+#ifndef TEXTURERESIDENCY_H
+#define TEXTURERESIDENCY_H
+
+#include <QOpenGLFunctions>
+
+#include "mesh.h"
+
+#define DEFAULT_TEXTURE_BUDGET_MB 1024
+#define TEXTURE_PLACEHOLDER_SIZE 32
+
+// keeps mesh textures within a VRAM budget. Textures that haven't been drawn
+// recently are read back, compressed on a worker thread and deleted; a small
+// placeholder is drawn until an asynchronous restore brings them back.
+//
+// All functions need the shared GL context to be current.
+class TextureResidency
+{
+public:
+    // start tracking a texture stored in GLCache
+    static void registerTexture(Mesh* mesh, int size);
+    static void forgetMesh(Mesh* mesh);
+
+    static bool isEvicted(Mesh* mesh);
+
+    // once per drawn frame, uploads restores that finished decompressing
+    static void beginFrame();
+    // evicts least recently used textures until the budget is met
+    static void endFrame();
+
+    // texture to sample this frame, the placeholder while still restoring
+    static GLuint textureForDraw(Mesh* mesh);
+    // blocks until the real texture is back, for bakes and exports
+    static void ensureResident(Mesh* mesh);
+
+    // for textures stored in a format other than RGBA8
+    static void setTextureBytes(Mesh* mesh, qint64 bytes);
+    // VRAM of copies this class can't evict, such as instance texture
+    // arrays. Counts against the budget, so more mesh textures get evicted.
+    static void setUnmanagedBytes(qint64 bytes);
+    // VRAM used by the mesh texture, 0 while evicted
+    static qint64 meshTextureBytes(Mesh* mesh);
+
+    static qint64 budget();
+    static void setBudget(qint64 bytes);
+    static qint64 residentBytes();
+    static int evictionCount();
+};
+
+#endif // TEXTURERESIDENCY_H
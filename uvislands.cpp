@@ -0,0 +1,205 @@
+#include "uvislands.h"
+
+#include <QHash>
+#include <QtConcurrent>
+#include <atomic>
+#include <memory>
+#include <string.h>
+#include <algorithm>
+
+namespace {
+    QHash<Mesh*, QVector<UVIsland> > meshIslandTable;
+    const QVector<UVIsland> noIslands;
+
+    // lock-free union-find, roots only ever point to smaller ids so
+    // concurrent links can't form cycles
+    int findRoot(std::atomic<int>* parent, int x)
+    {
+        while (true) {
+            int p = parent[x].load(std::memory_order_relaxed);
+            if (p == x)
+                return x;
+            int grandparent = parent[p].load(std::memory_order_relaxed);
+            if (grandparent != p) {
+                parent[x].compare_exchange_weak(p, grandparent, std::memory_order_relaxed);
+            }
+            x = grandparent;
+        }
+    }
+
+    void unite(std::atomic<int>* parent, int a, int b)
+    {
+        while (true) {
+            a = findRoot(parent, a);
+            b = findRoot(parent, b);
+            if (a == b)
+                return;
+            if (a < b)
+                std::swap(a, b);
+            int expected = a;
+            if (parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed))
+                return;
+        }
+    }
+}
+
+QVector<UVIsland> UVIslands::build(QVector<quint32> &indices, const QVector<float> &uvs, int uvComponents)
+{
+    int triangleCount = indices.size() / 3;
+    int vertexCount = uvComponents > 0 ? uvs.size() / uvComponents : 0;
+    if (triangleCount == 0 || uvComponents < 2)
+        return QVector<UVIsland>();
+
+    // weld vertices with identical uvs, imports often split vertices at
+    // normal or smoothing seams that are continuous in uv space
+    QVector<int> welded(vertexCount);
+    {
+        QHash<quint64, int> first;
+        first.reserve(vertexCount);
+        for (int v = 0; v < vertexCount; v++) {
+            quint32 u, w;
+            memcpy(&u, &uvs[v * uvComponents], 4);
+            memcpy(&w, &uvs[v * uvComponents + 1], 4);
+            quint64 key = ((quint64)u << 32) | w;
+            welded[v] = first.value(key, -1);
+            if (welded[v] < 0) {
+                welded[v] = v;
+                first.insert(key, v);
+            }
+        }
+    }
+
+    std::unique_ptr<std::atomic<int>[]> parent(new std::atomic<int>[vertexCount]);
+    for (int v = 0; v < vertexCount; v++) {
+        parent[v].store(v, std::memory_order_relaxed);
+    }
+
+    QVector<int> chunks;
+    for (int start = 0; start < triangleCount; start += UV_ISLAND_CHUNK) {
+        chunks.append(start);
+    }
+
+    const quint32* tris = indices.constData();
+    const int* weld = welded.constData();
+    std::atomic<int>* parents = parent.get();
+    QtConcurrent::blockingMap(chunks, [tris, weld, parents, triangleCount](int start) {
+        int end = std::min(start + UV_ISLAND_CHUNK, triangleCount);
+        for (int t = start; t < end; t++) {
+            int a = weld[tris[t * 3 + 0]];
+            unite(parents, a, weld[tris[t * 3 + 1]]);
+            unite(parents, a, weld[tris[t * 3 + 2]]);
+        }
+    });
+
+    // compact island ids in order of first appearance, which keeps the
+    // incoming triangle order as far as possible
+    QVector<int> islandOfRoot(vertexCount, -1);
+    QVector<int> triangleIsland(triangleCount);
+    QVector<int> islandSizes;
+    for (int t = 0; t < triangleCount; t++) {
+        int root = findRoot(parents, weld[tris[t * 3]]);
+        if (islandOfRoot[root] < 0) {
+            islandOfRoot[root] = islandSizes.size();
+            islandSizes.append(0);
+        }
+        triangleIsland[t] = islandOfRoot[root];
+        islandSizes[triangleIsland[t]]++;
+    }
+
+    QVector<UVIsland> islands(islandSizes.size());
+    int offset = 0;
+    for (int i = 0; i < islands.size(); i++) {
+        islands[i].firstTriangle = offset;
+        islands[i].triangleCount = islandSizes[i];
+        offset += islandSizes[i];
+    }
+
+    // stable counting sort of triangles by island
+    QVector<int> cursor(islands.size());
+    for (int i = 0; i < islands.size(); i++) {
+        cursor[i] = islands[i].firstTriangle;
+    }
+
+    QVector<quint32> sorted(indices.size());
+    QVector<float> minU(islands.size(), 1e30f), minV(islands.size(), 1e30f);
+    QVector<float> maxU(islands.size(), -1e30f), maxV(islands.size(), -1e30f);
+    for (int t = 0; t < triangleCount; t++) {
+        int island = triangleIsland[t];
+        int slot = cursor[island]++;
+        for (int corner = 0; corner < 3; corner++) {
+            quint32 v = tris[t * 3 + corner];
+            sorted[slot * 3 + corner] = v;
+
+            float u = uvs[v * uvComponents];
+            float w = uvs[v * uvComponents + 1];
+            minU[island] = std::min(minU[island], u);
+            minV[island] = std::min(minV[island], w);
+            maxU[island] = std::max(maxU[island], u);
+            maxV[island] = std::max(maxV[island], w);
+        }
+    }
+    indices = sorted;
+
+    for (int i = 0; i < islands.size(); i++) {
+        islands[i].uvBounds = QRectF(minU[i], minV[i], maxU[i] - minU[i], maxV[i] - minV[i]);
+    }
+
+    return islands;
+}
+
+void UVIslands::setMeshIslands(Mesh *mesh, const QVector<UVIsland> &islands)
+{
+    meshIslandTable[mesh] = islands;
+}
+
+const QVector<UVIsland>& UVIslands::meshIslands(Mesh *mesh)
+{
+    if (!meshIslandTable.contains(mesh))
+        return noIslands;
+    return meshIslandTable[mesh];
+}
+
+int UVIslands::islandOfTriangle(Mesh *mesh, int triangle)
+{
+    const QVector<UVIsland>& islands = meshIslands(mesh);
+
+    // islands are sorted by their first triangle
+    int low = 0, high = islands.size() - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        const UVIsland& island = islands[middle];
+        if (triangle < island.firstTriangle) {
+            high = middle - 1;
+        } else if (triangle >= island.firstTriangle + island.triangleCount) {
+            low = middle + 1;
+        } else {
+            return middle;
+        }
+    }
+    return -1;
+}
+
+bool UVIslands::touchesRect(Mesh *mesh, QRectF uvRect)
+{
+    const QVector<UVIsland>& islands = meshIslands(mesh);
+    if (uvRect.isNull() || islands.isEmpty())
+        return true;
+
+    foreach (const UVIsland& island, islands) {
+        // bounds are closed, a flat island still has to count. Islands
+        // outside [0,1] wrap and always count.
+        const QRectF& b = island.uvBounds;
+        bool wraps = b.left() < 0 || b.top() < 0 || b.right() > 1 || b.bottom() > 1;
+        if (wraps)
+            return true;
+        if (b.right() >= uvRect.left() && b.left() <= uvRect.right() &&
+            b.bottom() >= uvRect.top() && b.top() <= uvRect.bottom())
+            return true;
+    }
+    return false;
+}
+
+void UVIslands::forgetMesh(Mesh *mesh)
+{
+    meshIslandTable.remove(mesh);
+}
@@ -0,0 +1,42 @@
+#ifndef UVISLANDS_H
+#define UVISLANDS_H
+
+#include <QVector>
+#include <QRectF>
+
+#include "mesh.h"
+
+#define UV_ISLAND_CHUNK 65536 // triangles per union-find task
+
+struct UVIsland
+{
+    int firstTriangle = 0;
+    int triangleCount = 0;
+    QRectF uvBounds;
+};
+
+// uv topology of a mesh: islands are triangles connected through shared uv
+// coordinates. MeshProcessor reorders each island into one contiguous run of
+// triangles. Bakes skip meshes whose islands all miss the strokes; they
+// still draw every triangle of the others, since the primitive ids they
+// test are those of a full draw.
+class UVIslands
+{
+public:
+    // finds the islands with a parallel union-find over welded uv vertices
+    // and reorders indices in place, keeping the order within an island
+    static QVector<UVIsland> build(QVector<quint32>& indices, const QVector<float>& uvs, int uvComponents);
+
+    static void setMeshIslands(Mesh* mesh, const QVector<UVIsland>& islands);
+    static const QVector<UVIsland>& meshIslands(Mesh* mesh); // empty until imported
+    static int islandOfTriangle(Mesh* mesh, int triangle);  // -1 if unknown
+
+    // whether a bake touching uvRect reaches an island of the mesh. A null
+    // rect stands for the whole texture, meshes without islands yet always
+    // count as touched.
+    static bool touchesRect(Mesh* mesh, QRectF uvRect);
+
+    static void forgetMesh(Mesh* mesh);
+};
+
+#endif // UVISLANDS_H
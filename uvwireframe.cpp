@@ -0,0 +1,267 @@
+#include "uvwireframe.h"
+
+#include <QHash>
+#include <QSet>
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <string.h>
+
+#include "geometrystore.h"
+#include "geometrycache.h"
+#include "texturemips.h"
+#include "profiler.h"
+
+#ifndef GL_TEXTURE_SWIZZLE_RGBA
+#define GL_TEXTURE_SWIZZLE_RGBA 0x8E46
+#endif
+
+namespace {
+    struct MeshLines
+    {
+        QOpenGLBuffer* buffer = 0; // two uv floats per endpoint
+        int vertexCount = 0;
+    };
+
+    struct ViewWireframe
+    {
+        QOpenGLFramebufferObject* target = 0;
+        int size = 0;
+        QVector<Mesh*> meshes; // drawn into the target
+        bool stale = false;    // a drawn mesh changed its uvs
+    };
+
+    QHash<Mesh*, MeshLines> meshLines;
+    QHash<const void*, ViewWireframe> views;
+    bool visible = true;
+
+    // endpoints of each edge once, vertices with identical uvs welded so
+    // edges split at normal seams don't draw twice
+    QVector<float> uniqueEdges(Mesh* mesh)
+    {
+        GeometryStore::ensureHostGeometry(mesh);
+
+        const int vertexCount = mesh->_vertices.size() / 3;
+        const int uvStride = vertexCount > 0 ? mesh->_uvs.size() / vertexCount : 0;
+        const int triangleCount = mesh->_triangleIndices.size() / 3;
+        if (triangleCount == 0 || uvStride < 2)
+            return QVector<float>();
+
+        const float* uvs = mesh->_uvs.constData();
+        QVector<quint32> welded(vertexCount);
+        QHash<quint64, quint32> first;
+        first.reserve(vertexCount);
+        for (int v = 0; v < vertexCount; v++) {
+            quint32 u, w;
+            memcpy(&u, &uvs[v * uvStride], 4);
+            memcpy(&w, &uvs[v * uvStride + 1], 4);
+            quint64 key = ((quint64)u << 32) | w;
+            welded[v] = first.value(key, v);
+            if (welded[v] == (quint32)v) {
+                first.insert(key, v);
+            }
+        }
+
+        QVector<quint64> edges(triangleCount * 3);
+        for (int t = 0; t < triangleCount; t++) {
+            for (int c = 0; c < 3; c++) {
+                quint32 a = welded[mesh->_triangleIndices[t * 3 + c]];
+                quint32 b = welded[mesh->_triangleIndices[t * 3 + (c + 1) % 3]];
+                edges[t * 3 + c] = a < b ? ((quint64)a << 32) | b : ((quint64)b << 32) | a;
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        QVector<float> lines(edges.size() * 4);
+        for (int i = 0; i < edges.size(); i++) {
+            quint32 a = edges[i] >> 32;
+            quint32 b = edges[i] & 0xffffffffu;
+            lines[i * 4 + 0] = uvs[a * uvStride];
+            lines[i * 4 + 1] = uvs[a * uvStride + 1];
+            lines[i * 4 + 2] = uvs[b * uvStride];
+            lines[i * 4 + 3] = uvs[b * uvStride + 1];
+        }
+        return lines;
+    }
+
+    MeshLines& linesOf(Mesh* mesh)
+    {
+        MeshLines& lines = meshLines[mesh];
+        if (!lines.buffer) {
+            QVector<float> edges = uniqueEdges(mesh);
+            lines.buffer = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+            lines.buffer->create();
+            lines.buffer->bind();
+            lines.buffer->allocate(edges.constData(), edges.size() * sizeof(float));
+            lines.buffer->release();
+            lines.vertexCount = edges.size() / 2;
+        }
+        return lines;
+    }
+}
+
+bool UVWireframe::isVisible()
+{
+    return visible;
+}
+
+void UVWireframe::setVisible(bool enabled)
+{
+    visible = enabled;
+}
+
+int UVWireframe::sizeForZoom(float pixelsPerUV)
+{
+    int size = UV_WIREFRAME_MIN_SIZE;
+    while (size < pixelsPerUV && size < UV_WIREFRAME_MAX_SIZE) {
+        size *= 2;
+    }
+    return size;
+}
+
+void UVWireframe::prepare(const void *view, const QVector<Mesh*> &meshes, int size)
+{
+    ViewWireframe& wireframe = views[view];
+    if (wireframe.target && wireframe.size == size && wireframe.meshes == meshes && !wireframe.stale)
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!wireframe.target || wireframe.size != size) {
+        delete wireframe.target;
+        wireframe.target = new QOpenGLFramebufferObject(size, size, QOpenGLFramebufferObject::NoAttachment, GL_TEXTURE_2D, GL_R8);
+        wireframe.size = size;
+    }
+    wireframe.meshes = meshes;
+    wireframe.stale = false;
+
+    QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+    GLint viewport[4];
+    f->glGetIntegerv(GL_VIEWPORT, viewport);
+
+    wireframe.target->bind();
+    f->glViewport(0, 0, size, size);
+    f->glClearColor(0, 0, 0, 0);
+    f->glClear(GL_COLOR_BUFFER_BIT);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0, 1, 0, 1, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    // coverage of smoothed lines lands in the red channel
+    f->glEnable(GL_BLEND);
+    f->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_LINE_SMOOTH);
+    glColor4f(1, 1, 1, 1);
+    glEnableClientState(GL_VERTEX_ARRAY);
+
+    // copies share their geometry and with it the uv layout
+    QSet<MeshGeometry*> drawn;
+    int edges = 0;
+    foreach (Mesh* mesh, meshes) {
+        MeshGeometry* geometry = GeometryCache::meshGeometry(mesh);
+        if (geometry) {
+            if (drawn.contains(geometry))
+                continue;
+            drawn.insert(geometry);
+        }
+
+        MeshLines& lines = linesOf(mesh);
+        lines.buffer->bind();
+        glVertexPointer(2, GL_FLOAT, 0, 0);
+        f->glDrawArrays(GL_LINES, 0, lines.vertexCount);
+        lines.buffer->release();
+        edges += lines.vertexCount / 2;
+    }
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisable(GL_LINE_SMOOTH);
+    f->glDisable(GL_BLEND);
+    wireframe.target->release();
+    f->glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    // sampled as white with the coverage as alpha, mips for the zoom
+    // levels between two sizes
+    GLint swizzle[4] = { GL_ONE, GL_ONE, GL_ONE, GL_RED };
+    f->glBindTexture(GL_TEXTURE_2D, wireframe.target->texture());
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    TextureMips::generate(wireframe.target->texture());
+    f->glBindTexture(GL_TEXTURE_2D, 0);
+
+    Profiler::setCounter("uv wireframe", QString("%1 edges of %2 meshes at %3x%3 in %4 ms, %5 MB for all views")
+                         .arg(edges).arg(drawn.size()).arg(size).arg(timer.nsecsElapsed() / 1000000.0f, 0, 'f', 1)
+                         .arg(totalBytes() / (1024.0 * 1024.0), 0, 'f', 1));
+}
+
+void UVWireframe::draw(const void *view, const QMatrix4x4 &uvToClip)
+{
+    if (!views.contains(view) || !views[view].target)
+        return;
+
+    QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(uvToClip.constData());
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    f->glEnable(GL_BLEND);
+    f->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_TEXTURE_2D);
+    f->glBindTexture(GL_TEXTURE_2D, views[view].target->texture());
+
+    glColor4f(1, 1, 1, 0.6f);
+    glBegin(GL_QUADS);
+    {
+        glTexCoord2f(0, 0);
+        glVertex2f(0, 0);
+        glTexCoord2f(1, 0);
+        glVertex2f(1, 0);
+        glTexCoord2f(1, 1);
+        glVertex2f(1, 1);
+        glTexCoord2f(0, 1);
+        glVertex2f(0, 1);
+    }
+    glEnd();
+    glColor4f(1, 1, 1, 1);
+
+    glDisable(GL_TEXTURE_2D);
+    f->glDisable(GL_BLEND);
+}
+
+void UVWireframe::forgetMesh(Mesh *mesh)
+{
+    for (QHash<const void*, ViewWireframe>::iterator it = views.begin(); it != views.end(); ++it) {
+        if (it->meshes.contains(mesh)) {
+            it->stale = true;
+        }
+    }
+
+    if (!meshLines.contains(mesh))
+        return;
+
+    MeshLines lines = meshLines.take(mesh);
+    lines.buffer->destroy();
+    delete lines.buffer;
+}
+
+qint64 UVWireframe::totalBytes()
+{
+    qint64 bytes = 0;
+    foreach (const MeshLines& lines, meshLines) {
+        bytes += lines.vertexCount * 2 * sizeof(float);
+    }
+    foreach (const ViewWireframe& wireframe, views) {
+        bytes += (qint64)wireframe.size * wireframe.size * 4 / 3; // with mips
+    }
+    return bytes;
+}
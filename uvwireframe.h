@@ -0,0 +1,49 @@
+#ifndef UVWIREFRAME_H
+#define UVWIREFRAME_H
+
+#include <QMatrix4x4>
+#include <QVector>
+
+#include "mesh.h"
+
+#define UV_WIREFRAME_MIN_SIZE 512
+#define UV_WIREFRAME_MAX_SIZE 4096 // 16 MB single channel, plus mips
+
+// uv layout overlay for the uv view. The unique uv edges of a mesh are
+// extracted once into a line buffer. The lines of all visible meshes are
+// rendered into one single channel texture per view, covering the unit
+// square and sized to the next power of two above the pixels the view
+// gives one uv unit. Copies sharing geometry draw their lines once.
+// Panning and zooming within a power of two only draw a textured quad, the
+// lines are drawn again when the zoom crosses into another size or the
+// visible meshes change.
+//
+// Tiled uvs outside the unit square are not shown, and past
+// UV_WIREFRAME_MAX_SIZE the lines are magnified instead of redrawn.
+// Views keep their texture for the session.
+// All functions need the shared GL context to be current.
+class UVWireframe
+{
+public:
+    static bool isVisible();
+    static void setVisible(bool enabled);
+
+    // size the overlay should have at this zoom
+    static int sizeForZoom(float pixelsPerUV);
+
+    // draws the lines of the meshes again if the view's texture has another
+    // size or showed other meshes, binds its own framebuffer, so call
+    // outside of other targets
+    static void prepare(const void* view, const QVector<Mesh*>& meshes, int size);
+
+    // textured quad over the unit square with the fixed function pipeline,
+    // into the bound target with uvToClip mapping uv to clip space
+    static void draw(const void* view, const QMatrix4x4& uvToClip);
+
+    // the uv layout changed, edges are extracted again on next use
+    static void forgetMesh(Mesh* mesh);
+
+    static qint64 totalBytes();
+};
+
+#endif // UVWIREFRAME_H